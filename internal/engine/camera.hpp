@@ -35,6 +35,10 @@ class Camera
     {
         return m_speed;
     }
+    [[nodiscard]] const float &getFar() const
+    {
+        return m_far;
+    }
 
   public:
     void setYFlip(const bool bFlip)
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+
+#include <glm/glm.hpp>
+
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief Per instance data of the draws, read from a second vertex buffer advanced once per instance
+ *
+ * The texture slot is only read by the bindless pipelines (see BindlessTable).
+ */
+class InstanceData
+{
+  public:
+    glm::mat4 model;
+    uint32_t textureSlot;
+
+    // after the vertex binding (see Vertex)
+    static constexpr uint32_t binding = 1;
+    static constexpr uint32_t firstLocation = 4;
+
+    static inline VkVertexInputBindingDescription get_instance_input_binding_description()
+    {
+        VkVertexInputBindingDescription desc = {
+            .binding = binding,
+            .stride = sizeof(InstanceData),
+            // update every instance
+            .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+        };
+
+        return desc;
+    }
+    static inline std::array<VkVertexInputAttributeDescription, 5> get_instance_input_attribute_description()
+    {
+        // a matrix takes a location per column
+        std::array<VkVertexInputAttributeDescription, 5> desc;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            desc[i] = {
+                .location = firstLocation + i,
+                .binding = binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = static_cast<uint32_t>(offsetof(InstanceData, model) + i * sizeof(glm::vec4)),
+            };
+        }
+        desc[4] = {
+            .location = firstLocation + 4,
+            .binding = binding,
+            .format = VK_FORMAT_R32_UINT,
+            .offset = offsetof(InstanceData, textureSlot),
+        };
+        return desc;
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief Specialization constant declared in a shader with layout(constant_id = ID)
+ *
+ * Booleans are 32 bits wide in SPIR-V, use VkBool32 for them.
+ */
+template <uint32_t ID, typename T> struct SpecializationConstantT
+{
+    static_assert(std::is_trivially_copyable_v<T> && (sizeof(T) == 4 || sizeof(T) == 8),
+                  "specialization constants are 32 or 64 bits scalars");
+
+    static constexpr uint32_t id = ID;
+    using type = T;
+};
+
+// constants of shaders/phong.frag
+namespace Phong
+{
+// number of point lights the loop is unrolled for
+using LightCount = SpecializationConstantT<0, int32_t>;
+// sample the albedo texture
+using UseTexture = SpecializationConstantT<1, VkBool32>;
+// discard fragments under half opacity
+using AlphaTest = SpecializationConstantT<2, VkBool32>;
+} // namespace Phong
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "buffer.hpp"
+#include "device.hpp"
+
+#include "allocation_stress.hpp"
+
+void run_allocation_stress(std::weak_ptr<Device> device, uint32_t bufferCount, VkDeviceSize bufferSize)
+{
+    auto devicePtr = device.lock();
+    MemoryAllocator *allocator = devicePtr->getAllocator();
+    uint32_t initialMemoryCount = allocator->getDeviceMemoryCount();
+
+    BufferBuilder bb;
+    BufferDirector bd;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    buffers.reserve(bufferCount);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < bufferCount; ++i)
+    {
+        bd.createVertexBufferBuilder(bb);
+        bb.setDevice(device);
+        bb.setSize(bufferSize);
+        bb.setDefragmentable(false);
+        std::unique_ptr<Buffer> buffer = bb.build();
+        if (!buffer)
+        {
+            std::cerr << "Failed to create allocation stress buffer " << i << std::endl;
+            break;
+        }
+        buffers.emplace_back(std::move(buffer));
+    }
+    auto allocationDuration = std::chrono::steady_clock::now() - start;
+    uint32_t peakMemoryCount = allocator->getDeviceMemoryCount();
+
+    // the buffers are retired through the deletion queue, nothing uses them
+    start = std::chrono::steady_clock::now();
+    buffers.clear();
+    vkDeviceWaitIdle(devicePtr->getHandle());
+    devicePtr->getDeletionQueue()->flush();
+    auto releaseDuration = std::chrono::steady_clock::now() - start;
+
+    auto allocationMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(allocationDuration).count();
+    std::cout << "Allocation stress : " << bufferCount << " buffer(s) of " << bufferSize << " bytes allocated in "
+              << allocationMicroseconds / 1000 << " ms ("
+              << static_cast<double>(allocationMicroseconds) * 1000.0 / std::max(bufferCount, 1U)
+              << " ns per buffer), released in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(releaseDuration).count() << " ms, "
+              << peakMemoryCount - initialMemoryCount << " VkDeviceMemory allocated for them ("
+              << peakMemoryCount << " live at the peak, " << allocator->getDeviceMemoryCount() << " after, limit "
+              << devicePtr->getPhysicalDeviceProperties().limits.maxMemoryAllocationCount << ")" << std::endl;
+}
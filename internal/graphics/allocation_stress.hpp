@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <vulkan/vulkan.h>
+
+class Device;
+
+/**
+ * @brief Create then destroy many small device local buffers and report the time spent and the VkDeviceMemory count
+ *
+ * The buffers are sub-allocated from the blocks of the MemoryAllocator, the live VkDeviceMemory count must stay
+ * far below maxMemoryAllocationCount. The device is waited on and the deletion queue flushed at the end.
+ */
+void run_allocation_stress(std::weak_ptr<Device> device, uint32_t bufferCount, VkDeviceSize bufferSize = 256);
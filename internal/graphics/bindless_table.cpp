@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+#include "bindless_table.hpp"
+
+BindlessTable::BindlessTable(VkDevice device, uint32_t textureCapacity, uint32_t bufferCapacity)
+    : m_device(device), m_textureSlots{.capacity = textureCapacity}, m_bufferSlots{.capacity = bufferCapacity}
+{
+    // slots are written while the set is bound by frames that do not read them, and are never all written
+    VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                                            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    std::array<VkDescriptorBindingFlags, 2> bindingsFlags = {bindingFlags, bindingFlags};
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(bindingsFlags.size()),
+        .pBindingFlags = bindingsFlags.data(),
+    };
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {
+        VkDescriptorSetLayoutBinding{
+            .binding = textureBinding,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = textureCapacity,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        },
+        VkDescriptorSetLayoutBinding{
+            .binding = bufferBinding,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = bufferCapacity,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        },
+    };
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = &bindingFlagsCreateInfo,
+        .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings = bindings.data(),
+    };
+    VkResult res = vkCreateDescriptorSetLayout(m_device, &layoutCreateInfo, nullptr, &m_setLayout);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create bindless descriptor set layout : " << res << std::endl;
+        m_setLayout = VK_NULL_HANDLE;
+        return;
+    }
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {
+        VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureCapacity},
+        VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferCapacity},
+    };
+    VkDescriptorPoolCreateInfo poolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+        .maxSets = 1,
+        .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+        .pPoolSizes = poolSizes.data(),
+    };
+    res = vkCreateDescriptorPool(m_device, &poolCreateInfo, nullptr, &m_pool);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create bindless descriptor pool : " << res << std::endl;
+        m_pool = VK_NULL_HANDLE;
+        return;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = m_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &m_setLayout,
+    };
+    res = vkAllocateDescriptorSets(m_device, &allocInfo, &m_set);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to allocate bindless descriptor set : " << res << std::endl;
+        m_set = VK_NULL_HANDLE;
+    }
+}
+
+BindlessTable::~BindlessTable()
+{
+    printStatistics();
+
+    vkDestroyDescriptorPool(m_device, m_pool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+}
+
+uint32_t BindlessTable::allocateSlot(SlotArrayT &slots)
+{
+    uint32_t slot = invalidSlot;
+    if (!slots.freeSlots.empty())
+    {
+        slot = slots.freeSlots.back();
+        slots.freeSlots.pop_back();
+    }
+    else if (slots.count < slots.capacity)
+    {
+        slot = slots.count++;
+    }
+    else
+    {
+        return invalidSlot;
+    }
+
+    ++slots.usedCount;
+    slots.peakUsedCount = std::max(slots.peakUsedCount, slots.usedCount);
+    return slot;
+}
+
+void BindlessTable::releaseSlot(SlotArrayT &slots, uint32_t slot)
+{
+    if (slot == invalidSlot)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // the descriptor is left as is, partially bound arrays may hold stale descriptors that are not read
+    slots.freeSlots.emplace_back(slot);
+    --slots.usedCount;
+}
+
+uint32_t BindlessTable::registerTexture(VkImageView imageView, VkSampler sampler)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t slot = allocateSlot(m_textureSlots);
+    if (slot == invalidSlot)
+    {
+        std::cerr << "Failed to register texture : the bindless table is full (" << m_textureSlots.capacity
+                  << " slots)" << std::endl;
+        return invalidSlot;
+    }
+
+    VkDescriptorImageInfo imageInfo = {
+        .sampler = sampler,
+        .imageView = imageView,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+    VkWriteDescriptorSet write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = m_set,
+        .dstBinding = textureBinding,
+        .dstArrayElement = slot,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &imageInfo,
+    };
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+    return slot;
+}
+
+uint32_t BindlessTable::registerBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t slot = allocateSlot(m_bufferSlots);
+    if (slot == invalidSlot)
+    {
+        std::cerr << "Failed to register buffer : the bindless table is full (" << m_bufferSlots.capacity
+                  << " slots)" << std::endl;
+        return invalidSlot;
+    }
+
+    VkDescriptorBufferInfo bufferInfo = {
+        .buffer = buffer,
+        .offset = offset,
+        .range = range,
+    };
+    VkWriteDescriptorSet write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = m_set,
+        .dstBinding = bufferBinding,
+        .dstArrayElement = slot,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &bufferInfo,
+    };
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+    return slot;
+}
+
+void BindlessTable::releaseTexture(uint32_t slot)
+{
+    releaseSlot(m_textureSlots, slot);
+}
+
+void BindlessTable::releaseBuffer(uint32_t slot)
+{
+    releaseSlot(m_bufferSlots, slot);
+}
+
+void BindlessTable::printStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_textureSlots.peakUsedCount == 0 && m_bufferSlots.peakUsedCount == 0)
+        return;
+
+    std::cout << "Bindless table : " << m_textureSlots.peakUsedCount << "/" << m_textureSlots.capacity
+              << " texture slot(s), " << m_bufferSlots.peakUsedCount << "/" << m_bufferSlots.capacity
+              << " buffer slot(s) used at most" << std::endl;
+}
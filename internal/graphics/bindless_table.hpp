@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief Device wide descriptor set of every texture and storage buffer (descriptor indexing)
+ *
+ * Resources register into a slot of an update-after-bind array and shaders index the array with the
+ * slot, so that the set is bound once per command buffer instead of once per object. A slot must only
+ * be released once the frames using it are retired (see DeletionQueue), a released slot is rewritten
+ * by the next registration.
+ */
+class BindlessTable
+{
+  private:
+    struct SlotArrayT
+    {
+        uint32_t capacity;
+        // slots below are or have been in use
+        uint32_t count = 0;
+        std::vector<uint32_t> freeSlots;
+        uint32_t usedCount = 0;
+        uint32_t peakUsedCount = 0;
+    };
+
+    VkDevice m_device;
+
+    VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool m_pool = VK_NULL_HANDLE;
+    VkDescriptorSet m_set = VK_NULL_HANDLE;
+
+    SlotArrayT m_textureSlots;
+    SlotArrayT m_bufferSlots;
+
+    mutable std::mutex m_mutex;
+
+    [[nodiscard]] uint32_t allocateSlot(SlotArrayT &slots);
+    void releaseSlot(SlotArrayT &slots, uint32_t slot);
+
+  public:
+    static constexpr uint32_t invalidSlot = std::numeric_limits<uint32_t>::max();
+
+    // set index of the table in the pipeline layouts, in place of the material set
+    static constexpr uint32_t setIndex = 1;
+    // sampler2D textures[] and buffer arrays in the shaders
+    static constexpr uint32_t textureBinding = 0;
+    static constexpr uint32_t bufferBinding = 1;
+
+    BindlessTable(VkDevice device, uint32_t textureCapacity, uint32_t bufferCapacity);
+    ~BindlessTable();
+
+    BindlessTable(const BindlessTable &) = delete;
+    BindlessTable &operator=(const BindlessTable &) = delete;
+    BindlessTable(BindlessTable &&) = delete;
+    BindlessTable &operator=(BindlessTable &&) = delete;
+
+    /**
+     * @brief Write a combined image sampler in a free slot
+     *
+     * @return invalidSlot if the table is full
+     */
+    [[nodiscard]] uint32_t registerTexture(VkImageView imageView, VkSampler sampler);
+    /**
+     * @brief Write a storage buffer range in a free slot
+     *
+     * @return invalidSlot if the table is full
+     */
+    [[nodiscard]] uint32_t registerBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+    /**
+     * @brief Give back a slot, no frame in flight may use it anymore (invalidSlot is ignored)
+     *
+     */
+    void releaseTexture(uint32_t slot);
+    void releaseBuffer(uint32_t slot);
+
+    void printStatistics() const;
+
+  public:
+    [[nodiscard]] inline VkDescriptorSetLayout getSetLayout() const
+    {
+        return m_setLayout;
+    }
+    /**
+     * @brief VK_NULL_HANDLE if the table could not be created
+     *
+     */
+    [[nodiscard]] inline VkDescriptorSet getSet() const
+    {
+        return m_set;
+    }
+};
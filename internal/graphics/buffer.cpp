@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 
 #include "device.hpp"
@@ -7,16 +9,89 @@
 
 #include "buffer.hpp"
 
+VkMappedMemoryRange Buffer::getAlignedMemoryRange(VkDeviceSize begin, VkDeviceSize end) const
+{
+    VkDeviceSize atomMask = m_nonCoherentAtomSize - 1;
+    VkDeviceSize memoryBegin = (m_allocation.offset + begin) & ~atomMask;
+    VkDeviceSize memoryEnd = (m_allocation.offset + end + atomMask) & ~atomMask;
+
+    VkMappedMemoryRange range = {
+        .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .memory = m_allocation.memory,
+        .offset = memoryBegin,
+        .size = memoryEnd - memoryBegin,
+    };
+
+    // sub-allocations are power of two nodes at least as large as the atom, only a dedicated
+    // allocation can end before the aligned range does
+    if (m_allocation.blockIndex == UINT32_MAX && memoryEnd > m_allocation.size)
+        range.size = VK_WHOLE_SIZE;
+
+    return range;
+}
+
 void Buffer::copyDataToMemory(const void *srcData)
 {
-    auto deviceHandle = m_device.lock()->getHandle();
-    // filling the VBO (bind and unbind CPU accessible memory)
-    void *data;
-    vkMapMemory(deviceHandle, m_memory, 0, m_size, 0, &data);
-    // TODO : flush memory
-    memcpy(data, srcData, m_size);
-    // TODO : invalidate memory before reading in the pipeline
-    vkUnmapMemory(deviceHandle, m_memory);
+    write(0, std::span<const std::byte>(static_cast<const std::byte *>(srcData), m_size));
+    flush();
+}
+
+void Buffer::write(VkDeviceSize offset, std::span<const std::byte> data)
+{
+    // host visible blocks are persistently mapped by the allocator
+    assert(m_allocation.mapped);
+    assert(offset + data.size() <= m_size);
+
+    memcpy(static_cast<std::byte *>(m_allocation.mapped) + offset, data.data(), data.size());
+
+    if (m_bHostCoherent || data.empty())
+        return;
+
+    // sequential writes extend the last range instead of adding a new one
+    VkDeviceSize end = offset + data.size();
+    if (!m_dirtyRanges.empty() && offset <= m_dirtyRanges.back().end && end >= m_dirtyRanges.back().begin)
+    {
+        m_dirtyRanges.back().begin = std::min(m_dirtyRanges.back().begin, offset);
+        m_dirtyRanges.back().end = std::max(m_dirtyRanges.back().end, end);
+        return;
+    }
+    m_dirtyRanges.emplace_back(RangeT{
+        .begin = offset,
+        .end = end,
+    });
+}
+
+void Buffer::flush()
+{
+    if (m_dirtyRanges.empty())
+        return;
+
+    std::sort(m_dirtyRanges.begin(), m_dirtyRanges.end(),
+              [](const RangeT &a, const RangeT &b) { return a.begin < b.begin; });
+
+    // merge the ranges that overlap once aligned, then flush everything with a single call
+    std::vector<VkMappedMemoryRange> ranges;
+    ranges.reserve(m_dirtyRanges.size());
+    for (const RangeT &dirtyRange : m_dirtyRanges)
+    {
+        VkMappedMemoryRange range = getAlignedMemoryRange(dirtyRange.begin, dirtyRange.end);
+        if (!ranges.empty() && ranges.back().size != VK_WHOLE_SIZE &&
+            range.offset <= ranges.back().offset + ranges.back().size)
+        {
+            VkDeviceSize end = range.size == VK_WHOLE_SIZE
+                                   ? VK_WHOLE_SIZE
+                                   : std::max(ranges.back().offset + ranges.back().size, range.offset + range.size);
+            ranges.back().size = end == VK_WHOLE_SIZE ? VK_WHOLE_SIZE : end - ranges.back().offset;
+            continue;
+        }
+        ranges.emplace_back(range);
+    }
+    m_dirtyRanges.clear();
+
+    VkResult res = vkFlushMappedMemoryRanges(m_device.lock()->getHandle(), static_cast<uint32_t>(ranges.size()),
+                                             ranges.data());
+    if (res != VK_SUCCESS)
+        std::cerr << "Failed to flush mapped memory ranges : " << res << std::endl;
 }
 
 void Buffer::transferBufferToBuffer(VkBuffer src)
@@ -25,21 +100,78 @@ void Buffer::transferBufferToBuffer(VkBuffer src)
 
     VkCommandBuffer commandBuffer = devicePtr->cmdBeginOneTimeSubmit();
 
+    recordTransferBufferToBuffer(commandBuffer, src, 0, m_size);
+
+    devicePtr->cmdEndOneTimeSubmit(commandBuffer);
+}
+
+void Buffer::recordTransferBufferToBuffer(VkCommandBuffer commandBuffer, VkBuffer src, VkDeviceSize srcOffset,
+                                          VkDeviceSize size, VkDeviceSize dstOffset) const
+{
     VkBufferCopy copyRegion{
-        .size = m_size,
+        .srcOffset = srcOffset,
+        .dstOffset = dstOffset,
+        .size = size,
     };
     vkCmdCopyBuffer(commandBuffer, src, m_handle, 1, &copyRegion);
-
-    devicePtr->cmdEndOneTimeSubmit(commandBuffer);
 }
 
 Buffer::~Buffer()
 {
-    auto deviceHandle = m_device.lock()->getHandle();
+    if (!m_device.lock())
+        return;
 
-    vkFreeMemory(deviceHandle, m_memory, nullptr);
+    auto devicePtr = m_device.lock();
+
+    if (m_bDefragmentable)
+        devicePtr->getDefragmenter()->unregisterResource(this);
+
+    // the buffer may still be referenced by frames in flight
+    devicePtr->getDeletionQueue()->push(
+        [deviceHandle = devicePtr->getHandle(), allocator = devicePtr->getAllocator(), handle = m_handle,
+         allocation = m_allocation]() {
+            vkDestroyBuffer(deviceHandle, handle, nullptr);
+            allocator->free(allocation);
+        });
+}
+
+bool Buffer::recordMove(VkCommandBuffer commandBuffer, const MemoryAllocationT &allocation)
+{
+    auto devicePtr = m_device.lock();
+    auto deviceHandle = devicePtr->getHandle();
+
+    VkBufferCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = m_size,
+        .usage = m_usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    VkBuffer handle;
+    VkResult res = vkCreateBuffer(deviceHandle, &createInfo, nullptr, &handle);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create moved buffer : " << res << std::endl;
+        return false;
+    }
+    vkBindBufferMemory(deviceHandle, handle, allocation.memory, allocation.offset);
+
+    VkBufferCopy copyRegion{
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = m_size,
+    };
+    vkCmdCopyBuffer(commandBuffer, m_handle, handle, 1, &copyRegion);
 
-    vkDestroyBuffer(deviceHandle, m_handle, nullptr);
+    // frames in flight still read the old buffer
+    devicePtr->getDeletionQueue()->push([deviceHandle, allocator = devicePtr->getAllocator(), handle = m_handle,
+                                         oldAllocation = m_allocation]() {
+        vkDestroyBuffer(deviceHandle, handle, nullptr);
+        allocator->free(oldAllocation);
+    });
+
+    m_handle = handle;
+    m_allocation = allocation;
+    return true;
 }
 
 std::unique_ptr<Buffer> BufferBuilder::build()
@@ -49,10 +181,15 @@ std::unique_ptr<Buffer> BufferBuilder::build()
     auto devicePtr = m_device.lock();
     auto deviceHandle = devicePtr->getHandle();
 
+    // moves copy the content from the old buffer to the new one
+    m_product->m_usage = m_usage;
+    if (m_bDefragmentable)
+        m_product->m_usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
     VkBufferCreateInfo createInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
                                      .flags = 0,
                                      .size = m_size,
-                                     .usage = m_usage,
+                                     .usage = m_product->m_usage,
                                      .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
     VkResult res = vkCreateBuffer(deviceHandle, &createInfo, nullptr, &m_product->m_handle);
     if (res != VK_SUCCESS)
@@ -61,41 +198,82 @@ std::unique_ptr<Buffer> BufferBuilder::build()
         return nullptr;
     }
 
-    VkMemoryRequirements memReq;
-    vkGetBufferMemoryRequirements(deviceHandle, m_product->m_handle, &memReq);
-    std::optional<uint32_t> memoryTypeIndex = devicePtr->findMemoryTypeIndex(memReq, m_properties);
-    VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-                                      .allocationSize = memReq.size,
-                                      .memoryTypeIndex = memoryTypeIndex.value()};
-    res = vkAllocateMemory(deviceHandle, &allocInfo, nullptr, &m_product->m_memory);
-    if (res != VK_SUCCESS)
+    MemoryAllocator *allocator = devicePtr->getAllocator();
+    MemoryRequirementsT memReq = allocator->getBufferMemoryRequirements(m_product->m_handle);
+    std::optional<uint32_t> memoryTypeIndex =
+        devicePtr->findMemoryTypeIndex(memReq.requirements, m_properties, m_preferredProperties);
+    if (!memoryTypeIndex.has_value())
+    {
+        std::cerr << "Failed to find a memory type for the buffer" << std::endl;
+        vkDestroyBuffer(deviceHandle, m_product->m_handle, nullptr);
+        m_product->m_handle = VK_NULL_HANDLE;
+        return nullptr;
+    }
+
+    std::optional<MemoryAllocationT> allocation =
+        allocator->allocate(memReq, memoryTypeIndex.value(), true, false, m_memoryCategory);
+    if (!allocation.has_value())
     {
-        std::cerr << "Failed to allocate buffer memory : " << res << std::endl;
+        std::cerr << "Failed to allocate buffer memory" << std::endl;
         return nullptr;
     }
+    m_product->m_allocation = allocation.value();
+
+    m_product->m_bHostCoherent =
+        allocator->getMemoryPropertyFlags(memoryTypeIndex.value()) & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    m_product->m_nonCoherentAtomSize = devicePtr->getPhysicalDeviceProperties().limits.nonCoherentAtomSize;
 
-    vkBindBufferMemory(deviceHandle, m_product->m_handle, m_product->m_memory, 0);
+    vkBindBufferMemory(deviceHandle, m_product->m_handle, m_product->m_allocation.memory,
+                       m_product->m_allocation.offset);
 
-    return std::move(m_product);
+    m_product->m_creationFrameSerial = devicePtr->getDeletionQueue()->getFrameSerial();
+    m_product->m_bDefragmentable = m_bDefragmentable && !m_product->m_allocation.mapped;
+    if (m_product->m_bDefragmentable)
+        devicePtr->getDefragmenter()->registerResource(m_product.get());
+
+    auto result = std::move(m_product);
+    restart();
+    return result;
 }
 
 void BufferDirector::createStagingBufferBuilder(BufferBuilder &builder)
 {
     builder.setUsage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
     builder.setProperties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    builder.setMemoryCategory(MemoryCategory::Staging);
 }
 void BufferDirector::createVertexBufferBuilder(BufferBuilder &builder)
 {
     builder.setUsage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
     builder.setProperties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    builder.setMemoryCategory(MemoryCategory::Vertex);
+    builder.setDefragmentable(true);
 }
 void BufferDirector::createIndexBufferBuilder(BufferBuilder &builder)
 {
     builder.setUsage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
     builder.setProperties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    builder.setMemoryCategory(MemoryCategory::Index);
+    builder.setDefragmentable(true);
 }
 void BufferDirector::createUniformBufferBuilder(BufferBuilder &builder)
 {
+    // written through Buffer::write, non-coherent memory is flushed once per frame
     builder.setUsage(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    builder.setProperties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    builder.setPreferredProperties(VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    builder.setMemoryCategory(MemoryCategory::Uniform);
+}
+void BufferDirector::createInstanceBufferBuilder(BufferBuilder &builder)
+{
+    // written sequentially and never read back, coherent memory spares the flushes
+    builder.setUsage(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    builder.setProperties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    builder.setMemoryCategory(MemoryCategory::Vertex);
+}
+void BufferDirector::createIndirectBufferBuilder(BufferBuilder &builder)
+{
+    builder.setUsage(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
     builder.setProperties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    builder.setMemoryCategory(MemoryCategory::Other);
 }
\ No newline at end of file
@@ -1,36 +1,91 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
+#include <span>
+#include <vector>
 
 #include <vulkan/vulkan.hpp>
 
+#include "memory_allocator.hpp"
+#include "memory_defragmenter.hpp"
+
 class Device;
 class BufferBuilder;
 
-class Buffer
+/**
+ * @brief Device buffer, host visible buffers are persistently mapped
+ *
+ * Writes to non-coherent memory are tracked as dirty ranges and made visible to the device
+ * with a single vkFlushMappedMemoryRanges call in flush().
+ * Defragmentable buffers may change handle between frames, the handle must not be cached.
+ */
+class Buffer : public DefragmentableI
 {
     friend BufferBuilder;
 
   private:
+    struct RangeT
+    {
+        VkDeviceSize begin;
+        VkDeviceSize end;
+    };
+
     std::weak_ptr<Device> m_device;
 
     VkBuffer m_handle;
-    VkDeviceMemory m_memory;
+    MemoryAllocationT m_allocation;
     size_t m_size;
+    VkBufferUsageFlags m_usage;
+
+    bool m_bDefragmentable = false;
+    uint64_t m_creationFrameSerial = 0;
+
+    bool m_bHostCoherent = true;
+    VkDeviceSize m_nonCoherentAtomSize = 1;
+
+    // written ranges not flushed yet (non-coherent memory only)
+    std::vector<RangeT> m_dirtyRanges;
 
     Buffer() = default;
 
+    /**
+     * @brief Expand a range of the buffer to nonCoherentAtomSize boundaries in its device memory
+     *
+     */
+    [[nodiscard]] VkMappedMemoryRange getAlignedMemoryRange(VkDeviceSize begin, VkDeviceSize end) const;
+
   public:
-    ~Buffer();
+    ~Buffer() override;
 
     Buffer(const Buffer &) = delete;
     Buffer &operator=(const Buffer &) = delete;
     Buffer(Buffer &&) = delete;
     Buffer &operator=(Buffer &&) = delete;
 
+    /**
+     * @brief Write the whole buffer and flush it
+     *
+     */
     void copyDataToMemory(const void *srcData);
 
+    /**
+     * @brief Copy bytes into the mapped buffer, call flush() before the device reads them
+     *
+     */
+    void write(VkDeviceSize offset, std::span<const std::byte> data);
+
+    /**
+     * @brief Flush every range written since the last flush (does nothing on coherent memory)
+     *
+     */
+    void flush();
+
     void transferBufferToBuffer(VkBuffer src);
+    void recordTransferBufferToBuffer(VkCommandBuffer commandBuffer, VkBuffer src, VkDeviceSize srcOffset,
+                                      VkDeviceSize size, VkDeviceSize dstOffset = 0) const;
+
+    [[nodiscard]] bool recordMove(VkCommandBuffer commandBuffer, const MemoryAllocationT &allocation) override;
 
   public:
     [[nodiscard]] inline const VkBuffer &getHandle() const
@@ -38,9 +93,26 @@ class Buffer
         return m_handle;
     }
 
-    [[nodiscard]] inline const VkDeviceMemory &getMemory() const
+    [[nodiscard]] inline size_t getSize() const
+    {
+        return m_size;
+    }
+
+    [[nodiscard]] inline const MemoryAllocationT &getAllocation() const override
     {
-        return m_memory;
+        return m_allocation;
+    }
+    [[nodiscard]] inline uint64_t getCreationFrameSerial() const override
+    {
+        return m_creationFrameSerial;
+    }
+    [[nodiscard]] inline void *getMappedData() const
+    {
+        return m_allocation.mapped;
+    }
+    [[nodiscard]] inline bool isHostCoherent() const
+    {
+        return m_bHostCoherent;
     }
 };
 
@@ -55,6 +127,11 @@ class BufferBuilder
 
     VkBufferUsageFlags m_usage;
     VkMemoryPropertyFlags m_properties;
+    VkMemoryPropertyFlags m_preferredProperties = 0;
+
+    MemoryCategory m_memoryCategory = MemoryCategory::Other;
+
+    bool m_bDefragmentable = false;
 
   public:
     BufferBuilder()
@@ -85,6 +162,26 @@ class BufferBuilder
     {
         m_properties = a;
     }
+    /**
+     * @brief Properties used in addition to the required ones when a memory type supports them
+     *
+     */
+    void setPreferredProperties(VkMemoryPropertyFlags a)
+    {
+        m_preferredProperties = a;
+    }
+    void setMemoryCategory(MemoryCategory a)
+    {
+        m_memoryCategory = a;
+    }
+    /**
+     * @brief Let the defragmenter move the buffer (device local memory only, adds the transfer usages)
+     *
+     */
+    void setDefragmentable(bool a)
+    {
+        m_bDefragmentable = a;
+    }
 
     std::unique_ptr<Buffer> build();
 };
@@ -96,4 +193,14 @@ class BufferDirector
     void createVertexBufferBuilder(BufferBuilder &builder);
     void createIndexBufferBuilder(BufferBuilder &builder);
     void createUniformBufferBuilder(BufferBuilder &builder);
+    /**
+     * @brief Vertex buffer of per instance data, rewritten by the host every frame
+     *
+     */
+    void createInstanceBufferBuilder(BufferBuilder &builder);
+    /**
+     * @brief Buffer of indirect draw commands, rewritten by the host every frame
+     *
+     */
+    void createIndirectBufferBuilder(BufferBuilder &builder);
 };
\ No newline at end of file
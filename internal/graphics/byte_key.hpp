@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+/**
+ * @brief Append the bytes of a value to a serialized key or description
+ *
+ * Keys built this way are compared byte for byte (see PipelineRegistry, DescriptorAllocator), the value must
+ * have no padding.
+ */
+template <typename T> inline void append_bytes(std::string &out, const T &value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+/**
+ * @brief Read a value written by append_bytes and advance the cursor
+ *
+ * @return false if the input is too short
+ */
+template <typename T> inline bool read_bytes(const std::string &in, size_t &cursor, T &value)
+{
+    if (in.size() - cursor < sizeof(T))
+        return false;
+    memcpy(&value, in.data() + cursor, sizeof(T));
+    cursor += sizeof(T);
+    return true;
+}
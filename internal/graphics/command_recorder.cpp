@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "device.hpp"
+#include "pipeline.hpp"
+
+#include "command_recorder.hpp"
+
+CommandRecorder::CommandRecorder(std::weak_ptr<Device> device) : m_dynamicStateRecorder(device)
+{
+    auto devicePtr = device.lock();
+    if (devicePtr->getPhysicalDeviceFeatures().multiDrawIndirect)
+        m_maxDrawIndirectCount = devicePtr->getPhysicalDeviceProperties().limits.maxDrawIndirectCount;
+}
+
+CommandRecorder::~CommandRecorder()
+{
+    printStatistics();
+}
+
+bool CommandRecorder::isDirty(bool bDirty)
+{
+    if (bDirty)
+        ++m_stats.issuedBindCount;
+    else
+        ++m_stats.skippedBindCount;
+    return bDirty;
+}
+
+void CommandRecorder::begin(VkCommandBuffer commandBuffer)
+{
+    m_commandBuffer = commandBuffer;
+
+    m_pipeline = VK_NULL_HANDLE;
+    m_viewport.reset();
+    m_scissor.reset();
+    m_sets.fill({});
+    m_vertexBuffers.fill({});
+    m_indexBuffer = {};
+    m_dynamicStateRecorder.reset();
+}
+
+void CommandRecorder::bindPipeline(const Pipeline &pipeline)
+{
+    VkPipeline handle = pipeline.getHandle();
+    if (isDirty(handle != m_pipeline))
+    {
+        vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, handle);
+        m_pipeline = handle;
+    }
+
+    // binding a pipeline whose state is baked invalidates the dynamic state set before it
+    if (!pipeline.hasDynamicState())
+        m_dynamicStateRecorder.reset();
+    if (!pipeline.hasDynamicViewport())
+    {
+        m_viewport.reset();
+        m_scissor.reset();
+        return;
+    }
+
+    const VkExtent2D &extent = pipeline.getExtent();
+    setViewport(VkViewport{
+        .x = 0.f,
+        .y = 0.f,
+        .width = static_cast<float>(extent.width),
+        .height = static_cast<float>(extent.height),
+        .minDepth = 0.f,
+        .maxDepth = 1.f,
+    });
+    setScissor(VkRect2D{.offset = {0, 0}, .extent = extent});
+}
+
+void CommandRecorder::setViewport(const VkViewport &viewport)
+{
+    if (!isDirty(!m_viewport.has_value() || memcmp(&*m_viewport, &viewport, sizeof(VkViewport)) != 0))
+        return;
+
+    vkCmdSetViewport(m_commandBuffer, 0, 1, &viewport);
+    m_viewport = viewport;
+}
+
+void CommandRecorder::setScissor(const VkRect2D &scissor)
+{
+    if (!isDirty(!m_scissor.has_value() || memcmp(&*m_scissor, &scissor, sizeof(VkRect2D)) != 0))
+        return;
+
+    vkCmdSetScissor(m_commandBuffer, 0, 1, &scissor);
+    m_scissor = scissor;
+}
+
+void CommandRecorder::bindDescriptorSet(VkPipelineLayout pipelineLayout, uint32_t setIndex, VkDescriptorSet set,
+                                        std::span<const uint32_t> dynamicOffsets)
+{
+    if (setIndex >= trackedSetCount)
+    {
+        isDirty(true);
+        vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setIndex, 1, &set,
+                                static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+        return;
+    }
+
+    BoundSetT &bound = m_sets[setIndex];
+    bool bSame = bound.layout == pipelineLayout && bound.set == set &&
+                 std::equal(bound.dynamicOffsets.begin(), bound.dynamicOffsets.end(), dynamicOffsets.begin(),
+                            dynamicOffsets.end());
+    if (!isDirty(!bSame))
+        return;
+
+    vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, setIndex, 1, &set,
+                            static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+    bound.layout = pipelineLayout;
+    bound.set = set;
+    bound.dynamicOffsets.assign(dynamicOffsets.begin(), dynamicOffsets.end());
+
+    // the sets bound with an other layout may have been disturbed, compatible layouts are not told apart
+    for (BoundSetT &other : m_sets)
+    {
+        if (other.layout != pipelineLayout)
+            other = {};
+    }
+}
+
+void CommandRecorder::bindVertexBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset)
+{
+    if (binding < trackedVertexBindingCount)
+    {
+        BoundBufferT &bound = m_vertexBuffers[binding];
+        if (!isDirty(bound.buffer != buffer || bound.offset != offset))
+            return;
+        bound = {.buffer = buffer, .offset = offset};
+    }
+    else
+    {
+        isDirty(true);
+    }
+
+    vkCmdBindVertexBuffers(m_commandBuffer, binding, 1, &buffer, &offset);
+}
+
+void CommandRecorder::bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType)
+{
+    if (!isDirty(m_indexBuffer.buffer != buffer || m_indexBuffer.offset != offset || m_indexType != indexType))
+        return;
+
+    vkCmdBindIndexBuffer(m_commandBuffer, buffer, offset, indexType);
+    m_indexBuffer = {.buffer = buffer, .offset = offset};
+    m_indexType = indexType;
+}
+
+void CommandRecorder::setDynamicState(const DynamicStateT &state)
+{
+    m_dynamicStateRecorder.record(m_commandBuffer, state);
+}
+
+void CommandRecorder::pushConstants(VkPipelineLayout pipelineLayout, VkShaderStageFlags stageFlags, uint32_t offset,
+                                    uint32_t size, const void *values)
+{
+    vkCmdPushConstants(m_commandBuffer, pipelineLayout, stageFlags, offset, size, values);
+}
+
+void CommandRecorder::drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex,
+                                  int32_t vertexOffset, uint32_t firstInstance)
+{
+    ++m_stats.drawCount;
+    vkCmdDrawIndexed(m_commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+
+void CommandRecorder::drawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount)
+{
+    m_stats.drawCount += drawCount;
+    for (uint32_t first = 0; first < drawCount; first += m_maxDrawIndirectCount)
+    {
+        ++m_stats.indirectCallCount;
+        vkCmdDrawIndexedIndirect(m_commandBuffer, buffer, offset + first * sizeof(VkDrawIndexedIndirectCommand),
+                                 std::min(drawCount - first, m_maxDrawIndirectCount),
+                                 sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+void CommandRecorder::printStatistics() const
+{
+    uint64_t bindCount = m_stats.issuedBindCount + m_stats.skippedBindCount;
+    if (bindCount == 0)
+        return;
+
+    std::cout << "Command recorder : " << m_stats.issuedBindCount << " bind(s) recorded, " << m_stats.skippedBindCount
+              << " redundant bind(s) skipped (" << 100 * m_stats.skippedBindCount / bindCount << "%), "
+              << m_stats.drawCount << " draw(s) (" << m_stats.indirectCallCount << " indirect call(s))" << std::endl;
+}
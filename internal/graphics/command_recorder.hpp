@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "dynamic_state.hpp"
+
+class Device;
+class Pipeline;
+
+struct CommandRecorderStatsT
+{
+    uint64_t issuedBindCount = 0;
+    uint64_t skippedBindCount = 0;
+    // indirect draws count as one draw per command
+    uint64_t drawCount = 0;
+    uint64_t indirectCallCount = 0;
+};
+
+/**
+ * @brief Records the draws of a command buffer, skipping the binds and states that are already current
+ *
+ * The recorder tracks the pipeline, the viewport and scissor, the descriptor sets and the vertex and
+ * index buffers of a single command buffer. It must be begun again when recording an other command buffer,
+ * commands recorded without it make its state stale.
+ */
+class CommandRecorder
+{
+  private:
+    struct BoundSetT
+    {
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        std::vector<uint32_t> dynamicOffsets;
+    };
+
+    struct BoundBufferT
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+    };
+
+    // sets and vertex bindings above these are bound without being tracked
+    static constexpr uint32_t trackedSetCount = 4;
+    static constexpr uint32_t trackedVertexBindingCount = 4;
+
+    VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+
+    // state of the command buffer, unknown after begin
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    std::optional<VkViewport> m_viewport;
+    std::optional<VkRect2D> m_scissor;
+    std::array<BoundSetT, trackedSetCount> m_sets;
+    std::array<BoundBufferT, trackedVertexBindingCount> m_vertexBuffers;
+    BoundBufferT m_indexBuffer;
+    VkIndexType m_indexType = VK_INDEX_TYPE_UINT16;
+
+    // extended dynamic state of the draws
+    DynamicStateRecorder m_dynamicStateRecorder;
+
+    // commands read by an indirect draw call, 1 without multiDrawIndirect
+    uint32_t m_maxDrawIndirectCount = 1;
+
+    CommandRecorderStatsT m_stats;
+
+    // counts the bind and tells whether it must be recorded
+    bool isDirty(bool bDirty);
+
+  public:
+    CommandRecorder(std::weak_ptr<Device> device);
+    ~CommandRecorder();
+
+    CommandRecorder(const CommandRecorder &) = delete;
+    CommandRecorder &operator=(const CommandRecorder &) = delete;
+    CommandRecorder(CommandRecorder &&) = delete;
+    CommandRecorder &operator=(CommandRecorder &&) = delete;
+
+    /**
+     * @brief Record in a command buffer whose state is unknown, the next commands are all recorded
+     *
+     */
+    void begin(VkCommandBuffer commandBuffer);
+
+    /**
+     * @brief Bind a pipeline and set its viewport and scissor to its whole extent if they are dynamic
+     *
+     * A pipeline whose state is baked resets the dynamic state of the command buffer.
+     */
+    void bindPipeline(const Pipeline &pipeline);
+    void setViewport(const VkViewport &viewport);
+    void setScissor(const VkRect2D &scissor);
+
+    /**
+     * @brief Bind a descriptor set, the bind is skipped if the same set and offsets are bound with the same layout
+     *
+     */
+    void bindDescriptorSet(VkPipelineLayout pipelineLayout, uint32_t setIndex, VkDescriptorSet set,
+                           std::span<const uint32_t> dynamicOffsets = {});
+    void bindVertexBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset);
+    void bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType);
+
+    /**
+     * @brief Set the states of the next draws that differ from the current ones (see DynamicStateRecorder)
+     *
+     */
+    void setDynamicState(const DynamicStateT &state);
+
+    void pushConstants(VkPipelineLayout pipelineLayout, VkShaderStageFlags stageFlags, uint32_t offset,
+                       uint32_t size, const void *values);
+    void drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset,
+                     uint32_t firstInstance);
+    /**
+     * @brief Draw the VkDrawIndexedIndirectCommand array of a buffer
+     *
+     * The array is drawn in as few calls as the device allows, one call per command without multiDrawIndirect.
+     */
+    void drawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount);
+
+    void printStatistics() const;
+
+  public:
+    [[nodiscard]] VkCommandBuffer getCommandBuffer() const
+    {
+        return m_commandBuffer;
+    }
+    [[nodiscard]] const CommandRecorderStatsT &getStatistics() const
+    {
+        return m_stats;
+    }
+};
@@ -18,6 +18,8 @@ std::unique_ptr<Context> ContextBuilder::build()
     InstanceBuilder ib;
     ib.setContext(m_product.get());
     ib.setUseReportCallback(false);
+    // timeline semaphores and the other Vulkan 1.2 features are used by the device
+    ib.setApiVersion(1, 2, 0);
     // TODO : set app name and version (editable)
     m_product->m_instance = ib.build();
     return std::move(m_product);
@@ -0,0 +1,59 @@
+#include "deletion_queue.hpp"
+
+DeletionQueue::~DeletionQueue()
+{
+    flush();
+}
+
+void DeletionQueue::run(std::deque<DeletionT> &deletions)
+{
+    // deleters run outside of the lock, destroying an object may push other deletions
+    for (DeletionT &deletion : deletions)
+        deletion.deleter();
+}
+
+void DeletionQueue::push(std::function<void()> &&deleter)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_deletions.emplace_back(DeletionT{
+        .frameSerial = m_frameSerial,
+        .deleter = std::move(deleter),
+    });
+}
+
+uint64_t DeletionQueue::endFrame()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frameSerial++;
+}
+
+void DeletionQueue::collect(uint64_t completedFrameSerial)
+{
+    std::deque<DeletionT> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // deletions are pushed in serial order
+        while (!m_deletions.empty() && m_deletions.front().frameSerial <= completedFrameSerial)
+        {
+            ready.emplace_back(std::move(m_deletions.front()));
+            m_deletions.pop_front();
+        }
+    }
+    run(ready);
+}
+
+void DeletionQueue::flush()
+{
+    // deleters may push again (e.g. a texture releasing its image), loop until the queue is empty
+    while (true)
+    {
+        std::deque<DeletionT> ready;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_deletions.empty())
+                return;
+            ready.swap(m_deletions);
+        }
+        run(ready);
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+/**
+ * @brief Defers the destruction of Vulkan objects until the GPU is done with them
+ *
+ * Every deletion is tagged with the serial of the frame being recorded when it was pushed.
+ * The renderer ends a frame by taking its serial and collects the deletions of a serial once
+ * the fence of that frame has been waited on. Frames retire in submission order, so a retired
+ * serial means every older serial is retired too.
+ * Deletions pushed while no frame is ever submitted are only run by flush().
+ */
+class DeletionQueue
+{
+  private:
+    struct DeletionT
+    {
+        uint64_t frameSerial;
+        std::function<void()> deleter;
+    };
+
+    // serial of the frame currently being recorded
+    uint64_t m_frameSerial = 1;
+
+    std::deque<DeletionT> m_deletions;
+
+    mutable std::mutex m_mutex;
+
+    void run(std::deque<DeletionT> &deletions);
+
+  public:
+    DeletionQueue() = default;
+    ~DeletionQueue();
+
+    DeletionQueue(const DeletionQueue &) = delete;
+    DeletionQueue &operator=(const DeletionQueue &) = delete;
+    DeletionQueue(DeletionQueue &&) = delete;
+    DeletionQueue &operator=(DeletionQueue &&) = delete;
+
+    /**
+     * @brief Destroy objects once the frame being recorded has been retired
+     *
+     */
+    void push(std::function<void()> &&deleter);
+
+    /**
+     * @brief Close the frame being recorded
+     *
+     * @return the serial to pass to collect() once the frame's submission has completed
+     */
+    uint64_t endFrame();
+
+    /**
+     * @brief Run every deletion pushed up to (and including) the given frame serial
+     *
+     */
+    void collect(uint64_t completedFrameSerial);
+
+    /**
+     * @brief Run every pending deletion, the device must be idle
+     *
+     */
+    void flush();
+
+  public:
+    [[nodiscard]] uint64_t getFrameSerial() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_frameSerial;
+    }
+    [[nodiscard]] size_t getPendingCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_deletions.size();
+    }
+};
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <iostream>
+
+#include "byte_key.hpp"
+#include "deletion_queue.hpp"
+
+#include "descriptor_allocator.hpp"
+
+// size classes of the pools, in sets
+constexpr uint32_t min_pool_set_count = 64;
+constexpr uint32_t max_pool_set_count = 4096;
+
+DescriptorAllocator::DescriptorAllocator(VkDevice device, DeletionQueue *deletionQueue)
+    : m_device(device), m_deletionQueue(deletionQueue)
+{
+    m_poolSizeRatios = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+    };
+
+    m_immutableChain.nextSetCount = min_pool_set_count;
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+    printStatistics();
+
+    for (VkDescriptorPool pool : m_immutableChain.pools)
+        vkDestroyDescriptorPool(m_device, pool, nullptr);
+    for (PoolChainT &chain : m_frameChains)
+    {
+        for (VkDescriptorPool pool : chain.pools)
+            vkDestroyDescriptorPool(m_device, pool, nullptr);
+    }
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(uint32_t setCount, VkDescriptorPoolCreateFlags flags)
+{
+    std::vector<VkDescriptorPoolSize> poolSizes = m_poolSizeRatios;
+    for (VkDescriptorPoolSize &poolSize : poolSizes)
+        poolSize.descriptorCount *= setCount;
+
+    VkDescriptorPoolCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = flags,
+        .maxSets = setCount,
+        .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+        .pPoolSizes = poolSizes.data(),
+    };
+    VkDescriptorPool pool;
+    VkResult res = vkCreateDescriptorPool(m_device, &createInfo, nullptr, &pool);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create descriptor pool : " << res << std::endl;
+        return VK_NULL_HANDLE;
+    }
+    return pool;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(PoolChainT &chain, VkDescriptorSetLayout layout,
+                                              VkDescriptorPoolCreateFlags poolFlags)
+{
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout,
+    };
+
+    // the current pool, then a following one, then a new larger one
+    while (true)
+    {
+        if (chain.current == chain.pools.size())
+        {
+            VkDescriptorPool pool = createPool(chain.nextSetCount, poolFlags);
+            if (pool == VK_NULL_HANDLE)
+                return VK_NULL_HANDLE;
+            chain.pools.emplace_back(pool);
+            chain.nextSetCount = std::min(chain.nextSetCount * 2, max_pool_set_count);
+        }
+
+        allocInfo.descriptorPool = chain.pools[chain.current];
+        VkDescriptorSet set;
+        VkResult res = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+        if (res == VK_SUCCESS)
+            return set;
+        if (res != VK_ERROR_OUT_OF_POOL_MEMORY && res != VK_ERROR_FRAGMENTED_POOL)
+        {
+            std::cerr << "Failed to allocate descriptor sets : " << res << std::endl;
+            return VK_NULL_HANDLE;
+        }
+        ++chain.current;
+    }
+}
+
+VkDescriptorSet DescriptorAllocator::getImmutableSet(VkDescriptorSetLayout layout,
+                                                     std::span<const VkWriteDescriptorSet> writes)
+{
+    std::string key;
+    std::vector<uint64_t> resources;
+    append_bytes(key, layout);
+    for (const VkWriteDescriptorSet &write : writes)
+    {
+        append_bytes(key, write.dstBinding);
+        append_bytes(key, write.dstArrayElement);
+        append_bytes(key, write.descriptorType);
+        append_bytes(key, write.descriptorCount);
+        for (uint32_t i = 0; write.pBufferInfo && i < write.descriptorCount; ++i)
+        {
+            append_bytes(key, write.pBufferInfo[i].buffer);
+            append_bytes(key, write.pBufferInfo[i].offset);
+            append_bytes(key, write.pBufferInfo[i].range);
+            resources.emplace_back(reinterpret_cast<uint64_t>(write.pBufferInfo[i].buffer));
+        }
+        for (uint32_t i = 0; write.pImageInfo && i < write.descriptorCount; ++i)
+        {
+            append_bytes(key, write.pImageInfo[i].sampler);
+            append_bytes(key, write.pImageInfo[i].imageView);
+            append_bytes(key, write.pImageInfo[i].imageLayout);
+            resources.emplace_back(reinterpret_cast<uint64_t>(write.pImageInfo[i].imageView));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    ++m_requestCount;
+    auto it = m_immutableSets.find(key);
+    if (it != m_immutableSets.end())
+        return it->second.set;
+
+    // immutable sets are freed one by one when they are evicted
+    VkDescriptorSet set = allocate(m_immutableChain, layout, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT);
+    if (set == VK_NULL_HANDLE)
+        return VK_NULL_HANDLE;
+
+    std::vector<VkWriteDescriptorSet> setWrites(writes.begin(), writes.end());
+    for (VkWriteDescriptorSet &write : setWrites)
+        write.dstSet = set;
+    vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+
+    m_immutableSets[key] = CachedSetT{
+        .set = set,
+        .poolIndex = m_immutableChain.current,
+        .resources = std::move(resources),
+    };
+    return set;
+}
+
+VkDescriptorSet DescriptorAllocator::allocateFrameSet(VkDescriptorSetLayout layout)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_frameIndex >= m_frameChains.size())
+        m_frameChains.resize(m_frameIndex + 1, PoolChainT{.nextSetCount = min_pool_set_count});
+
+    ++m_frameSetCount;
+    return allocate(m_frameChains[m_frameIndex], layout, 0);
+}
+
+void DescriptorAllocator::beginFrame(uint32_t frameIndex)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_frameIndex = frameIndex;
+    if (m_frameIndex >= m_frameChains.size())
+        return;
+
+    PoolChainT &chain = m_frameChains[m_frameIndex];
+    for (size_t i = 0; i <= chain.current && i < chain.pools.size(); ++i)
+        vkResetDescriptorPool(m_device, chain.pools[i], 0);
+    chain.current = 0;
+}
+
+void DescriptorAllocator::evictSets(uint64_t resource)
+{
+    std::vector<CachedSetT> evictedSets;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::erase_if(m_immutableSets, [resource, &evictedSets](const auto &entry) {
+            const std::vector<uint64_t> &resources = entry.second.resources;
+            if (std::find(resources.begin(), resources.end(), resource) == resources.end())
+                return false;
+            evictedSets.emplace_back(entry.second);
+            return true;
+        });
+    }
+
+    if (evictedSets.empty())
+        return;
+
+    // frames in flight may still bind the sets
+    m_deletionQueue->push([this, evictedSets = std::move(evictedSets)]() { freeImmutableSets(evictedSets); });
+}
+
+void DescriptorAllocator::freeImmutableSets(const std::vector<CachedSetT> &sets)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const CachedSetT &cachedSet : sets)
+    {
+        vkFreeDescriptorSets(m_device, m_immutableChain.pools[cachedSet.poolIndex], 1, &cachedSet.set);
+        // allocate from the pool again now that it has room
+        m_immutableChain.current = std::min(m_immutableChain.current, cachedSet.poolIndex);
+    }
+    m_freedSetCount += sets.size();
+}
+
+void DescriptorAllocator::evictSets(VkImageView imageView)
+{
+    evictSets(reinterpret_cast<uint64_t>(imageView));
+}
+
+void DescriptorAllocator::evictSets(VkBuffer buffer)
+{
+    evictSets(reinterpret_cast<uint64_t>(buffer));
+}
+
+void DescriptorAllocator::printStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_requestCount == 0 && m_frameSetCount == 0)
+        return;
+
+    size_t poolCount = m_immutableChain.pools.size();
+    for (const PoolChainT &chain : m_frameChains)
+        poolCount += chain.pools.size();
+
+    std::cout << "Descriptor allocator : " << m_requestCount << " immutable set request(s) served by "
+              << m_immutableSets.size() << " cached set(s) (" << m_freedSetCount << " freed), " << m_frameSetCount
+              << " per frame set(s), " << poolCount << " descriptor pool(s)" << std::endl;
+}
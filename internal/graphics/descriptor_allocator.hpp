@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+class DeletionQueue;
+
+/**
+ * @brief Device wide descriptor set allocator
+ *
+ * Sets are allocated from chains of pools, a full chain grows by a pool twice as large as the previous
+ * one (up to a maximum size class). Immutable sets are cached by their layout and bound resources so
+ * that users binding the same resources share a set, they are freed once a resource they reference is
+ * evicted and the frames in flight are done with them. Per frame sets are allocated from the chain of a
+ * frame in flight and released in bulk with vkResetDescriptorPool when the frame is started again.
+ */
+class DescriptorAllocator
+{
+  private:
+    struct PoolChainT
+    {
+        std::vector<VkDescriptorPool> pools;
+        // pool sets are allocated from, the following ones are empty (or have freed sets, immutable chain only)
+        size_t current = 0;
+        uint32_t nextSetCount;
+    };
+
+    // immutable set and the resources it references
+    struct CachedSetT
+    {
+        VkDescriptorSet set;
+        // index of the pool of the immutable chain the set is allocated from
+        size_t poolIndex;
+        std::vector<uint64_t> resources;
+    };
+
+    VkDevice m_device;
+    DeletionQueue *m_deletionQueue;
+
+    // descriptors of each type per set in a pool
+    std::vector<VkDescriptorPoolSize> m_poolSizeRatios;
+
+    PoolChainT m_immutableChain;
+    // serialized layout and writes
+    std::unordered_map<std::string, CachedSetT> m_immutableSets;
+
+    std::vector<PoolChainT> m_frameChains;
+    uint32_t m_frameIndex = 0;
+
+    uint64_t m_requestCount = 0;
+    uint64_t m_frameSetCount = 0;
+    uint64_t m_freedSetCount = 0;
+
+    mutable std::mutex m_mutex;
+
+    [[nodiscard]] VkDescriptorPool createPool(uint32_t setCount, VkDescriptorPoolCreateFlags flags);
+    [[nodiscard]] VkDescriptorSet allocate(PoolChainT &chain, VkDescriptorSetLayout layout,
+                                           VkDescriptorPoolCreateFlags poolFlags);
+    void evictSets(uint64_t resource);
+    void freeImmutableSets(const std::vector<CachedSetT> &sets);
+
+  public:
+    /**
+     * @param deletionQueue defers the release of the evicted sets, must outlive the allocator's last eviction
+     */
+    DescriptorAllocator(VkDevice device, DeletionQueue *deletionQueue);
+    ~DescriptorAllocator();
+
+    DescriptorAllocator(const DescriptorAllocator &) = delete;
+    DescriptorAllocator &operator=(const DescriptorAllocator &) = delete;
+    DescriptorAllocator(DescriptorAllocator &&) = delete;
+    DescriptorAllocator &operator=(DescriptorAllocator &&) = delete;
+
+    /**
+     * @brief Set of the given content, written on first use then shared
+     *
+     * The set must not be updated by its users. It stays valid until one of its resources is evicted.
+     *
+     * @param writes content of the set, their dstSet is ignored
+     * @return VK_NULL_HANDLE if the set could not be allocated
+     */
+    [[nodiscard]] VkDescriptorSet getImmutableSet(VkDescriptorSetLayout layout,
+                                                  std::span<const VkWriteDescriptorSet> writes);
+
+    /**
+     * @brief Set valid until the current frame region is started again, written by the caller
+     *
+     */
+    [[nodiscard]] VkDescriptorSet allocateFrameSet(VkDescriptorSetLayout layout);
+
+    /**
+     * @brief Release the sets of a frame region, the GPU must be done with the frame that last used it
+     *
+     */
+    void beginFrame(uint32_t frameIndex);
+
+    /**
+     * @brief Forget the immutable sets referencing a resource about to be destroyed
+     *
+     * The sets are freed once the frame being recorded is retired, their users must not bind them anymore.
+     */
+    void evictSets(VkImageView imageView);
+    void evictSets(VkBuffer buffer);
+
+    void printStatistics() const;
+};
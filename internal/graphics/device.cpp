@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <set>
+#include <sstream>
+#include <type_traits>
 #include <vector>
 
 #include "context.hpp"
@@ -9,17 +13,45 @@
 
 Device::~Device()
 {
+    // background compilations use the objects below
+    m_pipelineCompiler.reset();
+
+    // objects released while frames were in flight
+    vkDeviceWaitIdle(m_handle);
+    m_transferHandoff.reset();
+    m_deletionQueue.reset();
+    m_defragmenter.reset();
+    // deletions evict the descriptor sets and release the bindless slots of the destroyed resources
+    m_descriptorAllocator.reset();
+    m_bindlessTable.reset();
+
+    m_pipelineManifest.reset();
+    m_pipelineRegistry.reset();
+    m_pipelineCache.reset();
+
     vkDestroyCommandPool(m_handle, m_commandPool, nullptr);
     vkDestroyCommandPool(m_handle, m_commandPoolTransient, nullptr);
 
+    m_allocator.reset();
+
     vkDestroyDevice(m_handle, nullptr);
 }
 
 std::optional<uint32_t> Device::findMemoryTypeIndex(VkMemoryRequirements requirements,
-                                                    VkMemoryPropertyFlags properties) const
+                                                    VkMemoryPropertyFlags properties,
+                                                    VkMemoryPropertyFlags preferredProperties) const
 {
-    VkPhysicalDeviceMemoryProperties memProp;
-    vkGetPhysicalDeviceMemoryProperties(m_physicalHandle, &memProp);
+    const VkPhysicalDeviceMemoryProperties &memProp = m_memoryProperties;
+
+    // first pass with the preferred properties, second pass with the required ones only
+    VkMemoryPropertyFlags allProperties = properties | preferredProperties;
+    for (uint32_t i = 0; allProperties != properties && i < memProp.memoryTypeCount; ++i)
+    {
+        bool rightType = requirements.memoryTypeBits & (1 << i);
+        bool rightFlag = (memProp.memoryTypes[i].propertyFlags & allProperties) == allProperties;
+        if (rightType && rightFlag)
+            return std::optional<uint32_t>(i);
+    }
 
     for (uint32_t i = 0; i < memProp.memoryTypeCount; ++i)
     {
@@ -33,6 +65,29 @@ std::optional<uint32_t> Device::findMemoryTypeIndex(VkMemoryRequirements require
     return std::optional<uint32_t>();
 }
 
+MemoryStatsT Device::getMemoryStats() const
+{
+    MemoryStatsT stats = m_allocator->getStats();
+    if (!m_bMemoryBudget)
+        return stats;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+    };
+    VkPhysicalDeviceMemoryProperties2 memoryProps2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+        .pNext = &budgetProps,
+    };
+    vkGetPhysicalDeviceMemoryProperties2(m_physicalHandle, &memoryProps2);
+
+    for (uint32_t i = 0; i < stats.heaps.size(); ++i)
+    {
+        stats.heaps[i].usage = budgetProps.heapUsage[i];
+        stats.heaps[i].budget = budgetProps.heapBudget[i];
+    }
+    return stats;
+}
+
 std::vector<VkQueueFamilyProperties> Device::getQueueFamilyProperties() const
 {
     uint32_t queueFamilyPropertiesCount;
@@ -52,6 +107,32 @@ std::optional<uint32_t> Device::findQueueFamilyIndex(const VkQueueFlags &capabil
     }
     return std::optional<uint32_t>();
 }
+std::optional<uint32_t> Device::findTransferQueueFamilyIndex() const
+{
+    auto props = getQueueFamilyProperties();
+    for (uint32_t i = 0; i < props.size(); ++i)
+    {
+        bool bTransfer = props[i].queueFlags & VK_QUEUE_TRANSFER_BIT;
+        bool bGeneral = props[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+        if (bTransfer && !bGeneral)
+            return std::optional<uint32_t>(i);
+    }
+    return std::optional<uint32_t>();
+}
+bool Device::isDeviceExtensionSupported(const char *extensionName) const
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(m_physicalHandle, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(m_physicalHandle, nullptr, &extensionCount, extensions.data());
+
+    for (const VkExtensionProperties &extension : extensions)
+    {
+        if (strcmp(extension.extensionName, extensionName) == 0)
+            return true;
+    }
+    return false;
+}
 std::optional<uint32_t> Device::findPresentQueueFamilyIndex() const
 {
     if (!m_surface)
@@ -116,6 +197,8 @@ std::unique_ptr<Device> DeviceBuilder::build()
         uniqueQueueFamilies.insert(m_product->m_graphicsFamilyIndex.value());
     if (m_product->m_presentFamilyIndex.has_value())
         uniqueQueueFamilies.insert(m_product->m_presentFamilyIndex.value());
+    if (m_product->m_transferFamilyIndex.has_value())
+        uniqueQueueFamilies.insert(m_product->m_transferFamilyIndex.value());
 
     float queuePriority = 1.f;
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
@@ -128,16 +211,146 @@ std::unique_ptr<Device> DeviceBuilder::build()
         queueCreateInfos.emplace_back(queueCreateInfo);
     }
 
+    // heap usage and budget reporting
+    if (m_product->m_props.apiVersion >= VK_API_VERSION_1_1 &&
+        m_product->isDeviceExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+    {
+        addDeviceExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        m_product->m_bMemoryBudget = true;
+    }
+    // pipeline cache hit reporting
+    if (m_product->isDeviceExtensionSupported(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME))
+    {
+        addDeviceExtension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+        m_product->m_bPipelineCreationFeedback = true;
+    }
+
+    // pipelines linked from separately compiled parts, only worth it if linking is fast
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+    };
+    if (m_product->m_props.apiVersion >= VK_API_VERSION_1_2 &&
+        m_product->isDeviceExtensionSupported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+        m_product->isDeviceExtensionSupported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+    {
+        VkPhysicalDeviceFeatures2 features2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &graphicsPipelineLibraryFeatures,
+        };
+        vkGetPhysicalDeviceFeatures2(m_product->m_physicalHandle, &features2);
+
+        VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphicsPipelineLibraryProps = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT,
+        };
+        VkPhysicalDeviceProperties2 props2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &graphicsPipelineLibraryProps,
+        };
+        vkGetPhysicalDeviceProperties2(m_product->m_physicalHandle, &props2);
+
+        if (graphicsPipelineLibraryFeatures.graphicsPipelineLibrary &&
+            graphicsPipelineLibraryProps.graphicsPipelineLibraryFastLinking)
+        {
+            addDeviceExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+            addDeviceExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+            m_product->m_bGraphicsPipelineLibrary = true;
+        }
+    }
+
+    // render passes and per draw state without pipeline permutations
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+    };
+    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+    };
+    VkPhysicalDeviceExtendedDynamicState2FeaturesEXT extendedDynamicState2Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT,
+    };
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT,
+    };
+    // chained behind the Vulkan 1.2 features
+    void *pNextFeatures = m_product->m_bGraphicsPipelineLibrary ? &graphicsPipelineLibraryFeatures : nullptr;
+    if (m_bDynamicStateMode && m_product->m_props.apiVersion >= VK_API_VERSION_1_2)
+    {
+        auto queryFeatures = [&](const char *extensionName, auto &features) {
+            if (!m_product->isDeviceExtensionSupported(extensionName))
+                return false;
+            VkPhysicalDeviceFeatures2 features2 = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext = &features,
+            };
+            vkGetPhysicalDeviceFeatures2(m_product->m_physicalHandle, &features2);
+            return true;
+        };
+        auto enableFeatures = [&](const char *extensionName, auto &features) {
+            addDeviceExtension(extensionName);
+            features.pNext = pNextFeatures;
+            pNextFeatures = &features;
+        };
+
+        if (queryFeatures(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, dynamicRenderingFeatures) &&
+            dynamicRenderingFeatures.dynamicRendering)
+        {
+            enableFeatures(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, dynamicRenderingFeatures);
+            m_product->m_bDynamicRendering = true;
+        }
+        if (queryFeatures(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME, extendedDynamicStateFeatures) &&
+            extendedDynamicStateFeatures.extendedDynamicState)
+        {
+            enableFeatures(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME, extendedDynamicStateFeatures);
+            m_product->m_bExtendedDynamicState = true;
+        }
+        if (queryFeatures(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME, extendedDynamicState2Features) &&
+            extendedDynamicState2Features.extendedDynamicState2)
+        {
+            // logic op and patch control points are not used
+            extendedDynamicState2Features.extendedDynamicState2LogicOp = VK_FALSE;
+            extendedDynamicState2Features.extendedDynamicState2PatchControlPoints = VK_FALSE;
+            enableFeatures(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME, extendedDynamicState2Features);
+            m_product->m_bExtendedDynamicState2 = true;
+        }
+        if (queryFeatures(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME, extendedDynamicState3Features) &&
+            extendedDynamicState3Features.extendedDynamicState3DepthClampEnable &&
+            extendedDynamicState3Features.extendedDynamicState3PolygonMode &&
+            extendedDynamicState3Features.extendedDynamicState3ColorBlendEnable &&
+            extendedDynamicState3Features.extendedDynamicState3ColorWriteMask)
+        {
+            // only the states set by the DynamicStateRecorder
+            extendedDynamicState3Features = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT,
+                .extendedDynamicState3DepthClampEnable = VK_TRUE,
+                .extendedDynamicState3PolygonMode = VK_TRUE,
+                .extendedDynamicState3ColorBlendEnable = VK_TRUE,
+                .extendedDynamicState3ColorWriteMask = VK_TRUE,
+            };
+            enableFeatures(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME, extendedDynamicState3Features);
+            m_product->m_bExtendedDynamicState3 = true;
+        }
+    }
+
+    // every supported feature is enabled, Vulkan 1.2 features are chained behind the core ones
+    VkPhysicalDeviceVulkan12Features features12 = m_product->m_features12;
+    features12.pNext = pNextFeatures;
+    VkPhysicalDeviceFeatures2 features2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .features = m_product->m_features,
+    };
+    if (m_product->m_props.apiVersion >= VK_API_VERSION_1_2)
+        features2.pNext = &features12;
+
     auto contextPtr = m_cx.lock();
     VkDeviceCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &features2,
         .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
         .pQueueCreateInfos = queueCreateInfos.data(),
         .enabledLayerCount = static_cast<uint32_t>(contextPtr->getLayerCount()),
         .ppEnabledLayerNames = contextPtr->getLayers(),
         .enabledExtensionCount = static_cast<uint32_t>(m_deviceExtensions.size()),
         .ppEnabledExtensionNames = m_deviceExtensions.data(),
-        .pEnabledFeatures = &m_product->m_features,
+        .pEnabledFeatures = nullptr,
     };
 
     // create device
@@ -148,11 +361,118 @@ std::unique_ptr<Device> DeviceBuilder::build()
         return nullptr;
     }
 
+    // extension commands
+
+    auto loadCommand = [&](const char *name, auto &command) {
+        command = reinterpret_cast<std::remove_reference_t<decltype(command)>>(
+            vkGetDeviceProcAddr(m_product->m_handle, name));
+    };
+    DeviceDispatchT &dispatch = m_product->m_dispatch;
+    if (m_product->m_bDynamicRendering)
+    {
+        loadCommand("vkCmdBeginRenderingKHR", dispatch.vkCmdBeginRenderingKHR);
+        loadCommand("vkCmdEndRenderingKHR", dispatch.vkCmdEndRenderingKHR);
+    }
+    if (m_product->m_bExtendedDynamicState)
+    {
+        loadCommand("vkCmdSetCullModeEXT", dispatch.vkCmdSetCullModeEXT);
+        loadCommand("vkCmdSetFrontFaceEXT", dispatch.vkCmdSetFrontFaceEXT);
+        loadCommand("vkCmdSetPrimitiveTopologyEXT", dispatch.vkCmdSetPrimitiveTopologyEXT);
+        loadCommand("vkCmdSetDepthTestEnableEXT", dispatch.vkCmdSetDepthTestEnableEXT);
+        loadCommand("vkCmdSetDepthWriteEnableEXT", dispatch.vkCmdSetDepthWriteEnableEXT);
+        loadCommand("vkCmdSetDepthCompareOpEXT", dispatch.vkCmdSetDepthCompareOpEXT);
+    }
+    if (m_product->m_bExtendedDynamicState2)
+    {
+        loadCommand("vkCmdSetPrimitiveRestartEnableEXT", dispatch.vkCmdSetPrimitiveRestartEnableEXT);
+        loadCommand("vkCmdSetDepthBiasEnableEXT", dispatch.vkCmdSetDepthBiasEnableEXT);
+        loadCommand("vkCmdSetRasterizerDiscardEnableEXT", dispatch.vkCmdSetRasterizerDiscardEnableEXT);
+    }
+    if (m_product->m_bExtendedDynamicState3)
+    {
+        loadCommand("vkCmdSetDepthClampEnableEXT", dispatch.vkCmdSetDepthClampEnableEXT);
+        loadCommand("vkCmdSetPolygonModeEXT", dispatch.vkCmdSetPolygonModeEXT);
+        loadCommand("vkCmdSetColorBlendEnableEXT", dispatch.vkCmdSetColorBlendEnableEXT);
+        loadCommand("vkCmdSetColorWriteMaskEXT", dispatch.vkCmdSetColorWriteMaskEXT);
+    }
+
     // queue
 
     vkGetDeviceQueue(m_product->m_handle, m_product->m_graphicsFamilyIndex.value(), 0, &m_product->m_graphicsQueue);
     if (m_product->m_surface)
         vkGetDeviceQueue(m_product->m_handle, m_product->m_presentFamilyIndex.value(), 0, &m_product->m_presentQueue);
+    if (m_product->m_transferFamilyIndex.has_value())
+        vkGetDeviceQueue(m_product->m_handle, m_product->m_transferFamilyIndex.value(), 0,
+                         &m_product->m_transferQueue);
+
+    // the graphics queue waits on a timeline semaphore for the uploads of the transfer queue
+    if (m_product->m_transferFamilyIndex.has_value() && m_product->m_features12.timelineSemaphore)
+    {
+        m_product->m_transferHandoff = std::make_unique<TransferHandoff>(
+            m_product->m_handle, m_product->m_transferQueue, m_product->m_transferFamilyIndex.value(),
+            m_product->m_graphicsFamilyIndex.value());
+    }
+
+    // memory allocator
+
+    m_product->m_allocator = std::make_unique<MemoryAllocator>(m_product->m_handle, m_product->m_memoryProperties);
+    m_product->m_deletionQueue = std::make_unique<DeletionQueue>();
+    m_product->m_defragmenter = std::make_unique<MemoryDefragmenter>(m_product->m_allocator.get());
+
+    // pipeline cache
+
+    // the cache and the manifest only hold pipelines of this device
+    std::stringstream deviceSuffix;
+    deviceSuffix << std::hex << m_product->m_props.vendorID << "_" << m_product->m_props.deviceID << ".bin";
+    if (m_pipelineCacheFilename.empty())
+        m_pipelineCacheFilename = "pipeline_cache_" + deviceSuffix.str();
+    if (m_pipelineManifestFilename.empty())
+        m_pipelineManifestFilename = "pipeline_manifest_" + deviceSuffix.str();
+    m_product->m_pipelineCache =
+        std::make_unique<PipelineCache>(m_product->m_handle, m_product->m_props, m_pipelineCacheFilename);
+    m_product->m_pipelineRegistry = std::make_unique<PipelineRegistry>(m_product->m_handle);
+    m_product->m_pipelineManifest = std::make_unique<PipelineManifest>(m_pipelineManifestFilename);
+    m_product->m_pipelineCompiler = std::make_unique<PipelineCompiler>(m_pipelineCompilerThreadCount);
+
+    // descriptor sets
+
+    m_product->m_descriptorAllocator =
+        std::make_unique<DescriptorAllocator>(m_product->m_handle, m_product->m_deletionQueue.get());
+
+    // the Vulkan 1.2 features are all enabled, descriptor indexing included
+    const VkPhysicalDeviceVulkan12Features &features12 = m_product->m_features12;
+    if (m_bBindlessMode && features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound &&
+        features12.descriptorBindingUpdateUnusedWhilePending &&
+        features12.descriptorBindingSampledImageUpdateAfterBind &&
+        features12.descriptorBindingStorageBufferUpdateAfterBind &&
+        features12.shaderSampledImageArrayNonUniformIndexing &&
+        m_product->m_features.shaderSampledImageArrayDynamicIndexing &&
+        m_product->m_features.shaderStorageBufferArrayDynamicIndexing)
+    {
+        VkPhysicalDeviceVulkan12Properties props12 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES,
+        };
+        VkPhysicalDeviceProperties2 props2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &props12,
+        };
+        vkGetPhysicalDeviceProperties2(m_product->m_physicalHandle, &props2);
+
+        // combined image samplers count as sampled images and as samplers
+        uint32_t textureCapacity =
+            std::min({m_bindlessTextureCapacity, props12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                      props12.maxPerStageDescriptorUpdateAfterBindSamplers,
+                      props12.maxDescriptorSetUpdateAfterBindSampledImages,
+                      props12.maxDescriptorSetUpdateAfterBindSamplers});
+        uint32_t bufferCapacity =
+            std::min({m_bindlessBufferCapacity, props12.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                      props12.maxDescriptorSetUpdateAfterBindStorageBuffers});
+
+        m_product->m_bindlessTable =
+            std::make_unique<BindlessTable>(m_product->m_handle, textureCapacity, bufferCapacity);
+        if (m_product->m_bindlessTable->getSet() == VK_NULL_HANDLE)
+            m_product->m_bindlessTable.reset();
+    }
 
     // command pools
 
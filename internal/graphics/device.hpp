@@ -3,15 +3,56 @@
 #include <cassert>
 #include <memory>
 #include <optional>
+#include <string>
 #include <vector>
 
 #include <vulkan/vulkan.h>
 
+#include "bindless_table.hpp"
+#include "deletion_queue.hpp"
+#include "descriptor_allocator.hpp"
+#include "memory_allocator.hpp"
+#include "memory_defragmenter.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_compiler.hpp"
+#include "pipeline_manifest.hpp"
+#include "pipeline_registry.hpp"
 #include "surface.hpp"
+#include "transfer_handoff.hpp"
 
 class Context;
 class DeviceBuilder;
 
+/**
+ * @brief Extension commands, loaded when their extension is enabled
+ *
+ */
+struct DeviceDispatchT
+{
+    // VK_KHR_dynamic_rendering
+    PFN_vkCmdBeginRenderingKHR vkCmdBeginRenderingKHR = nullptr;
+    PFN_vkCmdEndRenderingKHR vkCmdEndRenderingKHR = nullptr;
+
+    // VK_EXT_extended_dynamic_state
+    PFN_vkCmdSetCullModeEXT vkCmdSetCullModeEXT = nullptr;
+    PFN_vkCmdSetFrontFaceEXT vkCmdSetFrontFaceEXT = nullptr;
+    PFN_vkCmdSetPrimitiveTopologyEXT vkCmdSetPrimitiveTopologyEXT = nullptr;
+    PFN_vkCmdSetDepthTestEnableEXT vkCmdSetDepthTestEnableEXT = nullptr;
+    PFN_vkCmdSetDepthWriteEnableEXT vkCmdSetDepthWriteEnableEXT = nullptr;
+    PFN_vkCmdSetDepthCompareOpEXT vkCmdSetDepthCompareOpEXT = nullptr;
+
+    // VK_EXT_extended_dynamic_state2
+    PFN_vkCmdSetPrimitiveRestartEnableEXT vkCmdSetPrimitiveRestartEnableEXT = nullptr;
+    PFN_vkCmdSetDepthBiasEnableEXT vkCmdSetDepthBiasEnableEXT = nullptr;
+    PFN_vkCmdSetRasterizerDiscardEnableEXT vkCmdSetRasterizerDiscardEnableEXT = nullptr;
+
+    // VK_EXT_extended_dynamic_state3
+    PFN_vkCmdSetDepthClampEnableEXT vkCmdSetDepthClampEnableEXT = nullptr;
+    PFN_vkCmdSetPolygonModeEXT vkCmdSetPolygonModeEXT = nullptr;
+    PFN_vkCmdSetColorBlendEnableEXT vkCmdSetColorBlendEnableEXT = nullptr;
+    PFN_vkCmdSetColorWriteMaskEXT vkCmdSetColorWriteMaskEXT = nullptr;
+};
+
 class Device
 {
     friend DeviceBuilder;
@@ -26,20 +67,55 @@ class Device
     // physical device
     VkPhysicalDevice m_physicalHandle;
     VkPhysicalDeviceFeatures m_features;
+    VkPhysicalDeviceVulkan12Features m_features12 = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
     VkPhysicalDeviceProperties m_props;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties;
+
+    // VK_EXT_memory_budget is enabled
+    bool m_bMemoryBudget = false;
+    // VK_EXT_pipeline_creation_feedback is enabled
+    bool m_bPipelineCreationFeedback = false;
+    // VK_EXT_graphics_pipeline_library is enabled with fast linking
+    bool m_bGraphicsPipelineLibrary = false;
+    // VK_KHR_dynamic_rendering is enabled, render passes have no VkRenderPass nor framebuffers
+    bool m_bDynamicRendering = false;
+    // VK_EXT_extended_dynamic_state, VK_EXT_extended_dynamic_state2 and VK_EXT_extended_dynamic_state3 are enabled
+    bool m_bExtendedDynamicState = false;
+    bool m_bExtendedDynamicState2 = false;
+    bool m_bExtendedDynamicState3 = false;
+
+    DeviceDispatchT m_dispatch;
 
     // logical device
     VkDevice m_handle;
 
     std::optional<uint32_t> m_graphicsFamilyIndex;
     std::optional<uint32_t> m_presentFamilyIndex;
+    // transfer only queue family (DMA engine), if the device exposes one
+    std::optional<uint32_t> m_transferFamilyIndex;
 
     VkQueue m_graphicsQueue;
     VkQueue m_presentQueue;
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    // uploads on the transfer queue, nullptr without a transfer only queue family or timeline semaphores
+    std::unique_ptr<TransferHandoff> m_transferHandoff;
 
     VkCommandPool m_commandPool;
     VkCommandPool m_commandPoolTransient;
 
+    std::unique_ptr<MemoryAllocator> m_allocator;
+    std::unique_ptr<DeletionQueue> m_deletionQueue;
+    std::unique_ptr<MemoryDefragmenter> m_defragmenter;
+
+    std::unique_ptr<PipelineCache> m_pipelineCache;
+    std::unique_ptr<PipelineRegistry> m_pipelineRegistry;
+    std::unique_ptr<PipelineManifest> m_pipelineManifest;
+    std::unique_ptr<PipelineCompiler> m_pipelineCompiler;
+
+    std::unique_ptr<DescriptorAllocator> m_descriptorAllocator;
+    // descriptor indexing is supported and the bindless mode is enabled
+    std::unique_ptr<BindlessTable> m_bindlessTable;
+
     Device() = default;
 
   public:
@@ -52,9 +128,18 @@ class Device
 
     std::optional<uint32_t> findQueueFamilyIndex(const VkQueueFlags &capabilities) const;
     std::optional<uint32_t> findPresentQueueFamilyIndex() const;
+    std::optional<uint32_t> findTransferQueueFamilyIndex() const;
+
+    [[nodiscard]] bool isDeviceExtensionSupported(const char *extensionName) const;
+
+    std::optional<uint32_t> findMemoryTypeIndex(VkMemoryRequirements requirements, VkMemoryPropertyFlags properties,
+                                                VkMemoryPropertyFlags preferredProperties = 0) const;
 
-    std::optional<uint32_t> findMemoryTypeIndex(VkMemoryRequirements requirements,
-                                                VkMemoryPropertyFlags properties) const;
+    /**
+     * @brief Per heap usage and budget, per category usage and high-water marks
+     *
+     */
+    [[nodiscard]] MemoryStatsT getMemoryStats() const;
 
     VkCommandBuffer cmdBeginOneTimeSubmit() const;
     void cmdEndOneTimeSubmit(VkCommandBuffer commandBuffer) const;
@@ -78,6 +163,14 @@ class Device
     {
         return m_props;
     }
+    [[nodiscard]] inline const VkPhysicalDeviceVulkan12Features &getPhysicalDeviceVulkan12Features() const
+    {
+        return m_features12;
+    }
+    [[nodiscard]] inline const VkPhysicalDeviceMemoryProperties &getPhysicalDeviceMemoryProperties() const
+    {
+        return m_memoryProperties;
+    }
 
     [[nodiscard]] inline const VkPhysicalDevice &getPhysicalHandle() const
     {
@@ -93,6 +186,83 @@ class Device
         return m_commandPool;
     }
 
+    /**
+     * @brief Release of the uploads on the transfer queue and acquisition by the frames, nullptr if unsupported
+     *
+     */
+    [[nodiscard]] inline TransferHandoff *getTransferHandoff() const
+    {
+        return m_transferHandoff.get();
+    }
+    [[nodiscard]] inline MemoryAllocator *getAllocator() const
+    {
+        return m_allocator.get();
+    }
+    [[nodiscard]] inline DeletionQueue *getDeletionQueue() const
+    {
+        return m_deletionQueue.get();
+    }
+    [[nodiscard]] inline MemoryDefragmenter *getDefragmenter() const
+    {
+        return m_defragmenter.get();
+    }
+    [[nodiscard]] inline PipelineCache *getPipelineCache() const
+    {
+        return m_pipelineCache.get();
+    }
+    [[nodiscard]] inline PipelineRegistry *getPipelineRegistry() const
+    {
+        return m_pipelineRegistry.get();
+    }
+    [[nodiscard]] inline PipelineManifest *getPipelineManifest() const
+    {
+        return m_pipelineManifest.get();
+    }
+    [[nodiscard]] inline PipelineCompiler *getPipelineCompiler() const
+    {
+        return m_pipelineCompiler.get();
+    }
+    [[nodiscard]] inline DescriptorAllocator *getDescriptorAllocator() const
+    {
+        return m_descriptorAllocator.get();
+    }
+    /**
+     * @brief Table of every texture and storage buffer, nullptr if the device does not support it
+     *
+     */
+    [[nodiscard]] inline BindlessTable *getBindlessTable() const
+    {
+        return m_bindlessTable.get();
+    }
+    [[nodiscard]] inline bool isPipelineCreationFeedbackEnabled() const
+    {
+        return m_bPipelineCreationFeedback;
+    }
+    [[nodiscard]] inline bool isGraphicsPipelineLibraryEnabled() const
+    {
+        return m_bGraphicsPipelineLibrary;
+    }
+    [[nodiscard]] inline bool isDynamicRenderingEnabled() const
+    {
+        return m_bDynamicRendering;
+    }
+    [[nodiscard]] inline bool isExtendedDynamicStateEnabled() const
+    {
+        return m_bExtendedDynamicState;
+    }
+    [[nodiscard]] inline bool isExtendedDynamicState2Enabled() const
+    {
+        return m_bExtendedDynamicState2;
+    }
+    [[nodiscard]] inline bool isExtendedDynamicState3Enabled() const
+    {
+        return m_bExtendedDynamicState3;
+    }
+    [[nodiscard]] inline const DeviceDispatchT &getDispatch() const
+    {
+        return m_dispatch;
+    }
+
     [[nodiscard]] inline const VkSurfaceKHR getSurfaceHandle() const
     {
         assert(m_surface);
@@ -107,6 +277,10 @@ class Device
     {
         return m_presentFamilyIndex;
     }
+    [[nodiscard]] inline const std::optional<uint32_t> &getTransferFamilyIndex() const
+    {
+        return m_transferFamilyIndex;
+    }
 
     [[nodiscard]] inline const VkQueue &getGraphicsQueue() const
     {
@@ -117,6 +291,10 @@ class Device
     {
         return m_presentQueue;
     }
+    [[nodiscard]] inline const VkQueue &getTransferQueue() const
+    {
+        return m_transferQueue;
+    }
 };
 
 class DeviceBuilder
@@ -128,6 +306,14 @@ class DeviceBuilder
 
     std::vector<const char *> m_deviceExtensions;
 
+    std::string m_pipelineCacheFilename;
+    std::string m_pipelineManifestFilename;
+    uint32_t m_pipelineCompilerThreadCount = 1;
+    bool m_bDynamicStateMode = true;
+    bool m_bBindlessMode = true;
+    uint32_t m_bindlessTextureCapacity = 4096;
+    uint32_t m_bindlessBufferCapacity = 1024;
+
     void restart()
     {
         m_product = std::unique_ptr<Device>(new Device);
@@ -156,8 +342,65 @@ class DeviceBuilder
         m_product->m_physicalHandle = a;
         vkGetPhysicalDeviceFeatures(a, &m_product->m_features);
         vkGetPhysicalDeviceProperties(a, &m_product->m_props);
+        vkGetPhysicalDeviceMemoryProperties(a, &m_product->m_memoryProperties);
+        if (m_product->m_props.apiVersion >= VK_API_VERSION_1_2)
+        {
+            VkPhysicalDeviceFeatures2 features2 = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext = &m_product->m_features12,
+            };
+            vkGetPhysicalDeviceFeatures2(a, &features2);
+            m_product->m_features12.pNext = nullptr;
+        }
 
         m_product->m_graphicsFamilyIndex = m_product->findQueueFamilyIndex(VK_QUEUE_GRAPHICS_BIT);
+        m_product->m_transferFamilyIndex = m_product->findTransferQueueFamilyIndex();
+    }
+
+    /**
+     * @brief File the pipeline cache is loaded from and saved to (named after the device by default)
+     *
+     */
+    void setPipelineCacheFilename(const std::string &filename)
+    {
+        m_pipelineCacheFilename = filename;
+    }
+    /**
+     * @brief File the descriptions of the built pipelines are recorded to (named after the device by default)
+     *
+     */
+    void setPipelineManifestFilename(const std::string &filename)
+    {
+        m_pipelineManifestFilename = filename;
+    }
+    /**
+     * @brief Number of threads compiling pipelines in the background (see PipelineBuilder::buildAsync)
+     *
+     */
+    void setPipelineCompilerThreadCount(uint32_t a)
+    {
+        m_pipelineCompilerThreadCount = a;
+    }
+    /**
+     * @brief Use dynamic rendering and extended dynamic state where supported
+     *
+     * Pipelines are then independent of the VkRenderPass and of the state set per draw (cull mode,
+     * depth test, topology...), which is recorded by a DynamicStateRecorder.
+     */
+    void setDynamicStateMode(bool bEnabled)
+    {
+        m_bDynamicStateMode = bEnabled;
+    }
+    /**
+     * @brief Create a BindlessTable where descriptor indexing is supported
+     *
+     * The capacities are clamped to the update-after-bind limits of the device.
+     */
+    void setBindlessMode(bool bEnabled, uint32_t textureCapacity = 4096, uint32_t bufferCapacity = 1024)
+    {
+        m_bBindlessMode = bEnabled;
+        m_bindlessTextureCapacity = textureCapacity;
+        m_bindlessBufferCapacity = bufferCapacity;
     }
 
     void setSurface(const Surface *surface)
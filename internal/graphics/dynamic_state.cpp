@@ -0,0 +1,85 @@
+#include <iostream>
+
+#include "device.hpp"
+
+#include "dynamic_state.hpp"
+
+DynamicStateRecorder::DynamicStateRecorder(std::weak_ptr<Device> device) : m_device(device)
+{
+}
+
+DynamicStateRecorder::~DynamicStateRecorder()
+{
+    printStatistics();
+}
+
+void DynamicStateRecorder::reset()
+{
+    m_bValid = false;
+}
+
+void DynamicStateRecorder::record(VkCommandBuffer commandBuffer, const DynamicStateT &state)
+{
+    auto devicePtr = m_device.lock();
+    const DeviceDispatchT &dispatch = devicePtr->getDispatch();
+
+    // a state is set if it is unknown or differs from the one of the command buffer
+    auto isDirty = [&](auto DynamicStateT::*field) {
+        bool bDirty = !m_bValid || m_current.*field != state.*field;
+        if (bDirty)
+            ++m_recordedCount;
+        else
+            ++m_skippedCount;
+        return bDirty;
+    };
+
+    if (devicePtr->isExtendedDynamicStateEnabled())
+    {
+        if (isDirty(&DynamicStateT::cullMode))
+            dispatch.vkCmdSetCullModeEXT(commandBuffer, state.cullMode);
+        if (isDirty(&DynamicStateT::frontFace))
+            dispatch.vkCmdSetFrontFaceEXT(commandBuffer, state.frontFace);
+        if (isDirty(&DynamicStateT::topology))
+            dispatch.vkCmdSetPrimitiveTopologyEXT(commandBuffer, state.topology);
+        if (isDirty(&DynamicStateT::depthTestEnable))
+            dispatch.vkCmdSetDepthTestEnableEXT(commandBuffer, state.depthTestEnable);
+        if (isDirty(&DynamicStateT::depthWriteEnable))
+            dispatch.vkCmdSetDepthWriteEnableEXT(commandBuffer, state.depthWriteEnable);
+        if (isDirty(&DynamicStateT::depthCompareOp))
+            dispatch.vkCmdSetDepthCompareOpEXT(commandBuffer, state.depthCompareOp);
+    }
+    if (devicePtr->isExtendedDynamicState2Enabled())
+    {
+        if (isDirty(&DynamicStateT::primitiveRestartEnable))
+            dispatch.vkCmdSetPrimitiveRestartEnableEXT(commandBuffer, state.primitiveRestartEnable);
+        if (isDirty(&DynamicStateT::depthBiasEnable))
+            dispatch.vkCmdSetDepthBiasEnableEXT(commandBuffer, state.depthBiasEnable);
+        if (isDirty(&DynamicStateT::rasterizerDiscardEnable))
+            dispatch.vkCmdSetRasterizerDiscardEnableEXT(commandBuffer, state.rasterizerDiscardEnable);
+    }
+    if (devicePtr->isExtendedDynamicState3Enabled())
+    {
+        if (isDirty(&DynamicStateT::depthClampEnable))
+            dispatch.vkCmdSetDepthClampEnableEXT(commandBuffer, state.depthClampEnable);
+        if (isDirty(&DynamicStateT::polygonMode))
+            dispatch.vkCmdSetPolygonModeEXT(commandBuffer, state.polygonMode);
+        // pipelines have a single color attachment
+        if (isDirty(&DynamicStateT::colorBlendEnable))
+            dispatch.vkCmdSetColorBlendEnableEXT(commandBuffer, 0, 1, &state.colorBlendEnable);
+        if (isDirty(&DynamicStateT::colorWriteMask))
+            dispatch.vkCmdSetColorWriteMaskEXT(commandBuffer, 0, 1, &state.colorWriteMask);
+    }
+
+    m_current = state;
+    m_bValid = true;
+}
+
+void DynamicStateRecorder::printStatistics() const
+{
+    if (m_recordedCount + m_skippedCount == 0)
+        return;
+
+    std::cout << "Dynamic state : " << m_recordedCount << " state(s) recorded, " << m_skippedCount
+              << " redundant state(s) skipped (" << 100 * m_skippedCount / (m_recordedCount + m_skippedCount)
+              << "%)" << std::endl;
+}
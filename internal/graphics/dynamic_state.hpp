@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <vulkan/vulkan.h>
+
+class Device;
+
+/**
+ * @brief Fixed function state set while recording instead of being baked in the pipelines
+ *
+ * Only the fields of the enabled extended dynamic state extensions are dynamic (see
+ * Device::isExtendedDynamicStateEnabled and its siblings), the other ones stay baked in the pipeline.
+ */
+struct DynamicStateT
+{
+    // VK_EXT_extended_dynamic_state
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkBool32 depthTestEnable = VK_TRUE;
+    VkBool32 depthWriteEnable = VK_TRUE;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+    // VK_EXT_extended_dynamic_state2
+    VkBool32 primitiveRestartEnable = VK_FALSE;
+    VkBool32 depthBiasEnable = VK_FALSE;
+    VkBool32 rasterizerDiscardEnable = VK_FALSE;
+
+    // VK_EXT_extended_dynamic_state3
+    VkBool32 depthClampEnable = VK_FALSE;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkBool32 colorBlendEnable = VK_TRUE;
+    VkColorComponentFlags colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    bool operator==(const DynamicStateT &) const = default;
+};
+
+/**
+ * @brief Records the dynamic state of the draws, skipping the commands setting a state to its current value
+ *
+ * The recorder tracks a single command buffer, it must be reset when recording a new one or after
+ * binding a pipeline whose state is not dynamic.
+ */
+class DynamicStateRecorder
+{
+  private:
+    std::weak_ptr<Device> m_device;
+
+    // state of the command buffer, unknown after a reset
+    DynamicStateT m_current;
+    bool m_bValid = false;
+
+    uint64_t m_recordedCount = 0;
+    uint64_t m_skippedCount = 0;
+
+  public:
+    DynamicStateRecorder(std::weak_ptr<Device> device);
+    ~DynamicStateRecorder();
+
+    DynamicStateRecorder(const DynamicStateRecorder &) = delete;
+    DynamicStateRecorder &operator=(const DynamicStateRecorder &) = delete;
+    DynamicStateRecorder(DynamicStateRecorder &&) = delete;
+    DynamicStateRecorder &operator=(DynamicStateRecorder &&) = delete;
+
+    /**
+     * @brief Forget the state of the command buffer, the next record sets every state
+     *
+     */
+    void reset();
+
+    /**
+     * @brief Set the states of the next draws that differ from the current ones
+     *
+     */
+    void record(VkCommandBuffer commandBuffer, const DynamicStateT &state);
+
+    void printStatistics() const;
+};
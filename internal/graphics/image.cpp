@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <iostream>
+#include <vector>
 
 #include "buffer.hpp"
 #include "device.hpp"
@@ -11,9 +14,17 @@ Image::~Image()
     if (!m_device.lock())
         return;
 
-    auto deviceHandle = m_device.lock()->getHandle();
-    vkFreeMemory(deviceHandle, m_memory, nullptr);
-    vkDestroyImage(deviceHandle, m_handle, nullptr);
+    auto devicePtr = m_device.lock();
+
+    if (m_bDefragmentable)
+        devicePtr->getDefragmenter()->unregisterResource(this);
+
+    devicePtr->getDeletionQueue()->push(
+        [deviceHandle = devicePtr->getHandle(), allocator = devicePtr->getAllocator(), handle = m_handle,
+         allocation = m_allocation]() {
+            vkDestroyImage(deviceHandle, handle, nullptr);
+            allocator->free(allocation);
+        });
 }
 
 void Image::transitionImageLayout(ImageLayoutTransition transition)
@@ -21,8 +32,7 @@ void Image::transitionImageLayout(ImageLayoutTransition transition)
     auto devicePtr = m_device.lock();
     VkCommandBuffer commandBuffer = devicePtr->cmdBeginOneTimeSubmit();
 
-    vkCmdPipelineBarrier(commandBuffer, transition.srcStageMask, transition.dstStageMask, 0, 0, nullptr, 0, nullptr, 1,
-                         &transition.barrier);
+    recordTransitionImageLayout(commandBuffer, transition);
 
     devicePtr->cmdEndOneTimeSubmit(commandBuffer);
 }
@@ -32,8 +42,21 @@ void Image::copyBufferToImage(VkBuffer buffer)
     auto devicePtr = m_device.lock();
     VkCommandBuffer commandBuffer = devicePtr->cmdBeginOneTimeSubmit();
 
+    recordCopyBufferToImage(commandBuffer, buffer);
+
+    devicePtr->cmdEndOneTimeSubmit(commandBuffer);
+}
+
+void Image::recordTransitionImageLayout(VkCommandBuffer commandBuffer, const ImageLayoutTransition &transition) const
+{
+    vkCmdPipelineBarrier(commandBuffer, transition.srcStageMask, transition.dstStageMask, 0, 0, nullptr, 0, nullptr, 1,
+                         &transition.barrier);
+}
+
+void Image::recordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset) const
+{
     VkBufferImageCopy region = {
-        .bufferOffset = 0,
+        .bufferOffset = bufferOffset,
         .bufferRowLength = 0,
         .bufferImageHeight = 0,
         .imageSubresource =
@@ -58,8 +81,105 @@ void Image::copyBufferToImage(VkBuffer buffer)
     };
 
     vkCmdCopyBufferToImage(commandBuffer, buffer, m_handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
 
-    devicePtr->cmdEndOneTimeSubmit(commandBuffer);
+bool Image::recordMove(VkCommandBuffer commandBuffer, const MemoryAllocationT &allocation)
+{
+    auto devicePtr = m_device.lock();
+    auto deviceHandle = devicePtr->getHandle();
+
+    VkImage handle;
+    VkResult res = vkCreateImage(deviceHandle, &m_createInfo, nullptr, &handle);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create moved image : " << res << std::endl;
+        return false;
+    }
+    vkBindImageMemory(deviceHandle, handle, allocation.memory, allocation.offset);
+
+    VkImageSubresourceRange subresourceRange = {
+        .aspectMask = m_aspectFlags,
+        .baseMipLevel = 0,
+        .levelCount = m_createInfo.mipLevels,
+        .baseArrayLayer = 0,
+        .layerCount = m_createInfo.arrayLayers,
+    };
+    std::array<VkImageMemoryBarrier, 2> barriers = {
+        VkImageMemoryBarrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = m_handle,
+            .subresourceRange = subresourceRange,
+        },
+        VkImageMemoryBarrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = handle,
+            .subresourceRange = subresourceRange,
+        },
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                         nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    std::vector<VkImageCopy> regions(m_createInfo.mipLevels);
+    for (uint32_t i = 0; i < m_createInfo.mipLevels; ++i)
+    {
+        VkImageSubresourceLayers subresource = {
+            .aspectMask = m_aspectFlags,
+            .mipLevel = i,
+            .baseArrayLayer = 0,
+            .layerCount = m_createInfo.arrayLayers,
+        };
+        regions[i] = VkImageCopy{
+            .srcSubresource = subresource,
+            .dstSubresource = subresource,
+            .extent =
+                {
+                    .width = std::max(m_createInfo.extent.width >> i, 1U),
+                    .height = std::max(m_createInfo.extent.height >> i, 1U),
+                    .depth = std::max(m_createInfo.extent.depth >> i, 1U),
+                },
+        };
+    }
+    vkCmdCopyImage(commandBuffer, m_handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, handle,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+    // back to the sampled layout (the defragmenter makes the transfer writes visible)
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = handle,
+        .subresourceRange = subresourceRange,
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &barrier);
+
+    // frames in flight still sample the old image
+    devicePtr->getDeletionQueue()->push([deviceHandle, allocator = devicePtr->getAllocator(), handle = m_handle,
+                                         oldAllocation = m_allocation]() {
+        vkDestroyImage(deviceHandle, handle, nullptr);
+        allocator->free(oldAllocation);
+    });
+
+    m_handle = handle;
+    m_allocation = allocation;
+    ++m_generation;
+    return true;
 }
 
 VkImageView Image::createImageView()
@@ -103,6 +223,11 @@ std::unique_ptr<Image> ImageBuilder::build()
     auto devicePtr = m_device.lock();
     auto deviceHandle = devicePtr->getHandle();
 
+    // moves copy the content from the old image to the new one
+    VkImageUsageFlags usage = m_usage;
+    if (m_bDefragmentable)
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
     VkImageCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
         .flags = 0,
@@ -118,7 +243,7 @@ std::unique_ptr<Image> ImageBuilder::build()
         .arrayLayers = m_arrayLayers,
         .samples = m_samples,
         .tiling = m_tiling,
-        .usage = m_usage,
+        .usage = usage,
         .sharingMode = m_sharingMode,
         .initialLayout = m_initialLayout,
     };
@@ -130,24 +255,37 @@ std::unique_ptr<Image> ImageBuilder::build()
         return nullptr;
     }
 
-    VkMemoryRequirements memReq;
-    vkGetImageMemoryRequirements(deviceHandle, m_product->m_handle, &memReq);
-    std::optional<uint32_t> memoryTypeIndex = devicePtr->findMemoryTypeIndex(memReq, m_properties);
-
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReq.size,
-        .memoryTypeIndex = memoryTypeIndex.value(),
-    };
+    MemoryRequirementsT memReq = devicePtr->getAllocator()->getImageMemoryRequirements(m_product->m_handle);
+    std::optional<uint32_t> memoryTypeIndex = devicePtr->findMemoryTypeIndex(memReq.requirements, m_properties);
+    if (!memoryTypeIndex.has_value())
+    {
+        std::cerr << "Failed to find a memory type for the image" << std::endl;
+        vkDestroyImage(deviceHandle, m_product->m_handle, nullptr);
+        m_product->m_handle = VK_NULL_HANDLE;
+        return nullptr;
+    }
 
-    res = vkAllocateMemory(deviceHandle, &allocInfo, nullptr, &m_product->m_memory);
-    if (res != VK_SUCCESS)
+    // big images (render targets, high resolution textures) get their own VkDeviceMemory
+    bool bDedicated = memReq.requirements.size >= s_dedicatedSizeThreshold;
+    std::optional<MemoryAllocationT> allocation = devicePtr->getAllocator()->allocate(
+        memReq, memoryTypeIndex.value(), m_tiling == VK_IMAGE_TILING_LINEAR, bDedicated, m_memoryCategory);
+    if (!allocation.has_value())
     {
-        std::cerr << "Failed to allocate memory : " << res << std::endl;
+        std::cerr << "Failed to allocate memory" << std::endl;
+        vkDestroyImage(deviceHandle, m_product->m_handle, nullptr);
+        m_product->m_handle = VK_NULL_HANDLE;
         return nullptr;
     }
+    m_product->m_allocation = allocation.value();
+
+    vkBindImageMemory(deviceHandle, m_product->m_handle, m_product->m_allocation.memory,
+                      m_product->m_allocation.offset);
 
-    vkBindImageMemory(deviceHandle, m_product->m_handle, m_product->m_memory, 0);
+    m_product->m_createInfo = createInfo;
+    m_product->m_creationFrameSerial = devicePtr->getDeletionQueue()->getFrameSerial();
+    m_product->m_bDefragmentable = m_bDefragmentable && !m_product->m_allocation.mapped;
+    if (m_product->m_bDefragmentable)
+        devicePtr->getDefragmenter()->registerResource(m_product.get());
 
     return std::move(m_product);
 }
@@ -171,6 +309,7 @@ void ImageDirector::createDepthImage2DBuilder(ImageBuilder &builder)
     builder.setUsage(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
     builder.setProperties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     builder.setAspectFlags(VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
+    builder.setMemoryCategory(MemoryCategory::Attachment);
 }
 
 void ImageDirector::createSampledImage2DBuilder(ImageBuilder &builder)
@@ -179,6 +318,8 @@ void ImageDirector::createSampledImage2DBuilder(ImageBuilder &builder)
     builder.setUsage(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
     builder.setProperties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     builder.setAspectFlags(VK_IMAGE_ASPECT_COLOR_BIT);
+    builder.setMemoryCategory(MemoryCategory::Texture);
+    builder.setDefragmentable(true);
 }
 
 void ImageLayoutTransitionBuilder::restart()
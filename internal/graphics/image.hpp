@@ -4,6 +4,9 @@
 
 #include <vulkan/vulkan.h>
 
+#include "memory_allocator.hpp"
+#include "memory_defragmenter.hpp"
+
 class Device;
 class Buffer;
 class ImageLayoutTransitionBuilder;
@@ -23,7 +26,13 @@ class ImageLayoutTransition
 
 class ImageBuilder;
 
-class Image
+/**
+ * @brief Device image
+ *
+ * Defragmentable images are expected to stay in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL once uploaded.
+ * A move replaces the handle and increments the generation, views of the image must then be recreated.
+ */
+class Image : public DefragmentableI
 {
     friend ImageBuilder;
 
@@ -38,12 +47,20 @@ class Image
     VkImageAspectFlags m_aspectFlags;
 
     VkImage m_handle;
-    VkDeviceMemory m_memory;
+    MemoryAllocationT m_allocation;
+
+    // create info kept to rebuild the image when it is moved
+    VkImageCreateInfo m_createInfo;
+
+    bool m_bDefragmentable = false;
+    uint64_t m_creationFrameSerial = 0;
+    // incremented each time the image is moved
+    uint64_t m_generation = 0;
 
     Image() = default;
 
   public:
-    ~Image();
+    ~Image() override;
 
     Image(const Image &) = delete;
     Image &operator=(const Image &) = delete;
@@ -53,6 +70,11 @@ class Image
     void transitionImageLayout(ImageLayoutTransition transition);
     void copyBufferToImage(VkBuffer buffer);
 
+    void recordTransitionImageLayout(VkCommandBuffer commandBuffer, const ImageLayoutTransition &transition) const;
+    void recordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset = 0) const;
+
+    [[nodiscard]] bool recordMove(VkCommandBuffer commandBuffer, const MemoryAllocationT &allocation) override;
+
     VkImageView createImageView();
 
   public:
@@ -70,11 +92,26 @@ class Image
     {
         return m_format;
     }
+
+    [[nodiscard]] const MemoryAllocationT &getAllocation() const override
+    {
+        return m_allocation;
+    }
+    [[nodiscard]] uint64_t getCreationFrameSerial() const override
+    {
+        return m_creationFrameSerial;
+    }
+    [[nodiscard]] uint64_t getGeneration() const
+    {
+        return m_generation;
+    }
 };
 
 class ImageBuilder
 {
   private:
+    static constexpr VkDeviceSize s_dedicatedSizeThreshold = 16 * 1024 * 1024;
+
     std::unique_ptr<Image> m_product;
 
     std::weak_ptr<Device> m_device;
@@ -92,6 +129,10 @@ class ImageBuilder
     VkSharingMode m_sharingMode;
     VkImageLayout m_initialLayout;
 
+    MemoryCategory m_memoryCategory = MemoryCategory::Other;
+
+    bool m_bDefragmentable = false;
+
     void restart()
     {
         m_product = std::unique_ptr<Image>(new Image);
@@ -164,6 +205,18 @@ class ImageBuilder
     {
         m_product->m_aspectFlags = a;
     }
+    void setMemoryCategory(MemoryCategory a)
+    {
+        m_memoryCategory = a;
+    }
+    /**
+     * @brief Let the defragmenter move the image (sampled images only, adds the transfer usages)
+     *
+     */
+    void setDefragmentable(bool a)
+    {
+        m_bDefragmentable = a;
+    }
 
     std::unique_ptr<Image> build();
 };
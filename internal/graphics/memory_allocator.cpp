@@ -0,0 +1,429 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <iostream>
+
+#include "memory_allocator.hpp"
+
+const char *getMemoryCategoryName(MemoryCategory category)
+{
+    switch (category)
+    {
+    case MemoryCategory::Vertex:
+        return "vertex";
+    case MemoryCategory::Index:
+        return "index";
+    case MemoryCategory::Uniform:
+        return "uniform";
+    case MemoryCategory::Texture:
+        return "texture";
+    case MemoryCategory::Attachment:
+        return "attachment";
+    case MemoryCategory::Staging:
+        return "staging";
+    default:
+        return "other";
+    }
+}
+
+MemoryAllocator::MemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties &memoryProperties)
+    : m_device(device), m_memoryProperties(memoryProperties)
+{
+    m_heapStats.resize(m_memoryProperties.memoryHeapCount);
+    for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+    {
+        m_heapStats[i].size = m_memoryProperties.memoryHeaps[i].size;
+        m_heapStats[i].flags = m_memoryProperties.memoryHeaps[i].flags;
+    }
+
+    // two pools per memory type : linear resources then optimal resources
+    m_pools.resize(m_memoryProperties.memoryTypeCount * 2);
+    for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+    {
+        VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[i].heapIndex].size;
+
+        // small heaps (e.g. host visible device local memory) get smaller blocks
+        VkDeviceSize blockSize = s_defaultBlockSize;
+        while (blockSize > s_minNodeSize && blockSize > heapSize / 8)
+            blockSize >>= 1;
+
+        for (uint32_t j = 0; j < 2; ++j)
+        {
+            PoolT &pool = m_pools[i * 2 + j];
+            pool.memoryTypeIndex = i;
+            pool.blockSize = blockSize;
+            pool.maxOrder = static_cast<uint32_t>(std::countr_zero(blockSize / s_minNodeSize));
+        }
+    }
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    // leak report
+    for (size_t i = 0; i < m_categoryStats.size(); ++i)
+    {
+        const MemoryCategoryStatsT &stats = m_categoryStats[i];
+        if (stats.allocationCount == 0)
+            continue;
+        std::cerr << "Memory leak : " << stats.allocationCount << " "
+                  << getMemoryCategoryName(static_cast<MemoryCategory>(i)) << " allocation(s) still alive ("
+                  << stats.bytes << " bytes)" << std::endl;
+    }
+
+    for (PoolT &pool : m_pools)
+    {
+        for (std::unique_ptr<BlockT> &block : pool.blocks)
+        {
+            if (block)
+                freeDeviceMemory(block->memory, block->mapped, pool.blockSize, pool.memoryTypeIndex);
+        }
+        pool.blocks.clear();
+    }
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void **mapped,
+                                                     const void *pNext)
+{
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = pNext,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex,
+    };
+    VkDeviceMemory memory;
+    VkResult res = vkAllocateMemory(m_device, &allocInfo, nullptr, &memory);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to allocate device memory : " << res << std::endl;
+        return VK_NULL_HANDLE;
+    }
+    ++m_deviceMemoryCount;
+
+    MemoryHeapStatsT &heapStats = m_heapStats[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+    heapStats.blockBytes += size;
+    heapStats.peakBlockBytes = std::max(heapStats.peakBlockBytes, heapStats.blockBytes);
+
+    *mapped = nullptr;
+    if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        res = vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, mapped);
+        if (res != VK_SUCCESS)
+            std::cerr << "Failed to map device memory : " << res << std::endl;
+    }
+
+    return memory;
+}
+
+void MemoryAllocator::freeDeviceMemory(VkDeviceMemory memory, void *mapped, VkDeviceSize size,
+                                       uint32_t memoryTypeIndex)
+{
+    if (mapped)
+        vkUnmapMemory(m_device, memory);
+    vkFreeMemory(m_device, memory, nullptr);
+    --m_deviceMemoryCount;
+
+    m_heapStats[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].blockBytes -= size;
+}
+
+std::optional<VkDeviceSize> MemoryAllocator::allocateNode(PoolT &pool, BlockT &block, uint32_t order)
+{
+    uint32_t o = order;
+    while (o <= pool.maxOrder && block.freeLists[o].empty())
+        ++o;
+    if (o > pool.maxOrder)
+        return std::optional<VkDeviceSize>();
+
+    VkDeviceSize offset = *block.freeLists[o].begin();
+    block.freeLists[o].erase(block.freeLists[o].begin());
+
+    // split until the node has the requested size, the upper halves go back to the free lists
+    while (o > order)
+    {
+        --o;
+        block.freeLists[o].insert(offset + (s_minNodeSize << o));
+    }
+
+    block.usedSize += s_minNodeSize << order;
+    return std::optional<VkDeviceSize>(offset);
+}
+
+void MemoryAllocator::freeNode(PoolT &pool, BlockT &block, VkDeviceSize offset, uint32_t order)
+{
+    block.usedSize -= s_minNodeSize << order;
+
+    // merge with the buddy as long as it is free
+    while (order < pool.maxOrder)
+    {
+        VkDeviceSize buddy = offset ^ (s_minNodeSize << order);
+        if (block.freeLists[order].erase(buddy) == 0)
+            break;
+        offset = std::min(offset, buddy);
+        ++order;
+    }
+    block.freeLists[order].insert(offset);
+}
+
+MemoryRequirementsT MemoryAllocator::getBufferMemoryRequirements(VkBuffer buffer) const
+{
+    VkBufferMemoryRequirementsInfo2 info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+        .buffer = buffer,
+    };
+    VkMemoryDedicatedRequirements dedicatedRequirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+    };
+    VkMemoryRequirements2 requirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+        .pNext = &dedicatedRequirements,
+    };
+    vkGetBufferMemoryRequirements2(m_device, &info, &requirements);
+
+    return MemoryRequirementsT{
+        .requirements = requirements.memoryRequirements,
+        .bPrefersDedicated = dedicatedRequirements.prefersDedicatedAllocation == VK_TRUE,
+        .bRequiresDedicated = dedicatedRequirements.requiresDedicatedAllocation == VK_TRUE,
+        .buffer = buffer,
+    };
+}
+
+MemoryRequirementsT MemoryAllocator::getImageMemoryRequirements(VkImage image) const
+{
+    VkImageMemoryRequirementsInfo2 info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+        .image = image,
+    };
+    VkMemoryDedicatedRequirements dedicatedRequirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+    };
+    VkMemoryRequirements2 requirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+        .pNext = &dedicatedRequirements,
+    };
+    vkGetImageMemoryRequirements2(m_device, &info, &requirements);
+
+    return MemoryRequirementsT{
+        .requirements = requirements.memoryRequirements,
+        .bPrefersDedicated = dedicatedRequirements.prefersDedicatedAllocation == VK_TRUE,
+        .bRequiresDedicated = dedicatedRequirements.requiresDedicatedAllocation == VK_TRUE,
+        .image = image,
+    };
+}
+
+std::optional<MemoryAllocationT> MemoryAllocator::allocate(const MemoryRequirementsT &memoryRequirements,
+                                                           uint32_t memoryTypeIndex, bool bLinear, bool bDedicated,
+                                                           MemoryCategory category)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const VkMemoryRequirements &requirements = memoryRequirements.requirements;
+
+    uint32_t poolIndex = memoryTypeIndex * 2 + (bLinear ? 0 : 1);
+    PoolT &pool = m_pools[poolIndex];
+
+    // buddy nodes are aligned on their own size, rounding up the size takes care of the alignment
+    VkDeviceSize nodeSize =
+        std::bit_ceil(std::max({requirements.size, requirements.alignment, s_minNodeSize}));
+
+    MemoryAllocationT allocation = {
+        .size = requirements.size,
+        .memoryTypeIndex = memoryTypeIndex,
+        .category = category,
+        .poolIndex = poolIndex,
+    };
+
+    if (bDedicated || memoryRequirements.bRequiresDedicated || memoryRequirements.bPrefersDedicated ||
+        nodeSize > pool.blockSize / 2)
+    {
+        // lets the driver place the memory for the resource (e.g. compressed render targets)
+        VkMemoryDedicatedAllocateInfo dedicatedInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+            .image = memoryRequirements.image,
+            .buffer = memoryRequirements.buffer,
+        };
+        bool bForResource = memoryRequirements.image != VK_NULL_HANDLE || memoryRequirements.buffer != VK_NULL_HANDLE;
+        allocation.memory = allocateDeviceMemory(requirements.size, memoryTypeIndex, &allocation.mapped,
+                                                 bForResource ? &dedicatedInfo : nullptr);
+        if (allocation.memory == VK_NULL_HANDLE)
+            return std::optional<MemoryAllocationT>();
+        trackAllocation(allocation);
+        return std::optional<MemoryAllocationT>(allocation);
+    }
+
+    allocation.order = static_cast<uint32_t>(std::countr_zero(nodeSize / s_minNodeSize));
+
+    std::optional<VkDeviceSize> offset;
+    uint32_t blockIndex = 0;
+    for (; blockIndex < pool.blocks.size(); ++blockIndex)
+    {
+        if (!pool.blocks[blockIndex])
+            continue;
+        offset = allocateNode(pool, *pool.blocks[blockIndex], allocation.order);
+        if (offset.has_value())
+            break;
+    }
+
+    if (!offset.has_value())
+    {
+        auto block = std::make_unique<BlockT>();
+        block->memory = allocateDeviceMemory(pool.blockSize, memoryTypeIndex, &block->mapped);
+        if (block->memory == VK_NULL_HANDLE)
+            return std::optional<MemoryAllocationT>();
+        block->freeLists.resize(pool.maxOrder + 1);
+        block->freeLists[pool.maxOrder].insert(0);
+
+        // reuse the slot of a released block to keep block indices stable
+        auto it = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+        blockIndex = static_cast<uint32_t>(it - pool.blocks.begin());
+        if (it == pool.blocks.end())
+            pool.blocks.emplace_back(std::move(block));
+        else
+            *it = std::move(block);
+
+        offset = allocateNode(pool, *pool.blocks[blockIndex], allocation.order);
+    }
+
+    BlockT &block = *pool.blocks[blockIndex];
+    allocation.memory = block.memory;
+    allocation.offset = offset.value();
+    allocation.blockIndex = blockIndex;
+    if (block.mapped)
+        allocation.mapped = static_cast<char *>(block.mapped) + allocation.offset;
+
+    trackAllocation(allocation);
+    return std::optional<MemoryAllocationT>(allocation);
+}
+
+void MemoryAllocator::free(const MemoryAllocationT &allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    MemoryCategoryStatsT &categoryStats = m_categoryStats[static_cast<size_t>(allocation.category)];
+    --categoryStats.allocationCount;
+    categoryStats.bytes -= allocation.size;
+
+    if (allocation.blockIndex == UINT32_MAX)
+    {
+        freeDeviceMemory(allocation.memory, allocation.mapped, allocation.size, allocation.memoryTypeIndex);
+        return;
+    }
+
+    PoolT &pool = m_pools[allocation.poolIndex];
+    std::unique_ptr<BlockT> &block = pool.blocks[allocation.blockIndex];
+    freeNode(pool, *block, allocation.offset, allocation.order);
+
+    if (block->usedSize != 0)
+        return;
+
+    // give empty blocks back to the driver, but keep one around to avoid allocation churn
+    auto liveBlockCount = std::count_if(pool.blocks.begin(), pool.blocks.end(),
+                                        [](const std::unique_ptr<BlockT> &b) { return b != nullptr; });
+    if (liveBlockCount > 1)
+    {
+        freeDeviceMemory(block->memory, block->mapped, pool.blockSize, pool.memoryTypeIndex);
+        block.reset();
+    }
+}
+
+std::vector<MemoryBlockRefT> MemoryAllocator::getDefragmentationSources() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<MemoryBlockRefT> sources;
+    for (uint32_t poolIndex = 0; poolIndex < m_pools.size(); ++poolIndex)
+    {
+        const PoolT &pool = m_pools[poolIndex];
+
+        // mapped memory cannot move, pointers to it are handed out
+        if (m_memoryProperties.memoryTypes[pool.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+            continue;
+
+        std::optional<uint32_t> leastUsedBlockIndex;
+        VkDeviceSize freeSize = 0;
+        for (uint32_t blockIndex = 0; blockIndex < pool.blocks.size(); ++blockIndex)
+        {
+            const std::unique_ptr<BlockT> &block = pool.blocks[blockIndex];
+            if (!block)
+                continue;
+            freeSize += pool.blockSize - block->usedSize;
+            if (!leastUsedBlockIndex.has_value() ||
+                block->usedSize < pool.blocks[leastUsedBlockIndex.value()]->usedSize)
+                leastUsedBlockIndex = blockIndex;
+        }
+        if (!leastUsedBlockIndex.has_value())
+            continue;
+
+        const BlockT &leastUsedBlock = *pool.blocks[leastUsedBlockIndex.value()];
+        VkDeviceSize otherFreeSize = freeSize - (pool.blockSize - leastUsedBlock.usedSize);
+        if (leastUsedBlock.usedSize == 0 || leastUsedBlock.usedSize > otherFreeSize)
+            continue;
+
+        sources.emplace_back(MemoryBlockRefT{
+            .poolIndex = poolIndex,
+            .blockIndex = leastUsedBlockIndex.value(),
+        });
+    }
+    return sources;
+}
+
+std::optional<MemoryAllocationT> MemoryAllocator::reallocate(const MemoryAllocationT &allocation,
+                                                             const std::vector<MemoryBlockRefT> &excludedBlocks)
+{
+    assert(allocation.blockIndex != UINT32_MAX);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    PoolT &pool = m_pools[allocation.poolIndex];
+    for (uint32_t blockIndex = 0; blockIndex < pool.blocks.size(); ++blockIndex)
+    {
+        if (!pool.blocks[blockIndex])
+            continue;
+        bool bExcluded = std::any_of(excludedBlocks.begin(), excludedBlocks.end(), [&](const MemoryBlockRefT &ref) {
+            return ref.poolIndex == allocation.poolIndex && ref.blockIndex == blockIndex;
+        });
+        if (bExcluded)
+            continue;
+
+        BlockT &block = *pool.blocks[blockIndex];
+        std::optional<VkDeviceSize> offset = allocateNode(pool, block, allocation.order);
+        if (!offset.has_value())
+            continue;
+
+        MemoryAllocationT result = allocation;
+        result.memory = block.memory;
+        result.offset = offset.value();
+        result.blockIndex = blockIndex;
+        result.mapped = block.mapped ? static_cast<char *>(block.mapped) + result.offset : nullptr;
+
+        trackAllocation(result);
+        return std::optional<MemoryAllocationT>(result);
+    }
+    return std::optional<MemoryAllocationT>();
+}
+
+void MemoryAllocator::trackAllocation(const MemoryAllocationT &allocation)
+{
+    MemoryCategoryStatsT &categoryStats = m_categoryStats[static_cast<size_t>(allocation.category)];
+    ++categoryStats.allocationCount;
+    categoryStats.bytes += allocation.size;
+    categoryStats.peakBytes = std::max(categoryStats.peakBytes, categoryStats.bytes);
+}
+
+MemoryStatsT MemoryAllocator::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    MemoryStatsT stats = {
+        .heaps = m_heapStats,
+        .categories = m_categoryStats,
+        .deviceMemoryCount = m_deviceMemoryCount,
+    };
+    for (MemoryHeapStatsT &heap : stats.heaps)
+    {
+        heap.usage = heap.blockBytes;
+        heap.budget = heap.size;
+    }
+    return stats;
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+class Device;
+
+/**
+ * @brief What an allocation is used for, set by the resource builders for statistics
+ *
+ */
+enum class MemoryCategory : uint8_t
+{
+    Other,
+    Vertex,
+    Index,
+    Uniform,
+    Texture,
+    Attachment,
+    Staging,
+    Count,
+};
+
+[[nodiscard]] const char *getMemoryCategoryName(MemoryCategory category);
+
+struct MemoryCategoryStatsT
+{
+    uint32_t allocationCount = 0;
+    VkDeviceSize bytes = 0;
+    VkDeviceSize peakBytes = 0;
+};
+
+struct MemoryHeapStatsT
+{
+    VkDeviceSize size = 0;
+    VkMemoryHeapFlags flags = 0;
+
+    // device memory allocated by the application (blocks and dedicated allocations)
+    VkDeviceSize blockBytes = 0;
+    VkDeviceSize peakBlockBytes = 0;
+
+    // process wide usage and budget reported by VK_EXT_memory_budget (blockBytes and size otherwise)
+    VkDeviceSize usage = 0;
+    VkDeviceSize budget = 0;
+};
+
+struct MemoryStatsT
+{
+    std::vector<MemoryHeapStatsT> heaps;
+    std::array<MemoryCategoryStatsT, static_cast<size_t>(MemoryCategory::Count)> categories;
+    uint32_t deviceMemoryCount = 0;
+};
+
+/**
+ * @brief Handle to a range of device memory owned by the MemoryAllocator
+ *
+ */
+struct MemoryAllocationT
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+
+    // persistently mapped pointer to the start of the range (host visible memory only)
+    void *mapped = nullptr;
+
+    uint32_t memoryTypeIndex = 0;
+    MemoryCategory category = MemoryCategory::Other;
+
+    // allocator bookkeeping (blockIndex is UINT32_MAX for dedicated allocations)
+    uint32_t poolIndex = 0;
+    uint32_t blockIndex = UINT32_MAX;
+    uint32_t order = 0;
+};
+
+/**
+ * @brief Memory requirements of a buffer or an image, with the driver's preference for a dedicated allocation
+ *
+ */
+struct MemoryRequirementsT
+{
+    VkMemoryRequirements requirements;
+    bool bPrefersDedicated = false;
+    bool bRequiresDedicated = false;
+
+    // resource a dedicated allocation is made for (only one of them is set)
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkImage image = VK_NULL_HANDLE;
+};
+
+/**
+ * @brief Identifies a memory block of the MemoryAllocator
+ *
+ */
+struct MemoryBlockRefT
+{
+    uint32_t poolIndex;
+    uint32_t blockIndex;
+};
+
+/**
+ * @brief Sub-allocates buffers and images from large device memory blocks
+ *
+ * One pool of blocks exists per memory type and per resource kind (linear/optimal) so that
+ * bufferImageGranularity never has to be taken into account inside a block.
+ * Each block is managed as a buddy allocator. Host visible blocks are persistently mapped.
+ */
+class MemoryAllocator
+{
+  private:
+    struct BlockT
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void *mapped = nullptr;
+        VkDeviceSize usedSize = 0;
+
+        // free node offsets, indexed by buddy order
+        std::vector<std::set<VkDeviceSize>> freeLists;
+    };
+
+    struct PoolT
+    {
+        uint32_t memoryTypeIndex;
+        VkDeviceSize blockSize;
+        uint32_t maxOrder;
+
+        std::vector<std::unique_ptr<BlockT>> blocks;
+    };
+
+    static constexpr VkDeviceSize s_minNodeSize = 256;
+    static constexpr VkDeviceSize s_defaultBlockSize = 64 * 1024 * 1024;
+
+    VkDevice m_device;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties;
+
+    std::vector<PoolT> m_pools;
+
+    uint32_t m_deviceMemoryCount = 0;
+
+    // statistics
+    std::vector<MemoryHeapStatsT> m_heapStats;
+    std::array<MemoryCategoryStatsT, static_cast<size_t>(MemoryCategory::Count)> m_categoryStats;
+
+    mutable std::mutex m_mutex;
+
+    [[nodiscard]] VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void **mapped,
+                                                      const void *pNext = nullptr);
+    void freeDeviceMemory(VkDeviceMemory memory, void *mapped, VkDeviceSize size, uint32_t memoryTypeIndex);
+
+    [[nodiscard]] std::optional<VkDeviceSize> allocateNode(PoolT &pool, BlockT &block, uint32_t order);
+    void freeNode(PoolT &pool, BlockT &block, VkDeviceSize offset, uint32_t order);
+
+    void trackAllocation(const MemoryAllocationT &allocation);
+
+  public:
+    MemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties &memoryProperties);
+    ~MemoryAllocator();
+
+    MemoryAllocator(const MemoryAllocator &) = delete;
+    MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+    MemoryAllocator(MemoryAllocator &&) = delete;
+    MemoryAllocator &operator=(MemoryAllocator &&) = delete;
+
+    [[nodiscard]] MemoryRequirementsT getBufferMemoryRequirements(VkBuffer buffer) const;
+    [[nodiscard]] MemoryRequirementsT getImageMemoryRequirements(VkImage image) const;
+
+    /**
+     * @brief Allocate memory for a resource
+     *
+     * A dedicated VkDeviceMemory is allocated for the resource if it is requested, if the driver prefers or
+     * requires it, or if the resource is too large for a block.
+     *
+     * @param requirements memory requirements queried from the resource
+     * @param memoryTypeIndex memory type to allocate from
+     * @param bLinear true for buffers and linear images, false for optimal images
+     * @param bDedicated force a dedicated VkDeviceMemory for this resource
+     * @param category usage of the resource, for statistics only
+     * @return std::optional<MemoryAllocationT>
+     */
+    [[nodiscard]] std::optional<MemoryAllocationT> allocate(const MemoryRequirementsT &requirements,
+                                                            uint32_t memoryTypeIndex, bool bLinear,
+                                                            bool bDedicated = false,
+                                                            MemoryCategory category = MemoryCategory::Other);
+    void free(const MemoryAllocationT &allocation);
+
+    /**
+     * @brief Blocks worth emptying by moving their allocations to other blocks
+     *
+     * The least used block of each device only pool that has several blocks, as long as the other
+     * blocks of the pool have enough free space for its content.
+     */
+    [[nodiscard]] std::vector<MemoryBlockRefT> getDefragmentationSources() const;
+    /**
+     * @brief Allocate a node of the same size in another existing block of the same pool
+     *
+     * No block is created, the excluded blocks are skipped.
+     */
+    [[nodiscard]] std::optional<MemoryAllocationT> reallocate(const MemoryAllocationT &allocation,
+                                                              const std::vector<MemoryBlockRefT> &excludedBlocks);
+
+  public:
+    [[nodiscard]] inline VkMemoryPropertyFlags getMemoryPropertyFlags(uint32_t memoryTypeIndex) const
+    {
+        return m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    }
+
+    /**
+     * @brief Number of live VkDeviceMemory objects (blocks and dedicated allocations)
+     *
+     */
+    [[nodiscard]] uint32_t getDeviceMemoryCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_deviceMemoryCount;
+    }
+    /**
+     * @brief Per heap and per category statistics (without the budget, see Device::getMemoryStats)
+     *
+     */
+    [[nodiscard]] MemoryStatsT getStats() const;
+};
@@ -0,0 +1,82 @@
+#include <algorithm>
+
+#include "memory_defragmenter.hpp"
+
+MemoryDefragmenter::MemoryDefragmenter(MemoryAllocator *allocator) : m_allocator(allocator)
+{
+}
+
+void MemoryDefragmenter::registerResource(DefragmentableI *resource)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_resources.insert(resource);
+}
+
+void MemoryDefragmenter::unregisterResource(DefragmentableI *resource)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_resources.erase(resource);
+}
+
+VkDeviceSize MemoryDefragmenter::recordPass(VkCommandBuffer commandBuffer, VkDeviceSize byteBudget,
+                                            uint64_t completedFrameSerial)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (byteBudget == 0 || m_resources.empty())
+        return 0;
+
+    std::vector<MemoryBlockRefT> sources = m_allocator->getDefragmentationSources();
+    if (sources.empty())
+        return 0;
+
+    VkDeviceSize movedBytes = 0;
+    for (DefragmentableI *resource : m_resources)
+    {
+        const MemoryAllocationT &allocation = resource->getAllocation();
+
+        // dedicated allocations have nothing to gain, mapped pointers must stay valid
+        if (allocation.blockIndex == UINT32_MAX || allocation.mapped)
+            continue;
+        // the upload of a resource created during a frame in flight may not be complete yet
+        if (resource->getCreationFrameSerial() > completedFrameSerial)
+            continue;
+        if (movedBytes + allocation.size > byteBudget)
+            continue;
+
+        bool bInSource = std::any_of(sources.begin(), sources.end(), [&](const MemoryBlockRefT &ref) {
+            return ref.poolIndex == allocation.poolIndex && ref.blockIndex == allocation.blockIndex;
+        });
+        if (!bInSource)
+            continue;
+
+        std::optional<MemoryAllocationT> newAllocation = m_allocator->reallocate(allocation, sources);
+        if (!newAllocation.has_value())
+            continue;
+
+        VkDeviceSize size = allocation.size;
+        if (!resource->recordMove(commandBuffer, newAllocation.value()))
+        {
+            m_allocator->free(newAllocation.value());
+            continue;
+        }
+
+        movedBytes += size;
+        ++m_totalMoveCount;
+    }
+
+    if (movedBytes == 0)
+        return 0;
+
+    // the moved resources are read by the draws recorded after the pass
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+
+    m_totalMovedBytes += movedBytes;
+    return movedBytes;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_set>
+
+#include <vulkan/vulkan.h>
+
+#include "memory_allocator.hpp"
+
+/**
+ * @brief Resource whose memory can be moved by the MemoryDefragmenter
+ *
+ */
+class DefragmentableI
+{
+  public:
+    virtual ~DefragmentableI() = default;
+
+    [[nodiscard]] virtual const MemoryAllocationT &getAllocation() const = 0;
+    /**
+     * @brief Serial of the frame recorded when the resource was created (see DeletionQueue)
+     *
+     */
+    [[nodiscard]] virtual uint64_t getCreationFrameSerial() const = 0;
+
+    /**
+     * @brief Bind a new resource to the allocation, record the copy of the content and swap it in
+     *
+     * The old resource and its allocation are retired through the deletion queue.
+     *
+     * @return false if the resource could not be moved (the allocation is not used then)
+     */
+    [[nodiscard]] virtual bool recordMove(VkCommandBuffer commandBuffer, const MemoryAllocationT &allocation) = 0;
+};
+
+/**
+ * @brief Empties sparse device local memory blocks by moving their resources with GPU copies
+ *
+ * A pass is recorded at the start of a frame's command buffer so that the copies are ordered before
+ * the draws of the frame. The amount of data copied per pass is bounded by a byte budget.
+ * Emptied blocks are given back to the driver once the moved resources are retired.
+ */
+class MemoryDefragmenter
+{
+  private:
+    MemoryAllocator *m_allocator;
+
+    std::unordered_set<DefragmentableI *> m_resources;
+
+    VkDeviceSize m_totalMovedBytes = 0;
+    uint32_t m_totalMoveCount = 0;
+
+    mutable std::mutex m_mutex;
+
+  public:
+    MemoryDefragmenter(MemoryAllocator *allocator);
+
+    MemoryDefragmenter(const MemoryDefragmenter &) = delete;
+    MemoryDefragmenter &operator=(const MemoryDefragmenter &) = delete;
+    MemoryDefragmenter(MemoryDefragmenter &&) = delete;
+    MemoryDefragmenter &operator=(MemoryDefragmenter &&) = delete;
+
+    void registerResource(DefragmentableI *resource);
+    void unregisterResource(DefragmentableI *resource);
+
+    /**
+     * @brief Record the moves of one defragmentation pass
+     *
+     * @param commandBuffer command buffer submitted on the graphics queue, outside of a render pass
+     * @param byteBudget maximum number of bytes to copy
+     * @param completedFrameSerial last retired frame, newer resources may still be uploading
+     * @return the number of bytes moved
+     */
+    VkDeviceSize recordPass(VkCommandBuffer commandBuffer, VkDeviceSize byteBudget, uint64_t completedFrameSerial);
+
+  public:
+    [[nodiscard]] VkDeviceSize getTotalMovedBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_totalMovedBytes;
+    }
+    [[nodiscard]] uint32_t getTotalMoveCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_totalMoveCount;
+    }
+};
@@ -1,53 +1,60 @@
+#include <algorithm>
 #include <array>
 #include <cassert>
-#include <fstream>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <string>
 
+#include "byte_key.hpp"
 #include "device.hpp"
+#include "pipeline_registry.hpp"
 #include "render_pass.hpp"
 
+#include "engine/instance_data.hpp"
 #include "engine/uniform.hpp"
 #include "engine/vertex.hpp"
 
 #include "pipeline.hpp"
 
-VkShaderModule create_shader_module(VkDevice device, const std::vector<char> &code)
+void append_string(std::string &out, const std::string &value)
 {
-    VkShaderModuleCreateInfo createInfo = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = code.size(),
-        .pCode = reinterpret_cast<const uint32_t *>(code.data()),
-    };
-
-    VkShaderModule module;
-    VkResult res = vkCreateShaderModule(device, &createInfo, nullptr, &module);
-    if (res != VK_SUCCESS)
-        std::cerr << "Failed to create shader module : " << res << std::endl;
-
-    return module;
+    append_bytes(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
 }
-void destroy_shader_module(VkDevice device, VkShaderModule module)
+void append_shader_stage(std::string &out, const ShaderStageT &shaderStage)
 {
-    vkDestroyShaderModule(device, module, nullptr);
-}
+    append_bytes(out, shaderStage.stage);
+    append_string(out, shaderStage.filename);
+    append_string(out, shaderStage.entryPoint);
 
-bool read_binary_file(const std::string &filename, std::vector<char> &out)
-{
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-    if (!file.is_open())
+    append_bytes(out, static_cast<uint32_t>(shaderStage.specializationConstants.size()));
+    for (const auto &[constantID, value] : shaderStage.specializationConstants)
     {
-        std::cerr << "Failed to open file : " << filename << std::endl;
-        return false;
+        append_bytes(out, constantID);
+        append_string(out, value);
     }
+}
+void append_render_pass(std::string &out, const RenderPass *renderPass)
+{
+    VkRenderPass handle = renderPass ? renderPass->getHandle() : VK_NULL_HANDLE;
+    append_bytes(out, handle);
 
-    size_t fileSize = static_cast<size_t>(file.tellg());
-    out.resize(fileSize);
-
-    file.seekg(0);
-    file.read(out.data(), fileSize);
-
-    file.close();
+    // dynamic rendering pipelines are compatible with any pass of the same attachment formats
+    if (!renderPass || !renderPass->isDynamicRendering())
+        return;
+    append_bytes(out, static_cast<uint32_t>(renderPass->getColorAttachmentFormats().size()));
+    for (VkFormat format : renderPass->getColorAttachmentFormats())
+        append_bytes(out, format);
+    append_bytes(out, renderPass->getDepthAttachmentFormat());
+}
+bool read_string(const std::string &in, size_t &cursor, std::string &value)
+{
+    uint32_t size;
+    if (!read_bytes(in, cursor, size) || in.size() - cursor < size)
+        return false;
+    value.assign(in.data() + cursor, size);
+    cursor += size;
     return true;
 }
 
@@ -56,53 +63,52 @@ Pipeline::~Pipeline()
     if (!m_device.lock())
         return;
 
-    auto deviceHandle = m_device.lock()->getHandle();
+    auto devicePtr = m_device.lock();
+    devicePtr->getDeletionQueue()->push([deviceHandle = devicePtr->getHandle(), handle = m_handle.load()]() {
+        vkDestroyPipeline(deviceHandle, handle, nullptr);
+    });
+}
+
+void Pipeline::replaceHandle(VkPipeline handle)
+{
+    VkPipeline oldHandle = m_handle.exchange(handle);
 
-    vkDestroyPipelineLayout(deviceHandle, m_pipelineLayout, nullptr);
-    vkDestroyDescriptorSetLayout(deviceHandle, m_descriptorSetLayout, nullptr);
-    vkDestroyPipeline(deviceHandle, m_handle, nullptr);
+    // frames in flight may have bound the old handle
+    auto devicePtr = m_device.lock();
+    devicePtr->getDeletionQueue()->push([deviceHandle = devicePtr->getHandle(), oldHandle]() {
+        vkDestroyPipeline(deviceHandle, oldHandle, nullptr);
+    });
 }
 
 void PipelineBuilder::restart()
 {
-    m_modules.clear();
-    m_shaderStageCreateInfos.clear();
+    m_shaderStages.clear();
     m_dynamicStates.clear();
 
+    m_state = {};
+
     m_pushConstantRanges.clear();
+    m_uniformDescriptorPacks.clear();
+    m_bBindless = false;
 
     m_product = std::unique_ptr<Pipeline>(new Pipeline);
 }
 
 void PipelineBuilder::addVertexShaderStage(const char *shaderName, const char *entryPoint)
 {
-    std::vector<char> shader;
-    if (!read_binary_file("shaders/" + std::string(shaderName) + ".vert.spv", shader))
-        return;
-
-    m_modules.emplace_back(create_shader_module(m_device.lock()->getHandle(), shader));
-
-    m_shaderStageCreateInfos.emplace_back(VkPipelineShaderStageCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+    m_shaderStages.emplace_back(ShaderStageT{
         .stage = VK_SHADER_STAGE_VERTEX_BIT,
-        .module = m_modules[m_modules.size() - 1],
-        .pName = entryPoint,
+        .filename = "shaders/" + std::string(shaderName) + ".vert.spv",
+        .entryPoint = entryPoint,
     });
 }
 
 void PipelineBuilder::addFragmentShaderStage(const char *shaderName, const char *entryPoint)
 {
-    std::vector<char> shader;
-    if (!read_binary_file("shaders/" + std::string(shaderName) + ".frag.spv", shader))
-        return;
-
-    m_modules.emplace_back(create_shader_module(m_device.lock()->getHandle(), shader));
-
-    m_shaderStageCreateInfos.emplace_back(VkPipelineShaderStageCreateInfo{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+    m_shaderStages.emplace_back(ShaderStageT{
         .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-        .module = m_modules[m_modules.size() - 1],
-        .pName = entryPoint,
+        .filename = "shaders/" + std::string(shaderName) + ".frag.spv",
+        .entryPoint = entryPoint,
     });
 }
 
@@ -113,36 +119,469 @@ void PipelineBuilder::addDynamicState(VkDynamicState state)
 
 void PipelineBuilder::setDrawTopology(VkPrimitiveTopology topology, bool bPrimitiveRestartEnable)
 {
-    m_topology = topology;
-    m_bPrimitiveRestartEnable = bPrimitiveRestartEnable;
+    m_state.topology = topology;
+    m_state.primitiveRestartEnable = static_cast<VkBool32>(bPrimitiveRestartEnable);
 }
 
 void PipelineBuilder::setExtent(VkExtent2D extent)
 {
-    m_extent = extent;
+    m_state.extent = extent;
     m_product->m_extent = extent;
 }
 
-std::unique_ptr<Pipeline> PipelineBuilder::build()
+std::string PipelineBuilder::getDescription() const
+{
+    // the viewport is dynamic, the extent only matters to the pipeline object
+    PipelineStateT state = getBakedState();
+    state.extent = {};
+
+    std::string description;
+    append_bytes(description, state);
+
+    append_bytes(description, static_cast<uint32_t>(m_shaderStages.size()));
+    for (const ShaderStageT &shaderStage : m_shaderStages)
+        append_shader_stage(description, shaderStage);
+
+    append_bytes(description, static_cast<uint32_t>(m_dynamicStates.size()));
+    for (VkDynamicState dynamicState : m_dynamicStates)
+        append_bytes(description, dynamicState);
+
+    append_bytes(description, static_cast<uint32_t>(m_pushConstantRanges.size()));
+    for (const VkPushConstantRange &range : m_pushConstantRanges)
+    {
+        append_bytes(description, range.stageFlags);
+        append_bytes(description, range.offset);
+        append_bytes(description, range.size);
+    }
+
+    append_bytes(description, static_cast<uint32_t>(m_uniformDescriptorPacks.size()));
+    for (const std::shared_ptr<UniformDescriptor> &uniformDescriptorPack : m_uniformDescriptorPacks)
+    {
+        const std::vector<VkDescriptorSetLayoutBinding> &layoutBindings = uniformDescriptorPack->getSetLayoutBindings();
+        append_bytes(description, static_cast<uint32_t>(layoutBindings.size()));
+        for (const VkDescriptorSetLayoutBinding &binding : layoutBindings)
+        {
+            append_bytes(description, binding.binding);
+            append_bytes(description, binding.descriptorType);
+            append_bytes(description, binding.descriptorCount);
+            append_bytes(description, binding.stageFlags);
+        }
+    }
+
+    append_bytes(description, static_cast<VkBool32>(m_bBindless));
+
+    return description;
+}
+
+bool PipelineBuilder::setDescription(const std::string &description)
+{
+    size_t cursor = 0;
+    bool bValid = read_bytes(description, cursor, m_state);
+
+    uint32_t shaderStageCount = 0;
+    bValid = bValid && read_bytes(description, cursor, shaderStageCount) &&
+             shaderStageCount <= description.size() - cursor;
+    m_shaderStages.resize(bValid ? shaderStageCount : 0);
+    for (ShaderStageT &shaderStage : m_shaderStages)
+    {
+        bValid = bValid && read_bytes(description, cursor, shaderStage.stage) &&
+                 read_string(description, cursor, shaderStage.filename) &&
+                 read_string(description, cursor, shaderStage.entryPoint);
+
+        uint32_t constantCount = 0;
+        bValid = bValid && read_bytes(description, cursor, constantCount);
+        shaderStage.specializationConstants.clear();
+        for (uint32_t i = 0; bValid && i < constantCount; ++i)
+        {
+            uint32_t constantID;
+            std::string value;
+            bValid = read_bytes(description, cursor, constantID) && read_string(description, cursor, value);
+            shaderStage.specializationConstants[constantID] = value;
+        }
+    }
+
+    uint32_t dynamicStateCount = 0;
+    bValid = bValid && read_bytes(description, cursor, dynamicStateCount) &&
+             dynamicStateCount <= description.size() - cursor;
+    m_dynamicStates.resize(bValid ? dynamicStateCount : 0);
+    for (VkDynamicState &dynamicState : m_dynamicStates)
+        bValid = bValid && read_bytes(description, cursor, dynamicState);
+
+    uint32_t pushConstantRangeCount = 0;
+    bValid = bValid && read_bytes(description, cursor, pushConstantRangeCount) &&
+             pushConstantRangeCount <= description.size() - cursor;
+    m_pushConstantRanges.resize(bValid ? pushConstantRangeCount : 0);
+    for (VkPushConstantRange &range : m_pushConstantRanges)
+    {
+        bValid = bValid && read_bytes(description, cursor, range.stageFlags) &&
+                 read_bytes(description, cursor, range.offset) && read_bytes(description, cursor, range.size);
+    }
+
+    uint32_t setCount = 0;
+    bValid = bValid && read_bytes(description, cursor, setCount) && setCount <= description.size() - cursor;
+    std::vector<std::shared_ptr<UniformDescriptor>> uniformDescriptorPacks;
+    for (uint32_t i = 0; bValid && i < setCount; ++i)
+    {
+        uint32_t layoutBindingCount = 0;
+        bValid = read_bytes(description, cursor, layoutBindingCount) &&
+                 layoutBindingCount <= description.size() - cursor;
+        UniformDescriptorBuilder udb;
+        for (uint32_t j = 0; bValid && j < layoutBindingCount; ++j)
+        {
+            VkDescriptorSetLayoutBinding binding = {};
+            bValid = read_bytes(description, cursor, binding.binding) &&
+                     read_bytes(description, cursor, binding.descriptorType) &&
+                     read_bytes(description, cursor, binding.descriptorCount) &&
+                     read_bytes(description, cursor, binding.stageFlags);
+            udb.addSetLayoutBinding(binding);
+        }
+        uniformDescriptorPacks.emplace_back(udb.build());
+    }
+
+    VkBool32 bBindless = VK_FALSE;
+    bValid = bValid && read_bytes(description, cursor, bBindless);
+
+    if (!bValid || cursor != description.size())
+    {
+        std::cerr << "Failed to read pipeline description" << std::endl;
+        return false;
+    }
+
+    m_uniformDescriptorPacks = uniformDescriptorPacks;
+    m_bBindless = bBindless == VK_TRUE;
+    m_pSampleMask = nullptr;
+    m_product->m_extent = m_state.extent;
+    return true;
+}
+
+std::string PipelineBuilder::getKey() const
+{
+    std::string key = getDescription();
+    append_bytes(key, m_state.extent);
+
+    // one mask word per 32 samples
+    append_bytes(key, m_pSampleMask != nullptr);
+    for (uint32_t i = 0; m_pSampleMask && i < (m_state.rasterizationSamples + 31) / 32; ++i)
+        append_bytes(key, m_pSampleMask[i]);
+
+    append_render_pass(key, m_renderPass);
+
+    return key;
+}
+
+PipelineStateT PipelineBuilder::getBakedState() const
+{
+    PipelineStateT state = m_state;
+
+    // dynamic fields get the same value in every pipeline so that they share a single one
+    auto devicePtr = m_device.lock();
+    if (!devicePtr)
+        return state;
+    if (devicePtr->isExtendedDynamicStateEnabled())
+    {
+        // only the topology class is baked
+        switch (state.topology)
+        {
+        case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+            break;
+        case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+        case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+            state.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+            break;
+        case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+            break;
+        default:
+            state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+            break;
+        }
+        state.cullMode = VK_CULL_MODE_NONE;
+        state.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        state.depthTestEnable = VK_FALSE;
+        state.depthWriteEnable = VK_FALSE;
+        state.depthCompareOp = VK_COMPARE_OP_NEVER;
+    }
+    if (devicePtr->isExtendedDynamicState2Enabled())
+    {
+        state.primitiveRestartEnable = VK_FALSE;
+        state.depthBiasEnable = VK_FALSE;
+        state.rasterizerDiscardEnable = VK_FALSE;
+    }
+    if (devicePtr->isExtendedDynamicState3Enabled())
+    {
+        state.depthClampEnable = VK_FALSE;
+        state.polygonMode = VK_POLYGON_MODE_FILL;
+        state.blendEnable = VK_FALSE;
+        state.colorWriteMask = 0;
+    }
+    return state;
+}
+
+std::vector<VkDynamicState> PipelineBuilder::getBakedDynamicStates() const
+{
+    std::vector<VkDynamicState> dynamicStates = m_dynamicStates;
+
+    auto devicePtr = m_device.lock();
+    if (!devicePtr)
+        return dynamicStates;
+    if (devicePtr->isExtendedDynamicStateEnabled())
+    {
+        dynamicStates.insert(dynamicStates.end(),
+                             {VK_DYNAMIC_STATE_CULL_MODE_EXT, VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+                              VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT, VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+                              VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT, VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT});
+    }
+    if (devicePtr->isExtendedDynamicState2Enabled())
+    {
+        dynamicStates.insert(dynamicStates.end(),
+                             {VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT, VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT,
+                              VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE_EXT});
+    }
+    if (devicePtr->isExtendedDynamicState3Enabled())
+    {
+        dynamicStates.insert(dynamicStates.end(),
+                             {VK_DYNAMIC_STATE_DEPTH_CLAMP_ENABLE_EXT, VK_DYNAMIC_STATE_POLYGON_MODE_EXT,
+                              VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT, VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT});
+    }
+    return dynamicStates;
+}
+
+VkPipelineRenderingCreateInfoKHR PipelineBuilder::getRenderingCreateInfo() const
+{
+    const std::vector<VkFormat> &colorFormats = m_renderPass->getColorAttachmentFormats();
+    return VkPipelineRenderingCreateInfoKHR{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+        .colorAttachmentCount = static_cast<uint32_t>(colorFormats.size()),
+        .pColorAttachmentFormats = colorFormats.data(),
+        .depthAttachmentFormat = m_renderPass->getDepthAttachmentFormat(),
+        .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+    };
+}
+
+DynamicStateT PipelineBuilder::getDynamicState() const
+{
+    return DynamicStateT{
+        .cullMode = m_state.cullMode,
+        .frontFace = m_state.frontFace,
+        .topology = m_state.topology,
+        .depthTestEnable = m_state.depthTestEnable,
+        .depthWriteEnable = m_state.depthWriteEnable,
+        .depthCompareOp = m_state.depthCompareOp,
+        .primitiveRestartEnable = m_state.primitiveRestartEnable,
+        .depthBiasEnable = m_state.depthBiasEnable,
+        .rasterizerDiscardEnable = m_state.rasterizerDiscardEnable,
+        .depthClampEnable = m_state.depthClampEnable,
+        .polygonMode = m_state.polygonMode,
+        .colorBlendEnable = m_state.blendEnable,
+        .colorWriteMask = m_state.colorWriteMask,
+    };
+}
+
+std::string PipelineBuilder::getLibraryKey(VkGraphicsPipelineLibraryFlagsEXT part, VkPipelineLayout layout) const
+{
+    std::string key;
+    append_bytes(key, part);
+
+    std::vector<VkDynamicState> dynamicStates = getBakedDynamicStates();
+    append_bytes(key, static_cast<uint32_t>(dynamicStates.size()));
+    for (VkDynamicState dynamicState : dynamicStates)
+        append_bytes(key, dynamicState);
+
+    PipelineStateT state = getBakedState();
+
+    auto appendMultisampleState = [&]() {
+        append_bytes(key, state.rasterizationSamples);
+        append_bytes(key, state.sampleShadingEnable);
+        append_bytes(key, state.minSampleShading);
+        append_bytes(key, state.alphaToCoverageEnable);
+        append_bytes(key, state.alphaToOneEnable);
+        append_bytes(key, m_pSampleMask != nullptr);
+        for (uint32_t i = 0; m_pSampleMask && i < (state.rasterizationSamples + 31) / 32; ++i)
+            append_bytes(key, m_pSampleMask[i]);
+    };
+
+    switch (part)
+    {
+    case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+        append_bytes(key, state.topology);
+        append_bytes(key, state.primitiveRestartEnable);
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+        for (const ShaderStageT &shaderStage : m_shaderStages)
+        {
+            if (shaderStage.stage != VK_SHADER_STAGE_FRAGMENT_BIT)
+                append_shader_stage(key, shaderStage);
+        }
+        // rasterizer fields, from depthClampEnable to lineWidth
+        key.append(reinterpret_cast<const char *>(&state.depthClampEnable),
+                   reinterpret_cast<const char *>(&state.lineWidth + 1));
+        append_bytes(key, layout);
+        append_render_pass(key, m_renderPass);
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+        for (const ShaderStageT &shaderStage : m_shaderStages)
+        {
+            if (shaderStage.stage == VK_SHADER_STAGE_FRAGMENT_BIT)
+                append_shader_stage(key, shaderStage);
+        }
+        // depth test fields, from depthTestEnable to maxDepthBounds
+        key.append(reinterpret_cast<const char *>(&state.depthTestEnable),
+                   reinterpret_cast<const char *>(&state.maxDepthBounds + 1));
+        appendMultisampleState();
+        append_bytes(key, layout);
+        append_render_pass(key, m_renderPass);
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+        // color blending fields, from blendEnable to blendConstants
+        key.append(reinterpret_cast<const char *>(&state.blendEnable),
+                   reinterpret_cast<const char *>(&state.blendConstants + 1));
+        appendMultisampleState();
+        append_render_pass(key, m_renderPass);
+        break;
+    }
+
+    return key;
+}
+
+bool PipelineBuilder::createLibraries(const VkGraphicsPipelineCreateInfo &pipelineCreateInfo,
+                                      std::array<VkPipeline, 4> &libraries) const
+{
+    auto devicePtr = m_device.lock();
+    PipelineRegistry *registry = devicePtr->getPipelineRegistry();
+    VkPipelineCache pipelineCache = devicePtr->getPipelineCache()->getHandle();
+
+    constexpr std::array<VkGraphicsPipelineLibraryFlagsEXT, 4> parts = {
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+    };
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        libraries[i] = registry->getLibrary(getLibraryKey(parts[i], pipelineCreateInfo.layout), [&]() -> VkPipeline {
+            // each part only reads the state of its subset, but the shader stages must match the subset
+            std::vector<VkPipelineShaderStageCreateInfo> stages;
+            for (uint32_t j = 0; j < pipelineCreateInfo.stageCount; ++j)
+            {
+                bool bFragmentStage = pipelineCreateInfo.pStages[j].stage == VK_SHADER_STAGE_FRAGMENT_BIT;
+                if ((parts[i] == VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT && !bFragmentStage) ||
+                    (parts[i] == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT && bFragmentStage))
+                    stages.emplace_back(pipelineCreateInfo.pStages[j]);
+            }
+
+            VkPipelineRenderingCreateInfoKHR renderingCreateInfo = getRenderingCreateInfo();
+            VkGraphicsPipelineLibraryCreateInfoEXT libraryCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+                .pNext = m_renderPass->isDynamicRendering() ? &renderingCreateInfo : nullptr,
+                .flags = parts[i],
+            };
+            VkGraphicsPipelineCreateInfo createInfo = pipelineCreateInfo;
+            createInfo.pNext = &libraryCreateInfo;
+            createInfo.flags |=
+                VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+            createInfo.stageCount = static_cast<uint32_t>(stages.size());
+            createInfo.pStages = stages.data();
+
+            VkPipeline library;
+            VkResult res =
+                vkCreateGraphicsPipelines(devicePtr->getHandle(), pipelineCache, 1, &createInfo, nullptr, &library);
+            if (res != VK_SUCCESS)
+            {
+                std::cerr << "Failed to create graphics pipeline library : " << res << std::endl;
+                return VK_NULL_HANDLE;
+            }
+            return library;
+        });
+        if (libraries[i] == VK_NULL_HANDLE)
+            return false;
+    }
+    return true;
+}
+
+std::shared_ptr<Pipeline> PipelineBuilder::build()
 {
     assert(m_device.lock());
     assert(m_renderPass);
 
-    const VkDevice &deviceHandle = m_device.lock()->getHandle();
+    auto devicePtr = m_device.lock();
+    const VkDevice &deviceHandle = devicePtr->getHandle();
+
+    PipelineRegistry *registry = devicePtr->getPipelineRegistry();
+    std::string key = getKey();
+    if (std::shared_ptr<Pipeline> pipeline = registry->findPipeline(key))
+        return pipeline;
+
+    // shader stages, the modules are shared by every pipeline
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStageCreateInfos;
+    // specialization infos are pointed to by the stage create infos
+    std::vector<VkSpecializationInfo> specializationInfos(m_shaderStages.size());
+    std::vector<std::vector<VkSpecializationMapEntry>> specializationEntries(m_shaderStages.size());
+    std::vector<std::string> specializationData(m_shaderStages.size());
+    for (size_t i = 0; i < m_shaderStages.size(); ++i)
+    {
+        const ShaderStageT &shaderStage = m_shaderStages[i];
+
+        VkShaderModule module = registry->getShaderModule(shaderStage.filename);
+        if (module == VK_NULL_HANDLE)
+            return nullptr;
+
+        for (const auto &[constantID, value] : shaderStage.specializationConstants)
+        {
+            specializationEntries[i].emplace_back(VkSpecializationMapEntry{
+                .constantID = constantID,
+                .offset = static_cast<uint32_t>(specializationData[i].size()),
+                .size = value.size(),
+            });
+            specializationData[i].append(value);
+        }
+        specializationInfos[i] = VkSpecializationInfo{
+            .mapEntryCount = static_cast<uint32_t>(specializationEntries[i].size()),
+            .pMapEntries = specializationEntries[i].data(),
+            .dataSize = specializationData[i].size(),
+            .pData = specializationData[i].data(),
+        };
+
+        shaderStageCreateInfos.emplace_back(VkPipelineShaderStageCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = shaderStage.stage,
+            .module = module,
+            .pName = shaderStage.entryPoint.c_str(),
+            .pSpecializationInfo = specializationEntries[i].empty() ? nullptr : &specializationInfos[i],
+        });
+    }
+
+    // the state set per draw is not baked in
+    PipelineStateT state = getBakedState();
+    std::vector<VkDynamicState> dynamicStates = getBakedDynamicStates();
+    m_product->m_bDynamicState = devicePtr->isExtendedDynamicStateEnabled() ||
+                                 devicePtr->isExtendedDynamicState2Enabled() ||
+                                 devicePtr->isExtendedDynamicState3Enabled();
+    auto isDynamic = [&](VkDynamicState dynamicState) {
+        return std::find(dynamicStates.begin(), dynamicStates.end(), dynamicState) != dynamicStates.end();
+    };
+    m_product->m_bDynamicViewport = isDynamic(VK_DYNAMIC_STATE_VIEWPORT) && isDynamic(VK_DYNAMIC_STATE_SCISSOR);
 
     VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-        .dynamicStateCount = static_cast<uint32_t>(m_dynamicStates.size()),
-        .pDynamicStates = m_dynamicStates.data(),
+        .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+        .pDynamicStates = dynamicStates.data(),
     };
 
-    // vertex buffer (enabling the binding for our Vertex structure)
-    auto binding = Vertex::get_vertex_input_binding_description();
-    auto attribs = Vertex::get_vertex_input_attribute_description();
+    // vertex buffer (enabling the binding for our Vertex structure) and instance buffer (see InstanceData)
+    std::array<VkVertexInputBindingDescription, 2> bindings = {
+        Vertex::get_vertex_input_binding_description(),
+        InstanceData::get_instance_input_binding_description(),
+    };
+    std::vector<VkVertexInputAttributeDescription> attribs;
+    for (const VkVertexInputAttributeDescription &attrib : Vertex::get_vertex_input_attribute_description())
+        attribs.emplace_back(attrib);
+    for (const VkVertexInputAttributeDescription &attrib : InstanceData::get_instance_input_attribute_description())
+        attribs.emplace_back(attrib);
     VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 1,
-        .pVertexBindingDescriptions = &binding,
+        .vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size()),
+        .pVertexBindingDescriptions = bindings.data(),
         .vertexAttributeDescriptionCount = static_cast<uint32_t>(attribs.size()),
         .pVertexAttributeDescriptions = attribs.data(),
     };
@@ -150,23 +589,23 @@ std::unique_ptr<Pipeline> PipelineBuilder::build()
     // draw mode
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = m_topology,
-        .primitiveRestartEnable = static_cast<VkBool32>(m_bPrimitiveRestartEnable),
+        .topology = state.topology,
+        .primitiveRestartEnable = state.primitiveRestartEnable,
     };
 
     // viewport
     VkViewport viewport = {
         .x = 0.f,
         .y = 0.f,
-        .width = static_cast<float>(m_extent.width),
-        .height = static_cast<float>(m_extent.height),
+        .width = static_cast<float>(state.extent.width),
+        .height = static_cast<float>(state.extent.height),
         .minDepth = 0.f,
         .maxDepth = 1.f,
     };
 
     VkRect2D scissor = {
         .offset = {0, 0},
-        .extent = m_extent,
+        .extent = state.extent,
     };
 
     VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {
@@ -178,105 +617,106 @@ std::unique_ptr<Pipeline> PipelineBuilder::build()
     // rasterizer
     VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-        .depthClampEnable = m_depthClampEnable,
-        .rasterizerDiscardEnable = m_rasterizerDiscardEnable,
-        .polygonMode = m_polygonMode,
-        .cullMode = m_cullMode,
-        .frontFace = m_frontFace,
-        .depthBiasEnable = m_depthBiasEnable,
-        .depthBiasConstantFactor = m_depthBiasConstantFactor,
-        .depthBiasClamp = m_depthBiasClamp,
-        .depthBiasSlopeFactor = m_depthBiasSlopeFactor,
-        .lineWidth = m_lineWidth,
+        .depthClampEnable = state.depthClampEnable,
+        .rasterizerDiscardEnable = state.rasterizerDiscardEnable,
+        .polygonMode = state.polygonMode,
+        .cullMode = state.cullMode,
+        .frontFace = state.frontFace,
+        .depthBiasEnable = state.depthBiasEnable,
+        .depthBiasConstantFactor = state.depthBiasConstantFactor,
+        .depthBiasClamp = state.depthBiasClamp,
+        .depthBiasSlopeFactor = state.depthBiasSlopeFactor,
+        .lineWidth = state.lineWidth,
     };
 
     // multisampling, anti-aliasing
     VkPipelineMultisampleStateCreateInfo multisamplingCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .rasterizationSamples = m_rasterizationSamples,
-        .sampleShadingEnable = m_sampleShadingEnable,
-        .minSampleShading = m_minSampleShading,
+        .rasterizationSamples = state.rasterizationSamples,
+        .sampleShadingEnable = state.sampleShadingEnable,
+        .minSampleShading = state.minSampleShading,
         .pSampleMask = m_pSampleMask,
-        .alphaToCoverageEnable = m_alphaToCoverageEnable,
-        .alphaToOneEnable = m_alphaToOneEnable,
+        .alphaToCoverageEnable = state.alphaToCoverageEnable,
+        .alphaToOneEnable = state.alphaToOneEnable,
     };
 
     VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-        .depthTestEnable = m_depthTestEnable,
-        .depthWriteEnable = m_depthWriteEnable,
-        .depthCompareOp = m_depthCompareOp,
-        .depthBoundsTestEnable = m_depthBoundsTestEnable,
-        .stencilTestEnable = m_stencilTestEnable,
-        .front = m_front,
-        .back = m_back,
-        .minDepthBounds = m_minDepthBounds,
-        .maxDepthBounds = m_maxDepthBounds,
+        .depthTestEnable = state.depthTestEnable,
+        .depthWriteEnable = state.depthWriteEnable,
+        .depthCompareOp = state.depthCompareOp,
+        .depthBoundsTestEnable = state.depthBoundsTestEnable,
+        .stencilTestEnable = state.stencilTestEnable,
+        .front = state.front,
+        .back = state.back,
+        .minDepthBounds = state.minDepthBounds,
+        .maxDepthBounds = state.maxDepthBounds,
     };
 
     // color blending
     VkPipelineColorBlendAttachmentState colorBlendAttachment = {
-        .blendEnable = VK_TRUE,
-        .srcColorBlendFactor = m_srcColorBlendFactor,
-        .dstColorBlendFactor = m_dstColorBlendFactor,
-        .colorBlendOp = m_colorBlendOp,
-        .srcAlphaBlendFactor = m_srcAlphaBlendFactor,
-        .dstAlphaBlendFactor = m_dstAlphaBlendFactor,
-        .alphaBlendOp = m_alphaBlendOp,
-        .colorWriteMask = m_colorWriteMask,
+        .blendEnable = state.blendEnable,
+        .srcColorBlendFactor = state.srcColorBlendFactor,
+        .dstColorBlendFactor = state.dstColorBlendFactor,
+        .colorBlendOp = state.colorBlendOp,
+        .srcAlphaBlendFactor = state.srcAlphaBlendFactor,
+        .dstAlphaBlendFactor = state.dstAlphaBlendFactor,
+        .alphaBlendOp = state.alphaBlendOp,
+        .colorWriteMask = state.colorWriteMask,
     };
 
     VkPipelineColorBlendStateCreateInfo colorBlendCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-        .logicOpEnable = m_logicOpEnable,
-        .logicOp = m_logicOp,
+        .logicOpEnable = state.logicOpEnable,
+        .logicOp = state.logicOp,
         .attachmentCount = 1,
         .pAttachments = &colorBlendAttachment,
         .blendConstants =
             {
-                m_blendConstants[0],
-                m_blendConstants[1],
-                m_blendConstants[2],
-                m_blendConstants[3],
+                state.blendConstants[0],
+                state.blendConstants[1],
+                state.blendConstants[2],
+                state.blendConstants[3],
             },
     };
 
     // descriptor set layout
 
-    std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
-    if (m_uniformDescriptorPack)
-        layoutBindings = m_uniformDescriptorPack->getSetLayoutBindings();
-    VkDescriptorSetLayoutCreateInfo createInfo = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .bindingCount = static_cast<uint32_t>(layoutBindings.size()),
-        .pBindings = layoutBindings.data(),
-    };
-    VkResult res = vkCreateDescriptorSetLayout(deviceHandle, &createInfo, nullptr, &m_product->m_descriptorSetLayout);
-    if (res != VK_SUCCESS)
+    std::vector<VkDescriptorSetLayout> &setLayouts = m_product->m_descriptorSetLayouts;
+    setLayouts.clear();
+    for (const std::shared_ptr<UniformDescriptor> &uniformDescriptorPack : m_uniformDescriptorPacks)
     {
-        std::cerr << "Failed to create descriptor set layout : " << res << std::endl;
-        return nullptr;
+        VkDescriptorSetLayout setLayout =
+            registry->getDescriptorSetLayout(uniformDescriptorPack->getSetLayoutBindings());
+        if (setLayout == VK_NULL_HANDLE)
+            return nullptr;
+        setLayouts.emplace_back(setLayout);
     }
-    std::vector<VkDescriptorSetLayout> setLayouts = {m_product->m_descriptorSetLayout};
-    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
-        .pSetLayouts = setLayouts.data(),
-        .pushConstantRangeCount = static_cast<uint32_t>(m_pushConstantRanges.size()),
-        .pPushConstantRanges = m_pushConstantRanges.data(),
-    };
-    res = vkCreatePipelineLayout(deviceHandle, &pipelineLayoutCreateInfo, nullptr, &m_product->m_pipelineLayout);
-    if (res != VK_SUCCESS)
+    if (m_bBindless)
     {
-        std::cerr << "Failed to create pipeline layout : " << res << std::endl;
-        return nullptr;
+        if (!devicePtr->getBindlessTable())
+        {
+            std::cerr << "Failed to create bindless pipeline layout : the device has no bindless table" << std::endl;
+            return nullptr;
+        }
+        if (setLayouts.size() != BindlessTable::setIndex)
+        {
+            std::cerr << "Failed to create bindless pipeline layout : the table must be set " << BindlessTable::setIndex
+                      << ", not set " << setLayouts.size() << std::endl;
+            return nullptr;
+        }
+        setLayouts.emplace_back(devicePtr->getBindlessTable()->getSetLayout());
+        m_product->m_bBindless = true;
     }
+    m_product->m_pipelineLayout = registry->getPipelineLayout(setLayouts, m_pushConstantRanges);
+    if (m_product->m_pipelineLayout == VK_NULL_HANDLE)
+        return nullptr;
 
     VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
         // shader stage
-        .stageCount = static_cast<uint32_t>(m_shaderStageCreateInfos.size()),
-        .pStages = m_shaderStageCreateInfos.data(),
+        .stageCount = static_cast<uint32_t>(shaderStageCreateInfos.size()),
+        .pStages = shaderStageCreateInfos.data(),
         // fixed function stage
         .pVertexInputState = &vertexInputCreateInfo,
         .pInputAssemblyState = &inputAssemblyCreateInfo,
@@ -295,22 +735,138 @@ std::unique_ptr<Pipeline> PipelineBuilder::build()
         .basePipelineIndex = -1,
     };
 
-    res =
-        vkCreateGraphicsPipelines(deviceHandle, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_product->m_handle);
+    // creation feedback tells whether the pipeline came from the cache
+    VkPipelineCreationFeedbackEXT creationFeedback = {};
+    std::vector<VkPipelineCreationFeedbackEXT> stageCreationFeedbacks(shaderStageCreateInfos.size());
+    VkPipelineCreationFeedbackCreateInfoEXT creationFeedbackCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+        .pPipelineCreationFeedback = &creationFeedback,
+        .pipelineStageCreationFeedbackCount = static_cast<uint32_t>(stageCreationFeedbacks.size()),
+        .pPipelineStageCreationFeedbacks = stageCreationFeedbacks.data(),
+    };
+    if (devicePtr->isPipelineCreationFeedbackEnabled())
+        pipelineCreateInfo.pNext = &creationFeedbackCreateInfo;
+
+    // without render pass, the attachment formats are given to the pipeline
+    VkPipelineRenderingCreateInfoKHR renderingCreateInfo = getRenderingCreateInfo();
+    if (m_renderPass->isDynamicRendering())
+    {
+        renderingCreateInfo.pNext = pipelineCreateInfo.pNext;
+        pipelineCreateInfo.pNext = &renderingCreateInfo;
+    }
+
+    PipelineCache *pipelineCache = devicePtr->getPipelineCache();
+    auto creationStart = std::chrono::steady_clock::now();
+    VkPipeline handle;
+    VkResult res;
+    std::array<VkPipeline, 4> libraries;
+    bool bLinked = devicePtr->isGraphicsPipelineLibraryEnabled();
+    if (bLinked)
+    {
+        // fast link of the separately cached parts
+        if (!createLibraries(pipelineCreateInfo, libraries))
+            return nullptr;
+
+        creationFeedbackCreateInfo.pipelineStageCreationFeedbackCount = 0;
+        VkPipelineLibraryCreateInfoKHR libraryCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+            .pNext = devicePtr->isPipelineCreationFeedbackEnabled() ? &creationFeedbackCreateInfo : nullptr,
+            .libraryCount = static_cast<uint32_t>(libraries.size()),
+            .pLibraries = libraries.data(),
+        };
+        VkGraphicsPipelineCreateInfo linkCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .pNext = &libraryCreateInfo,
+            .layout = m_product->m_pipelineLayout,
+        };
+        res = vkCreateGraphicsPipelines(deviceHandle, pipelineCache->getHandle(), 1, &linkCreateInfo, nullptr, &handle);
+    }
+    else
+    {
+        res = vkCreateGraphicsPipelines(deviceHandle, pipelineCache->getHandle(), 1, &pipelineCreateInfo, nullptr,
+                                        &handle);
+    }
     if (res != VK_SUCCESS)
     {
         std::cerr << "Failed to create graphics pipeline : " << res << std::endl;
         return nullptr;
     }
+    m_product->m_handle = handle;
+    pipelineCache->recordCreation(creationFeedback, std::chrono::steady_clock::now() - creationStart);
+
+    // the sample mask is only referenced by the builder, such a description cannot be replayed
+    if (!m_pSampleMask)
+        devicePtr->getPipelineManifest()->record(getDescription());
+
+    std::shared_ptr<Pipeline> product = std::move(m_product);
+    std::shared_ptr<Pipeline> result = registry->registerPipeline(key, product);
+    if (!bLinked || result != product)
+        return result;
+
+    // the fast linked pipeline is replaced by a link time optimized one compiled in the background
+    key.append("optimized");
+    (void)devicePtr->getPipelineCompiler()->submit(
+        key, [device = m_device, weakPipeline = std::weak_ptr<Pipeline>(product), libraries,
+              layout = product->m_pipelineLayout]() -> std::shared_ptr<Pipeline> {
+            auto devicePtr = device.lock();
+            auto pipeline = weakPipeline.lock();
+            if (!devicePtr || !pipeline)
+                return nullptr;
+
+            VkPipelineLibraryCreateInfoKHR libraryCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+                .libraryCount = static_cast<uint32_t>(libraries.size()),
+                .pLibraries = libraries.data(),
+            };
+            VkGraphicsPipelineCreateInfo createInfo = {
+                .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                .pNext = &libraryCreateInfo,
+                .flags = VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT,
+                .layout = layout,
+            };
+            VkPipeline handle;
+            VkResult res = vkCreateGraphicsPipelines(devicePtr->getHandle(), devicePtr->getPipelineCache()->getHandle(),
+                                                     1, &createInfo, nullptr, &handle);
+            if (res != VK_SUCCESS)
+            {
+                std::cerr << "Failed to create link time optimized graphics pipeline : " << res << std::endl;
+                return pipeline;
+            }
+            pipeline->replaceHandle(handle);
+            return pipeline;
+        });
 
-    auto result = std::move(m_product);
+    return result;
+}
 
-    for (int i = 0; i < m_modules.size(); ++i)
+std::shared_future<std::shared_ptr<Pipeline>> PipelineBuilder::buildAsync()
+{
+    assert(m_device.lock());
+    assert(m_renderPass);
+
+    auto devicePtr = m_device.lock();
+
+    // already compiled, or not replayable from a description
+    std::string key = getKey();
+    std::shared_ptr<Pipeline> pipeline = devicePtr->getPipelineRegistry()->findPipeline(key);
+    if (pipeline || m_pSampleMask)
     {
-        destroy_shader_module(m_device.lock()->getHandle(), m_modules[i]);
+        std::promise<std::shared_ptr<Pipeline>> promise;
+        promise.set_value(pipeline ? pipeline : build());
+        return promise.get_future().share();
     }
 
-    return result;
+    return devicePtr->getPipelineCompiler()->submit(
+        key, [device = m_device, renderPass = m_renderPass, extent = m_state.extent,
+              description = getDescription()]() -> std::shared_ptr<Pipeline> {
+            PipelineBuilder builder;
+            if (!device.lock() || !builder.setDescription(description))
+                return nullptr;
+            builder.setDevice(device);
+            builder.setRenderPass(renderPass);
+            builder.setExtent(extent);
+            return builder.build();
+        });
 }
 
 void PipelineDirector::createColorDepthRasterizerBuilder(PipelineBuilder &builder)
@@ -362,18 +918,3 @@ void PipelineDirector::createColorDepthRasterizerBuilder(PipelineBuilder &builde
     builder.setLogicOp(VK_LOGIC_OP_COPY);
     builder.setBlendConstants(0.f, 0.f, 0.f, 0.f);
 }
-
-void Pipeline::recordBind(VkCommandBuffer &commandBuffer, uint32_t imageIndex)
-{
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_handle);
-
-    VkViewport viewport = {.x = 0.f,
-                           .y = 0.f,
-                           .width = static_cast<float>(m_extent.width),
-                           .height = static_cast<float>(m_extent.height),
-                           .minDepth = 0.f,
-                           .maxDepth = 1.f};
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-    VkRect2D scissor = {.offset = {0, 0}, .extent = m_extent};
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-}
@@ -1,10 +1,18 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <future>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <vulkan/vulkan.h>
 
+#include "dynamic_state.hpp"
+
 class Device;
 class RenderPass;
 class PipelineBuilder;
@@ -17,104 +25,189 @@ class Pipeline
   private:
     std::weak_ptr<Device> m_device;
 
-    VkDescriptorSetLayout m_descriptorSetLayout;
+    // shared with the other pipelines of the same layout, owned by the PipelineRegistry
+    std::vector<VkDescriptorSetLayout> m_descriptorSetLayouts;
     VkPipelineLayout m_pipelineLayout;
-    VkPipeline m_handle;
+    // swapped for the link time optimized pipeline when built from pipeline libraries
+    std::atomic<VkPipeline> m_handle = VK_NULL_HANDLE;
 
     VkExtent2D m_extent;
 
+    // the state of DynamicStateT is set per draw (see DynamicStateRecorder)
+    bool m_bDynamicState = false;
+    // the viewport and the scissor are set per command buffer (see CommandRecorder)
+    bool m_bDynamicViewport = false;
+    // the layout binds the device's BindlessTable in place of the material set
+    bool m_bBindless = false;
+
     Pipeline() = default;
 
   public:
     ~Pipeline();
 
-    void recordBind(VkCommandBuffer &commandBuffer, uint32_t imageIndex);
+    /**
+     * @brief Use an equivalent pipeline handle from now on, the current one is retired with the frames using it
+     *
+     */
+    void replaceHandle(VkPipeline handle);
 
   public:
+    [[nodiscard]] VkPipeline getHandle() const
+    {
+        return m_handle.load();
+    }
     [[nodiscard]] const VkPipelineLayout &getPipelineLayout() const
     {
         return m_pipelineLayout;
     }
-    [[nodiscard]] const VkDescriptorSetLayout &getDescriptorSetLayout() const
+    [[nodiscard]] const VkExtent2D &getExtent() const
+    {
+        return m_extent;
+    }
+    /**
+     * @brief Layout of a descriptor set of the pipeline layout, VK_NULL_HANDLE if there is no such set
+     *
+     */
+    [[nodiscard]] VkDescriptorSetLayout getDescriptorSetLayout(uint32_t set) const
+    {
+        return set < m_descriptorSetLayouts.size() ? m_descriptorSetLayouts[set] : VK_NULL_HANDLE;
+    }
+    [[nodiscard]] bool hasDynamicState() const
+    {
+        return m_bDynamicState;
+    }
+    [[nodiscard]] bool hasDynamicViewport() const
+    {
+        return m_bDynamicViewport;
+    }
+    [[nodiscard]] bool isBindless() const
     {
-        return m_descriptorSetLayout;
+        return m_bBindless;
     }
 };
 
-class PipelineBuilder
+struct ShaderStageT
 {
-  private:
-    std::unique_ptr<Pipeline> m_product;
-
-    std::weak_ptr<Device> m_device;
-
-    // shaders
-    std::vector<VkShaderModule> m_modules;
-    std::vector<VkPipelineShaderStageCreateInfo> m_shaderStageCreateInfos;
-
-    // dynamic states
-    std::vector<VkDynamicState> m_dynamicStates;
+    VkShaderStageFlagBits stage;
+    std::string filename;
+    std::string entryPoint;
+    // raw value of each specialized constant, ordered by constant ID
+    std::map<uint32_t, std::string> specializationConstants;
+};
 
+/**
+ * @brief Fixed function state of a graphics pipeline
+ *
+ * Only made of 4 bytes wide fields (no padding) so that it can be compared and stored as raw bytes.
+ */
+struct PipelineStateT
+{
     // draw mode
-    VkPrimitiveTopology m_topology;
-    bool m_bPrimitiveRestartEnable;
+    VkPrimitiveTopology topology;
+    VkBool32 primitiveRestartEnable;
 
-    VkExtent2D m_extent;
+    VkExtent2D extent;
 
     // rasterizer
-    VkBool32 m_depthClampEnable;
-    VkBool32 m_rasterizerDiscardEnable;
-    VkPolygonMode m_polygonMode;
-    VkCullModeFlags m_cullMode;
-    VkFrontFace m_frontFace;
-    VkBool32 m_depthBiasEnable;
-    float m_depthBiasConstantFactor;
-    float m_depthBiasClamp;
-    float m_depthBiasSlopeFactor;
-    float m_lineWidth;
+    VkBool32 depthClampEnable;
+    VkBool32 rasterizerDiscardEnable;
+    VkPolygonMode polygonMode;
+    VkCullModeFlags cullMode;
+    VkFrontFace frontFace;
+    VkBool32 depthBiasEnable;
+    float depthBiasConstantFactor;
+    float depthBiasClamp;
+    float depthBiasSlopeFactor;
+    float lineWidth;
 
     // multisampling
-    VkSampleCountFlagBits m_rasterizationSamples;
-    VkBool32 m_sampleShadingEnable;
-    float m_minSampleShading;
-    const VkSampleMask *m_pSampleMask;
-    VkBool32 m_alphaToCoverageEnable;
-    VkBool32 m_alphaToOneEnable;
+    VkSampleCountFlagBits rasterizationSamples;
+    VkBool32 sampleShadingEnable;
+    float minSampleShading;
+    VkBool32 alphaToCoverageEnable;
+    VkBool32 alphaToOneEnable;
 
     // depth test
-    VkBool32 m_depthTestEnable;
-    VkBool32 m_depthWriteEnable;
-    VkCompareOp m_depthCompareOp;
-    VkBool32 m_depthBoundsTestEnable;
-    VkBool32 m_stencilTestEnable;
-    VkStencilOpState m_front;
-    VkStencilOpState m_back;
-    float m_minDepthBounds;
-    float m_maxDepthBounds;
+    VkBool32 depthTestEnable;
+    VkBool32 depthWriteEnable;
+    VkCompareOp depthCompareOp;
+    VkBool32 depthBoundsTestEnable;
+    VkBool32 stencilTestEnable;
+    VkStencilOpState front;
+    VkStencilOpState back;
+    float minDepthBounds;
+    float maxDepthBounds;
 
     // color blending
-    VkBool32 m_blendEnable;
-    VkBlendFactor m_srcColorBlendFactor;
-    VkBlendFactor m_dstColorBlendFactor;
-    VkBlendOp m_colorBlendOp;
-    VkBlendFactor m_srcAlphaBlendFactor;
-    VkBlendFactor m_dstAlphaBlendFactor;
-    VkBlendOp m_alphaBlendOp;
-    VkColorComponentFlags m_colorWriteMask;
-
-    VkBool32 m_logicOpEnable;
-    VkLogicOp m_logicOp;
-    float m_blendConstants[4];
+    VkBool32 blendEnable;
+    VkBlendFactor srcColorBlendFactor;
+    VkBlendFactor dstColorBlendFactor;
+    VkBlendOp colorBlendOp;
+    VkBlendFactor srcAlphaBlendFactor;
+    VkBlendFactor dstAlphaBlendFactor;
+    VkBlendOp alphaBlendOp;
+    VkColorComponentFlags colorWriteMask;
+
+    VkBool32 logicOpEnable;
+    VkLogicOp logicOp;
+    float blendConstants[4];
+};
+
+class PipelineBuilder
+{
+  private:
+    std::unique_ptr<Pipeline> m_product;
+
+    std::weak_ptr<Device> m_device;
+
+    // shaders, the modules are loaded on build
+    std::vector<ShaderStageT> m_shaderStages;
+
+    // dynamic states
+    std::vector<VkDynamicState> m_dynamicStates;
+
+    PipelineStateT m_state;
+    const VkSampleMask *m_pSampleMask = nullptr;
 
     // descriptor set layout
     std::vector<VkPushConstantRange> m_pushConstantRanges;
 
-    std::shared_ptr<UniformDescriptor> m_uniformDescriptorPack;
+    // one per descriptor set, in set order
+    std::vector<std::shared_ptr<UniformDescriptor>> m_uniformDescriptorPacks;
+    bool m_bBindless = false;
 
-    const RenderPass *m_renderPass;
+    const RenderPass *m_renderPass = nullptr;
 
     void restart();
 
+    /**
+     * @brief State baked in the pipeline, the fields set per draw are reset to a single value
+     *
+     */
+    [[nodiscard]] PipelineStateT getBakedState() const;
+    /**
+     * @brief Dynamic states of the pipeline, the extended dynamic states of the device included
+     *
+     */
+    [[nodiscard]] std::vector<VkDynamicState> getBakedDynamicStates() const;
+    /**
+     * @brief Attachment formats of a dynamic rendering pass
+     *
+     */
+    [[nodiscard]] VkPipelineRenderingCreateInfoKHR getRenderingCreateInfo() const;
+
+    /**
+     * @brief Key of the state read by a VK_EXT_graphics_pipeline_library part
+     *
+     */
+    [[nodiscard]] std::string getLibraryKey(VkGraphicsPipelineLibraryFlagsEXT part, VkPipelineLayout layout) const;
+    /**
+     * @brief Get the four pipeline library parts of the pipeline, created once per distinct part state
+     *
+     */
+    [[nodiscard]] bool createLibraries(const VkGraphicsPipelineCreateInfo &pipelineCreateInfo,
+                                       std::array<VkPipeline, 4> &libraries) const;
+
   public:
     PipelineBuilder()
     {
@@ -128,60 +221,82 @@ class PipelineBuilder
     }
     void addVertexShaderStage(const char *shaderName, const char *entryPoint = "main");
     void addFragmentShaderStage(const char *shaderName, const char *entryPoint = "main");
+    /**
+     * @brief Specialize a constant of a stage added beforehand
+     *
+     * Every set of values is a distinct pipeline variant, shared through the registry like any other
+     * pipeline.
+     *
+     * @tparam Constant a SpecializationConstantT declaring the ID and the type of the constant
+     */
+    template <typename Constant>
+    void setSpecializationConstant(VkShaderStageFlagBits stage, typename Constant::type value)
+    {
+        bool bStageFound = false;
+        for (ShaderStageT &shaderStage : m_shaderStages)
+        {
+            if (shaderStage.stage != stage)
+                continue;
+            shaderStage.specializationConstants[Constant::id].assign(reinterpret_cast<const char *>(&value),
+                                                                     sizeof(value));
+            bStageFound = true;
+        }
+        assert(bStageFound);
+    }
     void addDynamicState(VkDynamicState state);
     void setDrawTopology(VkPrimitiveTopology topology, bool bPrimitiveRestartEnable = false);
     void setExtent(VkExtent2D extent);
     void setDepthClampEnable(VkBool32 a)
     {
-        m_depthClampEnable = a;
+        m_state.depthClampEnable = a;
     }
     void setRasterizerDiscardEnable(VkBool32 a)
     {
-        m_rasterizerDiscardEnable = a;
+        m_state.rasterizerDiscardEnable = a;
     }
     void setPolygonMode(VkPolygonMode a)
     {
-        m_polygonMode = a;
+        m_state.polygonMode = a;
     }
     void setCullMode(VkCullModeFlags a)
     {
-        m_cullMode = a;
+        m_state.cullMode = a;
     }
     void setFrontFace(VkFrontFace a)
     {
-        m_frontFace = a;
+        m_state.frontFace = a;
     }
     void setDepthBiasEnable(VkBool32 a)
     {
-        m_depthBiasEnable = a;
+        m_state.depthBiasEnable = a;
     }
     void setDepthBiasConstantFactor(float a)
     {
-        m_depthBiasConstantFactor = a;
+        m_state.depthBiasConstantFactor = a;
     }
     void setDepthBiasClamp(float a)
     {
-        m_depthBiasClamp = a;
+        m_state.depthBiasClamp = a;
     }
     void setDepthBiasSlopeFactor(float a)
     {
-        m_depthBiasSlopeFactor = a;
+        m_state.depthBiasSlopeFactor = a;
     }
     void setLineWidth(float a)
     {
-        m_lineWidth = a;
+        m_state.lineWidth = a;
     }
     void setRasterizationSamples(VkSampleCountFlagBits a)
     {
-        m_rasterizationSamples = a;
+        m_state.rasterizationSamples = a;
     }
     void setSampleShadingEnable(VkBool32 a)
     {
-        m_sampleShadingEnable = a;
+        m_state.sampleShadingEnable = a;
     }
     void setMinSampleShading(float a)
     {
-        m_minSampleShading = a;
+        m_state.minSampleShading = a;
     }
     void setPSampleMask(const VkSampleMask *a)
     {
@@ -189,105 +304,157 @@ class PipelineBuilder
     }
     void setAlphaToCoverageEnable(VkBool32 a)
     {
-        m_alphaToCoverageEnable = a;
+        m_state.alphaToCoverageEnable = a;
     }
     void setAlphaToOneEnable(VkBool32 a)
     {
-        m_alphaToOneEnable = a;
+        m_state.alphaToOneEnable = a;
     }
     void setDepthTestEnable(VkBool32 a)
     {
-        m_depthTestEnable = a;
+        m_state.depthTestEnable = a;
     }
     void setDepthWriteEnable(VkBool32 a)
     {
-        m_depthWriteEnable = a;
+        m_state.depthWriteEnable = a;
     }
     void setDepthCompareOp(VkCompareOp a)
     {
-        m_depthCompareOp = a;
+        m_state.depthCompareOp = a;
     }
     void setDepthBoundsTestEnable(VkBool32 a)
     {
-        m_depthBoundsTestEnable = a;
+        m_state.depthBoundsTestEnable = a;
     }
     void setStencilTestEnable(VkBool32 a)
     {
-        m_stencilTestEnable = a;
+        m_state.stencilTestEnable = a;
     }
     void setFront(VkStencilOpState a)
     {
-        m_front = a;
+        m_state.front = a;
     }
     void setBack(VkStencilOpState a)
     {
-        m_back = a;
+        m_state.back = a;
     }
     void setMinDepthBounds(float a)
     {
-        m_minDepthBounds = a;
+        m_state.minDepthBounds = a;
     }
     void setMaxDepthBounds(float a)
     {
-        m_maxDepthBounds = a;
+        m_state.maxDepthBounds = a;
     }
     void setBlendEnable(VkBool32 a)
     {
-        m_blendEnable = a;
+        m_state.blendEnable = a;
     }
     void setSrcColorBlendFactor(VkBlendFactor a)
     {
-        m_srcColorBlendFactor = a;
+        m_state.srcColorBlendFactor = a;
     }
     void setDstColorBlendFactor(VkBlendFactor a)
     {
-        m_dstColorBlendFactor = a;
+        m_state.dstColorBlendFactor = a;
     }
     void setColorBlendOp(VkBlendOp a)
     {
-        m_colorBlendOp = a;
+        m_state.colorBlendOp = a;
     }
     void setSrcAlphaBlendFactor(VkBlendFactor a)
     {
-        m_srcAlphaBlendFactor = a;
+        m_state.srcAlphaBlendFactor = a;
     }
     void setDstAlphaBlendFactor(VkBlendFactor a)
     {
-        m_dstAlphaBlendFactor = a;
+        m_state.dstAlphaBlendFactor = a;
     }
     void setAlphaBlendOp(VkBlendOp a)
     {
-        m_alphaBlendOp = a;
+        m_state.alphaBlendOp = a;
     }
     void setColorWriteMask(VkColorComponentFlags a)
     {
-        m_colorWriteMask = a;
+        m_state.colorWriteMask = a;
     }
     void setLogicOpEnable(VkBool32 a)
     {
-        m_logicOpEnable = a;
+        m_state.logicOpEnable = a;
     }
     void setLogicOp(VkLogicOp a)
     {
-        m_logicOp = a;
+        m_state.logicOp = a;
     }
     void setBlendConstants(float a, float b, float c, float d)
     {
-        m_blendConstants[0] = a;
-        m_blendConstants[1] = b;
-        m_blendConstants[2] = c;
-        m_blendConstants[3] = d;
+        m_state.blendConstants[0] = a;
+        m_state.blendConstants[1] = b;
+        m_state.blendConstants[2] = c;
+        m_state.blendConstants[3] = d;
+    }
+    /**
+     * @brief Layout of the next descriptor set, the first pack added is set 0
+     *
+     */
+    void addUniformDescriptorPack(std::shared_ptr<UniformDescriptor> desc)
+    {
+        m_uniformDescriptorPacks.emplace_back(desc);
+    }
+    void addPushConstantRange(VkPushConstantRange range)
+    {
+        m_pushConstantRanges.emplace_back(range);
     }
-    void setUniformDescriptorPack(std::shared_ptr<UniformDescriptor> desc)
+    /**
+     * @brief Append the set layout of the device's BindlessTable to the pipeline layout
+     *
+     * The table is set BindlessTable::setIndex, the uniform descriptor packs are the sets before it.
+     */
+    void setBindless(bool bBindless)
     {
-        m_uniformDescriptorPack = desc;
+        m_bBindless = bBindless;
     }
     void setRenderPass(const RenderPass *a)
     {
         m_renderPass = a;
     }
 
-    std::unique_ptr<Pipeline> build();
+    /**
+     * @brief Serialized builder state, without the device, the render pass, the extent and the sample mask
+     *
+     */
+    [[nodiscard]] std::string getDescription() const;
+    /**
+     * @brief Restore the builder state from a serialized description (see getDescription)
+     *
+     * @return false if the description is malformed, the builder must not be built then
+     */
+    bool setDescription(const std::string &description);
+
+    /**
+     * @brief Identity of the described pipeline : the whole builder state, the shaders and the render pass
+     *
+     */
+    [[nodiscard]] std::string getKey() const;
+
+    /**
+     * @brief State to record per draw with the built pipeline when it has dynamic state
+     *
+     */
+    [[nodiscard]] DynamicStateT getDynamicState() const;
+
+    /**
+     * @brief Build the pipeline, or share the living one built from the same description
+     *
+     */
+    std::shared_ptr<Pipeline> build();
+    /**
+     * @brief Build the pipeline on the device's background compiler
+     *
+     * The future is ready right away if the pipeline is already living. The render pass must outlive
+     * the compilation. The future holds nullptr if the compilation failed.
+     */
+    [[nodiscard]] std::shared_future<std::shared_ptr<Pipeline>> buildAsync();
 };
 
 class PipelineDirector
@@ -0,0 +1,154 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "pipeline_cache.hpp"
+
+PipelineCache::PipelineCache(VkDevice device, const VkPhysicalDeviceProperties &props, const std::string &filename)
+    : m_device(device), m_props(props), m_filename(filename), m_lastSaveTime(std::chrono::steady_clock::now())
+{
+    std::vector<char> data;
+    std::ifstream file(m_filename, std::ios::ate | std::ios::binary);
+    if (file.is_open())
+    {
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), data.size());
+        file.close();
+
+        if (!isHeaderValid(data))
+        {
+            std::cout << "Pipeline cache " << m_filename << " was created by another device or driver, ignoring it"
+                      << std::endl;
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = data.size(),
+        .pInitialData = data.empty() ? nullptr : data.data(),
+    };
+    VkResult res = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_handle);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create pipeline cache : " << res << std::endl;
+        m_handle = VK_NULL_HANDLE;
+    }
+}
+
+PipelineCache::~PipelineCache()
+{
+    if (m_bDirty)
+        save();
+    printStatistics();
+
+    vkDestroyPipelineCache(m_device, m_handle, nullptr);
+}
+
+bool PipelineCache::isHeaderValid(const std::vector<char> &data) const
+{
+    if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne))
+        return false;
+
+    VkPipelineCacheHeaderVersionOne header;
+    memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne) &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header.vendorID == m_props.vendorID &&
+           header.deviceID == m_props.deviceID &&
+           memcmp(header.pipelineCacheUUID, m_props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool PipelineCache::save()
+{
+    if (m_handle == VK_NULL_HANDLE)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t dataSize;
+    VkResult res = vkGetPipelineCacheData(m_device, m_handle, &dataSize, nullptr);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to get pipeline cache data size : " << res << std::endl;
+        return false;
+    }
+    std::vector<char> data(dataSize);
+    res = vkGetPipelineCacheData(m_device, m_handle, &dataSize, data.data());
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to get pipeline cache data : " << res << std::endl;
+        return false;
+    }
+
+    // write next to the cache then replace it
+    std::string tmpFilename = m_filename + ".tmp";
+    std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open file : " << tmpFilename << std::endl;
+        return false;
+    }
+    file.write(data.data(), dataSize);
+    file.close();
+    if (file.fail())
+    {
+        std::cerr << "Failed to write file : " << tmpFilename << std::endl;
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmpFilename, m_filename, error);
+    if (error)
+    {
+        std::cerr << "Failed to replace pipeline cache " << m_filename << " : " << error.message() << std::endl;
+        return false;
+    }
+
+    m_bDirty = false;
+    m_lastSaveTime = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool PipelineCache::saveIfNeeded(std::chrono::seconds interval)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_bDirty || std::chrono::steady_clock::now() - m_lastSaveTime < interval)
+            return false;
+    }
+    return save();
+}
+
+void PipelineCache::recordCreation(const VkPipelineCreationFeedbackEXT &feedback, std::chrono::nanoseconds duration)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    ++m_pipelineCount;
+    m_creationDuration += duration;
+    m_bDirty = true;
+
+    if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT))
+        return;
+    ++m_feedbackCount;
+    if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT)
+        ++m_hitCount;
+}
+
+void PipelineCache::printStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_pipelineCount == 0)
+        return;
+
+    std::cout << "Pipeline cache : " << m_pipelineCount << " pipeline(s) created in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(m_creationDuration).count() << " ms";
+    if (m_feedbackCount > 0)
+        std::cout << ", " << m_hitCount << "/" << m_feedbackCount << " cache hit(s) ("
+                  << 100 * m_hitCount / m_feedbackCount << "%)";
+    std::cout << std::endl;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief VkPipelineCache persisted to disk
+ *
+ * The file is only used if its header matches the vendor, the device and the pipelineCacheUUID
+ * (driver version) of the physical device. It is written to a temporary file then renamed so that a
+ * crash while saving never leaves a truncated cache behind.
+ */
+class PipelineCache
+{
+  private:
+    VkDevice m_device;
+    VkPhysicalDeviceProperties m_props;
+
+    VkPipelineCache m_handle = VK_NULL_HANDLE;
+
+    std::string m_filename;
+
+    // pipelines created since the last save
+    bool m_bDirty = false;
+    std::chrono::steady_clock::time_point m_lastSaveTime;
+
+    // creation feedback statistics
+    uint32_t m_pipelineCount = 0;
+    uint32_t m_hitCount = 0;
+    uint32_t m_feedbackCount = 0;
+    std::chrono::nanoseconds m_creationDuration = std::chrono::nanoseconds(0);
+
+    mutable std::mutex m_mutex;
+
+    [[nodiscard]] bool isHeaderValid(const std::vector<char> &data) const;
+
+  public:
+    PipelineCache(VkDevice device, const VkPhysicalDeviceProperties &props, const std::string &filename);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache &) = delete;
+    PipelineCache &operator=(const PipelineCache &) = delete;
+    PipelineCache(PipelineCache &&) = delete;
+    PipelineCache &operator=(PipelineCache &&) = delete;
+
+    /**
+     * @brief Write the cache to disk
+     *
+     */
+    bool save();
+    /**
+     * @brief Write the cache to disk if pipelines were created and the interval elapsed since the last save
+     *
+     */
+    bool saveIfNeeded(std::chrono::seconds interval);
+
+    /**
+     * @brief Account for a pipeline creation
+     *
+     * @param feedback creation feedback of the whole pipeline (flags are 0 if the feedback is not supported)
+     * @param duration time spent in vkCreateGraphicsPipelines
+     */
+    void recordCreation(const VkPipelineCreationFeedbackEXT &feedback, std::chrono::nanoseconds duration);
+
+    void printStatistics() const;
+
+  public:
+    [[nodiscard]] inline VkPipelineCache getHandle() const
+    {
+        return m_handle;
+    }
+};
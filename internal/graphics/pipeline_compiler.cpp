@@ -0,0 +1,76 @@
+#include "pipeline.hpp"
+
+#include "pipeline_compiler.hpp"
+
+PipelineCompiler::PipelineCompiler(uint32_t threadCount)
+{
+    for (uint32_t i = 0; i < threadCount; ++i)
+        m_workers.emplace_back(&PipelineCompiler::work, this);
+}
+
+PipelineCompiler::~PipelineCompiler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopping = true;
+        m_jobs.clear();
+        m_pendingFutures.clear();
+    }
+    m_jobCondition.notify_all();
+
+    for (std::thread &worker : m_workers)
+        worker.join();
+}
+
+void PipelineCompiler::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_jobCondition.wait(lock, [this]() { return m_bStopping || !m_jobs.empty(); });
+        if (m_bStopping)
+            return;
+
+        JobT job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        ++m_runningJobCount;
+
+        // compile outside of the lock
+        lock.unlock();
+        std::shared_ptr<Pipeline> pipeline = job.compile();
+        lock.lock();
+
+        m_pendingFutures.erase(job.key);
+        job.promise.set_value(pipeline);
+
+        --m_runningJobCount;
+        if (m_jobs.empty() && m_runningJobCount == 0)
+            m_idleCondition.notify_all();
+    }
+}
+
+std::shared_future<std::shared_ptr<Pipeline>> PipelineCompiler::submit(
+    const std::string &key, std::function<std::shared_ptr<Pipeline>()> &&compile)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_pendingFutures.find(key);
+    if (it != m_pendingFutures.end())
+        return it->second;
+
+    JobT &job = m_jobs.emplace_back(JobT{
+        .key = key,
+        .compile = std::move(compile),
+    });
+    std::shared_future<std::shared_ptr<Pipeline>> future = job.promise.get_future().share();
+    m_pendingFutures[key] = future;
+
+    m_jobCondition.notify_one();
+    return future;
+}
+
+void PipelineCompiler::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idleCondition.wait(lock, [this]() { return m_jobs.empty() && m_runningJobCount == 0; });
+}
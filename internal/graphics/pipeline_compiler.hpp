@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Pipeline;
+
+/**
+ * @brief Compiles pipelines on background threads
+ *
+ * Jobs are keyed by the pipeline key (see PipelineBuilder::getKey) so that a pipeline requested again
+ * while it is compiling shares the pending compilation. Jobs still queued when the compiler is
+ * destroyed are dropped, their futures are broken.
+ */
+class PipelineCompiler
+{
+  private:
+    struct JobT
+    {
+        std::string key;
+        std::function<std::shared_ptr<Pipeline>()> compile;
+        std::promise<std::shared_ptr<Pipeline>> promise;
+    };
+
+    std::vector<std::thread> m_workers;
+
+    std::deque<JobT> m_jobs;
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<Pipeline>>> m_pendingFutures;
+    uint32_t m_runningJobCount = 0;
+    bool m_bStopping = false;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_jobCondition;
+    std::condition_variable m_idleCondition;
+
+    void work();
+
+  public:
+    PipelineCompiler(uint32_t threadCount);
+    ~PipelineCompiler();
+
+    PipelineCompiler(const PipelineCompiler &) = delete;
+    PipelineCompiler &operator=(const PipelineCompiler &) = delete;
+    PipelineCompiler(PipelineCompiler &&) = delete;
+    PipelineCompiler &operator=(PipelineCompiler &&) = delete;
+
+    /**
+     * @brief Queue a compilation, or join the pending one of the same key
+     *
+     * @param compile builds the pipeline on a worker thread, returns nullptr on failure
+     */
+    [[nodiscard]] std::shared_future<std::shared_ptr<Pipeline>> submit(
+        const std::string &key, std::function<std::shared_ptr<Pipeline>()> &&compile);
+
+    /**
+     * @brief Wait for every queued and running compilation
+     *
+     */
+    void waitIdle();
+
+  public:
+    [[nodiscard]] size_t getPendingCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pendingFutures.size();
+    }
+};
@@ -0,0 +1,109 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "pipeline.hpp"
+
+#include "pipeline_manifest.hpp"
+
+// the layout of the descriptions changes with the fixed function state and the description version
+struct PipelineManifestHeaderT
+{
+    char magic[4] = {'P', 'L', 'M', 'F'};
+    uint32_t version = 4;
+    uint32_t stateSize = sizeof(PipelineStateT);
+    uint32_t descriptionCount = 0;
+};
+
+PipelineManifest::PipelineManifest(const std::string &filename) : m_filename(filename)
+{
+    std::ifstream file(m_filename, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+        return;
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    PipelineManifestHeaderT expected;
+    PipelineManifestHeaderT header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.version != expected.version || header.stateSize != expected.stateSize)
+    {
+        std::cout << "Pipeline manifest " << m_filename << " is outdated, ignoring it" << std::endl;
+        return;
+    }
+
+    for (uint32_t i = 0; i < header.descriptionCount; ++i)
+    {
+        uint32_t size = 0;
+        file.read(reinterpret_cast<char *>(&size), sizeof(size));
+        std::string description(file && size <= fileSize ? size : 0, '\0');
+        file.read(description.data(), description.size());
+        if (!file || description.size() != size)
+        {
+            std::cerr << "Failed to read pipeline manifest : " << m_filename << std::endl;
+            break;
+        }
+
+        if (m_knownDescriptions.insert(description).second)
+            m_descriptions.emplace_back(std::move(description));
+    }
+}
+
+PipelineManifest::~PipelineManifest()
+{
+    if (m_bDirty)
+        save();
+}
+
+void PipelineManifest::record(const std::string &description)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_knownDescriptions.insert(description).second)
+        return;
+    m_descriptions.emplace_back(description);
+    m_bDirty = true;
+}
+
+bool PipelineManifest::save()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // write next to the manifest then replace it
+    std::string tmpFilename = m_filename + ".tmp";
+    std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open file : " << tmpFilename << std::endl;
+        return false;
+    }
+
+    PipelineManifestHeaderT header;
+    header.descriptionCount = static_cast<uint32_t>(m_descriptions.size());
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const std::string &description : m_descriptions)
+    {
+        uint32_t size = static_cast<uint32_t>(description.size());
+        file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        file.write(description.data(), description.size());
+    }
+    file.close();
+    if (file.fail())
+    {
+        std::cerr << "Failed to write file : " << tmpFilename << std::endl;
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmpFilename, m_filename, error);
+    if (error)
+    {
+        std::cerr << "Failed to replace pipeline manifest " << m_filename << " : " << error.message() << std::endl;
+        return false;
+    }
+
+    m_bDirty = false;
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief List of the pipeline descriptions built by the application, persisted to disk
+ *
+ * Every pipeline compiled through a PipelineBuilder records its description (see
+ * PipelineBuilder::getDescription). The next runs read them back to compile the pipelines ahead of
+ * their first use (see Renderer::warmupPipelines).
+ */
+class PipelineManifest
+{
+  private:
+    std::string m_filename;
+
+    // in recording order
+    std::vector<std::string> m_descriptions;
+    std::unordered_set<std::string> m_knownDescriptions;
+
+    // descriptions recorded since the last save
+    bool m_bDirty = false;
+
+    mutable std::mutex m_mutex;
+
+  public:
+    PipelineManifest(const std::string &filename);
+    ~PipelineManifest();
+
+    PipelineManifest(const PipelineManifest &) = delete;
+    PipelineManifest &operator=(const PipelineManifest &) = delete;
+    PipelineManifest(PipelineManifest &&) = delete;
+    PipelineManifest &operator=(PipelineManifest &&) = delete;
+
+    /**
+     * @brief Add a description if it is not already known
+     *
+     */
+    void record(const std::string &description);
+
+    /**
+     * @brief Write the manifest to disk
+     *
+     */
+    bool save();
+
+  public:
+    [[nodiscard]] std::vector<std::string> getDescriptions() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_descriptions;
+    }
+};
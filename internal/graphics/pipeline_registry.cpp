@@ -0,0 +1,229 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <span>
+
+#include <embedded_shaders.hpp>
+
+#include "byte_key.hpp"
+#include "pipeline.hpp"
+
+#include "pipeline_registry.hpp"
+
+bool read_binary_file(const std::string &filename, std::vector<char> &out)
+{
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open file : " << filename << std::endl;
+        return false;
+    }
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    out.resize(fileSize);
+
+    file.seekg(0);
+    file.read(out.data(), fileSize);
+
+    file.close();
+    return true;
+}
+
+PipelineRegistry::PipelineRegistry(VkDevice device) : m_device(device)
+{
+    if (const char *shaderDirectory = std::getenv("VKPG_SHADER_DIR"))
+    {
+        m_shaderDirectory = shaderDirectory;
+        std::cout << "Shaders are read from " << m_shaderDirectory << " before the embedded ones" << std::endl;
+    }
+}
+
+PipelineRegistry::~PipelineRegistry()
+{
+    printStatistics();
+
+    for (auto &[key, library] : m_libraries)
+        vkDestroyPipeline(m_device, library, nullptr);
+    for (auto &[key, pipelineLayout] : m_pipelineLayouts)
+        vkDestroyPipelineLayout(m_device, pipelineLayout, nullptr);
+    for (auto &[key, setLayout] : m_descriptorSetLayouts)
+        vkDestroyDescriptorSetLayout(m_device, setLayout, nullptr);
+    for (auto &[key, module] : m_shaderModules)
+        vkDestroyShaderModule(m_device, module, nullptr);
+}
+
+VkShaderModule PipelineRegistry::getShaderModule(const std::string &filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_shaderModules.find(filename);
+    if (it != m_shaderModules.end())
+        return it->second;
+
+    std::span<const uint32_t> code = find_embedded_shader(filename);
+
+    // shaders recompiled on disk take precedence during development
+    std::vector<char> fileCode;
+    if (!m_shaderDirectory.empty() && read_binary_file(m_shaderDirectory + "/" + filename, fileCode))
+        code = std::span(reinterpret_cast<const uint32_t *>(fileCode.data()), fileCode.size() / sizeof(uint32_t));
+
+    if (code.empty())
+    {
+        std::cerr << "Failed to find shader : " << filename << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    VkShaderModuleCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = code.size_bytes(),
+        .pCode = code.data(),
+    };
+    VkShaderModule module;
+    VkResult res = vkCreateShaderModule(m_device, &createInfo, nullptr, &module);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create shader module : " << res << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    m_shaderModules[filename] = module;
+    return module;
+}
+
+VkDescriptorSetLayout PipelineRegistry::getDescriptorSetLayout(std::span<const VkDescriptorSetLayoutBinding> bindings)
+{
+    std::string key;
+    for (const VkDescriptorSetLayoutBinding &binding : bindings)
+    {
+        append_bytes(key, binding.binding);
+        append_bytes(key, binding.descriptorType);
+        append_bytes(key, binding.descriptorCount);
+        append_bytes(key, binding.stageFlags);
+        for (uint32_t i = 0; binding.pImmutableSamplers && i < binding.descriptorCount; ++i)
+            append_bytes(key, binding.pImmutableSamplers[i]);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_descriptorSetLayouts.find(key);
+    if (it != m_descriptorSetLayouts.end())
+        return it->second;
+
+    VkDescriptorSetLayoutCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings = bindings.data(),
+    };
+    VkDescriptorSetLayout setLayout;
+    VkResult res = vkCreateDescriptorSetLayout(m_device, &createInfo, nullptr, &setLayout);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create descriptor set layout : " << res << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    m_descriptorSetLayouts[key] = setLayout;
+    return setLayout;
+}
+
+VkPipelineLayout PipelineRegistry::getPipelineLayout(std::span<const VkDescriptorSetLayout> setLayouts,
+                                                     std::span<const VkPushConstantRange> pushConstantRanges)
+{
+    std::string key;
+    append_bytes(key, setLayouts.size());
+    for (const VkDescriptorSetLayout &setLayout : setLayouts)
+        append_bytes(key, setLayout);
+    for (const VkPushConstantRange &range : pushConstantRanges)
+    {
+        append_bytes(key, range.stageFlags);
+        append_bytes(key, range.offset);
+        append_bytes(key, range.size);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_pipelineLayouts.find(key);
+    if (it != m_pipelineLayouts.end())
+        return it->second;
+
+    VkPipelineLayoutCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+        .pSetLayouts = setLayouts.data(),
+        .pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size()),
+        .pPushConstantRanges = pushConstantRanges.data(),
+    };
+    VkPipelineLayout pipelineLayout;
+    VkResult res = vkCreatePipelineLayout(m_device, &createInfo, nullptr, &pipelineLayout);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create pipeline layout : " << res << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    m_pipelineLayouts[key] = pipelineLayout;
+    return pipelineLayout;
+}
+
+VkPipeline PipelineRegistry::getLibrary(const std::string &key, const std::function<VkPipeline()> &create)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_libraries.find(key);
+        if (it != m_libraries.end())
+            return it->second;
+    }
+
+    // compiling a library takes a while, other threads keep using the registry meanwhile
+    VkPipeline library = create();
+    if (library == VK_NULL_HANDLE)
+        return VK_NULL_HANDLE;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [it, bInserted] = m_libraries.emplace(key, library);
+    if (!bInserted)
+        vkDestroyPipeline(m_device, library, nullptr);
+    return it->second;
+}
+
+std::shared_ptr<Pipeline> PipelineRegistry::findPipeline(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    ++m_requestCount;
+
+    auto it = m_pipelines.find(key);
+    if (it == m_pipelines.end())
+        return nullptr;
+
+    std::shared_ptr<Pipeline> pipeline = it->second.lock();
+    if (!pipeline)
+        m_pipelines.erase(it);
+    return pipeline;
+}
+
+std::shared_ptr<Pipeline> PipelineRegistry::registerPipeline(const std::string &key, std::shared_ptr<Pipeline> pipeline)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::weak_ptr<Pipeline> &entry = m_pipelines[key];
+    if (std::shared_ptr<Pipeline> existing = entry.lock())
+        return existing;
+
+    ++m_creationCount;
+    entry = pipeline;
+    return pipeline;
+}
+
+void PipelineRegistry::printStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_requestCount == 0)
+        return;
+
+    std::cout << "Pipeline registry : " << m_requestCount << " pipeline request(s), " << m_creationCount
+              << " pipeline(s) created, " << m_shaderModules.size() << " shader module(s), "
+              << m_descriptorSetLayouts.size() << " descriptor set layout(s), " << m_pipelineLayouts.size()
+              << " pipeline layout(s), " << m_libraries.size() << " pipeline library part(s)" << std::endl;
+}
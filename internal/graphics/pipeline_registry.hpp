@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+class Pipeline;
+
+/**
+ * @brief Shares pipelines and the objects they are made of between identical pipeline descriptions
+ *
+ * Pipelines are keyed by the serialized state of the PipelineBuilder that described them (see
+ * PipelineBuilder::getKey), an identical description gives back the living pipeline instead of
+ * compiling a new one. Shader modules, descriptor set layouts and pipeline layouts are created once
+ * and kept until the device is destroyed.
+ */
+class PipelineRegistry
+{
+  private:
+    VkDevice m_device;
+
+    // directory the SPIR-V files are read from instead of the embedded shaders (VKPG_SHADER_DIR), if any
+    std::string m_shaderDirectory;
+
+    // shader file path
+    std::unordered_map<std::string, VkShaderModule> m_shaderModules;
+    // serialized layout bindings
+    std::unordered_map<std::string, VkDescriptorSetLayout> m_descriptorSetLayouts;
+    // set layout handles and push constant ranges
+    std::unordered_map<std::string, VkPipelineLayout> m_pipelineLayouts;
+    // pipeline builder key, pipelines are released by their last user
+    std::unordered_map<std::string, std::weak_ptr<Pipeline>> m_pipelines;
+    // graphics pipeline library parts (VK_EXT_graphics_pipeline_library), keyed by the state of their part
+    std::unordered_map<std::string, VkPipeline> m_libraries;
+
+    uint32_t m_requestCount = 0;
+    uint32_t m_creationCount = 0;
+
+    mutable std::mutex m_mutex;
+
+  public:
+    PipelineRegistry(VkDevice device);
+    ~PipelineRegistry();
+
+    PipelineRegistry(const PipelineRegistry &) = delete;
+    PipelineRegistry &operator=(const PipelineRegistry &) = delete;
+    PipelineRegistry(PipelineRegistry &&) = delete;
+    PipelineRegistry &operator=(PipelineRegistry &&) = delete;
+
+    /**
+     * @brief Create the module of a shader compiled at build time on first use
+     *
+     * The SPIR-V is embedded in the binary (see shaders/CMakeLists.txt). For development, the file is
+     * read from the directory given by the VKPG_SHADER_DIR environment variable first.
+     *
+     * @param filename relative path of the SPIR-V file, e.g. "shaders/phong.frag.spv"
+     * @return VK_NULL_HANDLE if there is no such shader
+     */
+    [[nodiscard]] VkShaderModule getShaderModule(const std::string &filename);
+    [[nodiscard]] VkDescriptorSetLayout getDescriptorSetLayout(std::span<const VkDescriptorSetLayoutBinding> bindings);
+    [[nodiscard]] VkPipelineLayout getPipelineLayout(std::span<const VkDescriptorSetLayout> setLayouts,
+                                                     std::span<const VkPushConstantRange> pushConstantRanges);
+
+    /**
+     * @brief Pipeline library of the given key, created on first use
+     *
+     * @param create creates the library (outside of the registry lock), returns VK_NULL_HANDLE on failure
+     */
+    [[nodiscard]] VkPipeline getLibrary(const std::string &key, const std::function<VkPipeline()> &create);
+
+    /**
+     * @brief Living pipeline built from the same description, nullptr if none
+     *
+     */
+    [[nodiscard]] std::shared_ptr<Pipeline> findPipeline(const std::string &key);
+    /**
+     * @brief Register a newly created pipeline
+     *
+     * @return the registered pipeline, which is an other one if the same description was registered concurrently
+     */
+    std::shared_ptr<Pipeline> registerPipeline(const std::string &key, std::shared_ptr<Pipeline> pipeline);
+
+    void printStatistics() const;
+};
@@ -21,6 +21,171 @@ RenderPass::~RenderPass()
     vkDestroyRenderPass(deviceHandle, m_handle, nullptr);
 }
 
+void RenderPass::recordBegin(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                             std::span<const VkClearValue> clearValues, VkSubpassContents contents)
+{
+    if (!isDynamicRendering())
+    {
+        VkRenderPassBeginInfo renderPassBeginInfo = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+            .renderPass = m_handle,
+            .framebuffer = m_framebuffers[imageIndex],
+            .renderArea =
+                {
+                    .offset = {0, 0},
+                    .extent = m_swapchain->getExtent(),
+                },
+            .clearValueCount = static_cast<uint32_t>(clearValues.size()),
+            .pClearValues = clearValues.data(),
+        };
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, contents);
+        return;
+    }
+
+    // the layout transitions and the dependency of the render pass
+    std::array<VkImageMemoryBarrier, 2> barriers = {
+        VkImageMemoryBarrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = m_swapchain->getImages()[imageIndex],
+            .subresourceRange =
+                {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+        },
+        // the depth image is shared by the frames in flight
+        VkImageMemoryBarrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask =
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = m_swapchain->getDepthImage(),
+            .subresourceRange =
+                {
+                    .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+        },
+    };
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                         0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    VkRenderingAttachmentInfoKHR colorAttachment = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+        .imageView = m_swapchain->getImageViews()[imageIndex],
+        .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = clearValues[0],
+    };
+    VkRenderingAttachmentInfoKHR depthAttachment = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+        .imageView = m_swapchain->getDepthImageView(),
+        .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .clearValue = clearValues[1],
+    };
+    VkRenderingInfoKHR renderingInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+        .flags = contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                     ? static_cast<VkRenderingFlags>(VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR)
+                     : 0,
+        .renderArea =
+            {
+                .offset = {0, 0},
+                .extent = m_swapchain->getExtent(),
+            },
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorAttachment,
+        .pDepthAttachment = &depthAttachment,
+    };
+    m_device.lock()->getDispatch().vkCmdBeginRenderingKHR(commandBuffer, &renderingInfo);
+}
+
+bool RenderPass::beginSecondaryCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) const
+{
+    // with dynamic rendering, the secondary command buffer only inherits the attachment formats
+    VkCommandBufferInheritanceRenderingInfoKHR renderingInheritanceInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR,
+        .colorAttachmentCount = static_cast<uint32_t>(m_colorAttachmentFormats.size()),
+        .pColorAttachmentFormats = m_colorAttachmentFormats.data(),
+        .depthAttachmentFormat = m_depthAttachmentFormat,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+    };
+    VkCommandBufferInheritanceInfo inheritanceInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = isDynamicRendering() ? &renderingInheritanceInfo : nullptr,
+        .renderPass = m_handle,
+        .subpass = 0,
+        .framebuffer = isDynamicRendering() ? VK_NULL_HANDLE : m_framebuffers[imageIndex],
+    };
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = &inheritanceInfo,
+    };
+    VkResult res = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to begin recording secondary command buffer : " << res << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void RenderPass::recordEnd(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+    if (!isDynamicRendering())
+    {
+        vkCmdEndRenderPass(commandBuffer);
+        return;
+    }
+
+    m_device.lock()->getDispatch().vkCmdEndRenderingKHR(commandBuffer);
+
+    // final layout of the render pass
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = 0,
+        .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = m_swapchain->getImages()[imageIndex],
+        .subresourceRange =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
 std::unique_ptr<RenderPass> RenderPassBuilder::build()
 {
     assert(m_device.lock());
@@ -28,6 +193,13 @@ std::unique_ptr<RenderPass> RenderPassBuilder::build()
 
     const VkDevice &deviceHandle = m_device.lock()->getHandle();
 
+    // the attachments are described when beginning rendering
+    if (m_device.lock()->isDynamicRenderingEnabled())
+    {
+        auto result = std::move(m_product);
+        return result;
+    }
+
     m_subpass.colorAttachmentCount = static_cast<uint32_t>(m_colorAttachmentReferences.size());
     m_subpass.pColorAttachments = m_colorAttachmentReferences.data();
     m_subpass.pDepthStencilAttachment = m_depthAttachmentReferences.data();
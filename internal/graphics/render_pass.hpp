@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>
+#include <span>
 #include <vector>
 
 #include <vulkan/vulkan.h>
@@ -8,21 +10,52 @@ class Device;
 class SwapChain;
 class RenderPassBuilder;
 
+/**
+ * @brief Attachments rendered to by the pipelines
+ *
+ * With dynamic rendering (see Device::isDynamicRenderingEnabled) there is neither a VkRenderPass nor
+ * framebuffers, the swapchain images are rendered to directly and pipelines only depend on the
+ * attachment formats.
+ */
 class RenderPass
 {
     friend RenderPassBuilder;
 
   private:
     std::weak_ptr<Device> m_device;
+    const SwapChain *m_swapchain;
 
-    VkRenderPass m_handle;
+    VkRenderPass m_handle = VK_NULL_HANDLE;
     std::vector<VkFramebuffer> m_framebuffers;
 
+    std::vector<VkFormat> m_colorAttachmentFormats;
+    VkFormat m_depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+
     RenderPass() = default;
 
   public:
     ~RenderPass();
 
+    /**
+     * @brief Begin rendering to the swapchain image
+     *
+     * @param clearValues clear value of the color attachment then of the depth attachment
+     * @param contents VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS if the draws are recorded in secondary
+     * command buffers (see beginSecondaryCommandBuffer)
+     */
+    void recordBegin(VkCommandBuffer commandBuffer, uint32_t imageIndex, std::span<const VkClearValue> clearValues,
+                     VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+    /**
+     * @brief Begin a secondary command buffer continuing the rendering to the swapchain image
+     *
+     */
+    bool beginSecondaryCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) const;
+    /**
+     * @brief End rendering, the swapchain image is ready to be presented
+     *
+     */
+    void recordEnd(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
     RenderPass(const RenderPass &) = delete;
     RenderPass &operator=(const RenderPass &) = delete;
     RenderPass(RenderPass &&) = delete;
@@ -38,6 +71,18 @@ class RenderPass
     {
         return m_framebuffers[index];
     }
+    [[nodiscard]] bool isDynamicRendering() const
+    {
+        return m_handle == VK_NULL_HANDLE;
+    }
+    [[nodiscard]] const std::vector<VkFormat> &getColorAttachmentFormats() const
+    {
+        return m_colorAttachmentFormats;
+    }
+    [[nodiscard]] VkFormat getDepthAttachmentFormat() const
+    {
+        return m_depthAttachmentFormat;
+    }
 };
 
 class RenderPassBuilder
@@ -92,6 +137,7 @@ class RenderPassBuilder
 
         m_attachments.emplace_back(colorAttachment);
         m_colorAttachmentReferences.emplace_back(colorAttachmentRef);
+        m_product->m_colorAttachmentFormats.emplace_back(imageFormat);
 
         m_subpassDependency.srcStageMask |= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
         m_subpassDependency.dstStageMask |= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -117,6 +163,7 @@ class RenderPassBuilder
 
         m_attachments.emplace_back(depthAttachment);
         m_depthAttachmentReferences.emplace_back(depthAttachmentRef);
+        m_product->m_depthAttachmentFormat = depthImageFormat;
 
         m_subpassDependency.srcStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
         m_subpassDependency.dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
@@ -131,6 +178,7 @@ class RenderPassBuilder
     void setSwapChain(const SwapChain *swapchain)
     {
         m_swapchain = swapchain;
+        m_product->m_swapchain = swapchain;
     }
 
     std::unique_ptr<RenderPass> build();
@@ -77,8 +77,6 @@ SwapChain::SwapChain(std::weak_ptr<Device> device) : m_device(device)
     m_images.resize(imageCount);
     vkGetSwapchainImagesKHR(deviceHandle, m_handle, &imageCount, m_images.data());
 
-    m_frameInFlightCount = m_images.size();
-
     // image views
 
     m_imageViews.resize(imageCount);
@@ -146,3 +144,8 @@ const VkFormat SwapChain::getDepthImageFormat() const
 {
     return m_depthImage->getFormat();
 }
+
+VkImage SwapChain::getDepthImage() const
+{
+    return m_depthImage->getHandle();
+}
@@ -24,8 +24,6 @@ class SwapChain
     std::unique_ptr<Image> m_depthImage;
     VkImageView m_depthImageView;
 
-    uint32_t m_frameInFlightCount;
-
   public:
     SwapChain(std::weak_ptr<Device> device);
     ~SwapChain();
@@ -41,6 +39,10 @@ class SwapChain
         return m_handle;
     }
 
+    [[nodiscard]] inline const std::vector<VkImage> &getImages() const
+    {
+        return m_images;
+    }
     [[nodiscard]] inline const std::vector<VkImageView> &getImageViews() const
     {
         return m_imageViews;
@@ -55,14 +57,10 @@ class SwapChain
         return m_depthImageView;
     }
     [[nodiscard]] const VkFormat getDepthImageFormat() const;
+    [[nodiscard]] VkImage getDepthImage() const;
 
     [[nodiscard]] inline const VkExtent2D &getExtent() const
     {
         return m_extent;
     }
-
-    [[nodiscard]] inline const uint32_t getFrameInFlightCount() const
-    {
-        return m_frameInFlightCount;
-    }
 };
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include <iostream>
+
+#include "transfer_handoff.hpp"
+
+TransferHandoff::TransferHandoff(VkDevice device, VkQueue transferQueue, uint32_t transferFamilyIndex,
+                                 uint32_t graphicsFamilyIndex)
+    : m_device(device), m_transferQueue(transferQueue), m_transferFamilyIndex(transferFamilyIndex),
+      m_graphicsFamilyIndex(graphicsFamilyIndex)
+{
+    VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0,
+    };
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &semaphoreTypeCreateInfo,
+    };
+    VkResult res = vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_timelineSemaphore);
+    if (res != VK_SUCCESS)
+        std::cerr << "Failed to create transfer timeline semaphore : " << res << std::endl;
+}
+
+TransferHandoff::~TransferHandoff()
+{
+    vkDestroySemaphore(m_device, m_timelineSemaphore, nullptr);
+}
+
+bool TransferHandoff::submit(VkCommandBuffer commandBuffer, VkFence fence,
+                             std::span<const VkBufferMemoryBarrier> bufferBarriers,
+                             std::span<const VkImageMemoryBarrier> imageBarriers)
+{
+    // release on the transfer queue (the destination access is ignored)
+    std::vector<VkBufferMemoryBarrier> releaseBufferBarriers(bufferBarriers.begin(), bufferBarriers.end());
+    std::vector<VkImageMemoryBarrier> releaseImageBarriers(imageBarriers.begin(), imageBarriers.end());
+    for (VkBufferMemoryBarrier &barrier : releaseBufferBarriers)
+        barrier.dstAccessMask = 0;
+    for (VkImageMemoryBarrier &barrier : releaseImageBarriers)
+        barrier.dstAccessMask = 0;
+    if (!releaseBufferBarriers.empty() || !releaseImageBarriers.empty())
+    {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                             nullptr, static_cast<uint32_t>(releaseBufferBarriers.size()),
+                             releaseBufferBarriers.data(), static_cast<uint32_t>(releaseImageBarriers.size()),
+                             releaseImageBarriers.data());
+    }
+
+    VkResult res = vkEndCommandBuffer(commandBuffer);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to record upload command buffer : " << res << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // timeline values must increase in submission order
+    uint64_t signalValue = m_timelineValue + 1;
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &signalValue,
+    };
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timelineInfo,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &m_timelineSemaphore,
+    };
+    res = vkQueueSubmit(m_transferQueue, 1, &submitInfo, fence);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to submit upload command buffer to the transfer queue : " << res << std::endl;
+        return false;
+    }
+    m_timelineValue = signalValue;
+
+    // acquire on the graphics queue (the source access is ignored)
+    for (VkBufferMemoryBarrier barrier : bufferBarriers)
+    {
+        barrier.srcAccessMask = 0;
+        m_bufferBarriers.emplace_back(barrier);
+    }
+    for (VkImageMemoryBarrier barrier : imageBarriers)
+    {
+        barrier.srcAccessMask = 0;
+        m_imageBarriers.emplace_back(barrier);
+    }
+    return true;
+}
+
+uint64_t TransferHandoff::recordAcquire(VkCommandBuffer commandBuffer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_bufferBarriers.empty() && m_imageBarriers.empty())
+        return 0;
+
+    // the source stages are the ones waiting on the timeline, the layout transitions happen after the copies
+    vkCmdPipelineBarrier(commandBuffer, consumerStageMask, consumerStageMask, 0, 0, nullptr,
+                         static_cast<uint32_t>(m_bufferBarriers.size()), m_bufferBarriers.data(),
+                         static_cast<uint32_t>(m_imageBarriers.size()), m_imageBarriers.data());
+    m_bufferBarriers.clear();
+    m_imageBarriers.clear();
+
+    return m_timelineValue;
+}
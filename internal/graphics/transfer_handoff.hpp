@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief Hands the resources uploaded on the transfer queue over to the graphics queue
+ *
+ * Upload batches are submitted to the transfer queue through the handoff, which releases their resources
+ * and signals its timeline semaphore. The acquisitions are kept until the next frame records them : the
+ * frame waits on the timeline at the stages reading the resources only, so rendering is not stalled
+ * behind the copies until it uses them.
+ */
+class TransferHandoff
+{
+  private:
+    VkDevice m_device;
+    VkQueue m_transferQueue;
+    uint32_t m_transferFamilyIndex;
+    uint32_t m_graphicsFamilyIndex;
+
+    VkSemaphore m_timelineSemaphore = VK_NULL_HANDLE;
+    // value signaled by the last transfer submission
+    uint64_t m_timelineValue = 0;
+
+    // acquisitions of the resources submitted since the last recordAcquire
+    std::vector<VkBufferMemoryBarrier> m_bufferBarriers;
+    std::vector<VkImageMemoryBarrier> m_imageBarriers;
+
+    // the transfer queue is shared by the upload contexts of every thread
+    std::mutex m_mutex;
+
+  public:
+    // stages reading the uploaded resources, the defragmenter copies included
+    static constexpr VkPipelineStageFlags consumerStageMask =
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    static constexpr VkAccessFlags consumerAccessMask =
+        VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+        VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    TransferHandoff(VkDevice device, VkQueue transferQueue, uint32_t transferFamilyIndex,
+                    uint32_t graphicsFamilyIndex);
+    ~TransferHandoff();
+
+    TransferHandoff(const TransferHandoff &) = delete;
+    TransferHandoff &operator=(const TransferHandoff &) = delete;
+    TransferHandoff(TransferHandoff &&) = delete;
+    TransferHandoff &operator=(TransferHandoff &&) = delete;
+
+    /**
+     * @brief Release the uploaded resources, end and submit the transfer command buffer
+     *
+     * The barriers transfer the ownership of the written ranges and images from the transfer queue family to
+     * the graphics one, images are left in the layout they are sampled in.
+     * @param fence signaled once the copies are complete
+     */
+    [[nodiscard]] bool submit(VkCommandBuffer commandBuffer, VkFence fence,
+                              std::span<const VkBufferMemoryBarrier> bufferBarriers,
+                              std::span<const VkImageMemoryBarrier> imageBarriers);
+
+    /**
+     * @brief Record the acquisition of every resource submitted since the last call in a graphics command buffer
+     *
+     * @return the timeline value the submission of the command buffer waits on at consumerStageMask, 0 if
+     * nothing was acquired
+     */
+    [[nodiscard]] uint64_t recordAcquire(VkCommandBuffer commandBuffer);
+
+  public:
+    [[nodiscard]] inline VkSemaphore getTimelineSemaphore() const
+    {
+        return m_timelineSemaphore;
+    }
+    [[nodiscard]] inline uint32_t getTransferFamilyIndex() const
+    {
+        return m_transferFamilyIndex;
+    }
+    [[nodiscard]] inline uint32_t getGraphicsFamilyIndex() const
+    {
+        return m_graphicsFamilyIndex;
+    }
+};
@@ -0,0 +1,84 @@
+#include <cassert>
+#include <iostream>
+
+#include "buffer.hpp"
+#include "device.hpp"
+
+#include "uniform_ring_buffer.hpp"
+
+UniformRingBuffer::~UniformRingBuffer()
+{
+    if (auto devicePtr = m_device.lock())
+        devicePtr->getDescriptorAllocator()->evictSets(getBufferHandle());
+    m_buffer.reset();
+}
+
+void UniformRingBuffer::beginFrame(uint32_t frameIndex)
+{
+    assert(frameIndex < m_frameCount);
+
+    m_frameIndex = frameIndex;
+    m_head = 0;
+}
+
+std::optional<UniformSliceT> UniformRingBuffer::allocate(VkDeviceSize size)
+{
+    VkDeviceSize alignedSize = (size + m_alignment - 1) & ~(m_alignment - 1);
+    if (m_head + alignedSize > m_frameSize)
+    {
+        std::cerr << "Uniform ring buffer frame region is full (" << m_frameSize << " bytes)" << std::endl;
+        return std::optional<UniformSliceT>();
+    }
+
+    VkDeviceSize offset = m_frameIndex * m_frameSize + m_head;
+    m_head += alignedSize;
+
+    return std::optional<UniformSliceT>(UniformSliceT{
+        .offset = offset,
+        .size = size,
+    });
+}
+
+void UniformRingBuffer::write(const UniformSliceT &slice, std::span<const std::byte> data)
+{
+    assert(data.size() <= slice.size);
+
+    m_buffer->write(slice.offset, data);
+}
+
+void UniformRingBuffer::flush()
+{
+    m_buffer->flush();
+}
+
+VkBuffer UniformRingBuffer::getBufferHandle() const
+{
+    return m_buffer->getHandle();
+}
+
+std::unique_ptr<UniformRingBuffer> UniformRingBufferBuilder::build()
+{
+    assert(m_device.lock());
+    assert(m_frameCount > 0);
+
+    auto devicePtr = m_device.lock();
+
+    // dynamic offsets must be multiples of minUniformBufferOffsetAlignment (always a power of two)
+    VkDeviceSize alignment = devicePtr->getPhysicalDeviceProperties().limits.minUniformBufferOffsetAlignment;
+    m_product->m_alignment = alignment;
+    m_product->m_frameSize = (m_frameSize + alignment - 1) & ~(alignment - 1);
+    m_product->m_frameCount = m_frameCount;
+
+    BufferBuilder bb;
+    BufferDirector bd;
+    bd.createUniformBufferBuilder(bb);
+    bb.setDevice(m_device);
+    bb.setSize(m_product->m_frameSize * m_frameCount);
+    m_product->m_buffer = bb.build();
+    if (!m_product->m_buffer)
+        return nullptr;
+
+    auto result = std::move(m_product);
+    restart();
+    return result;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <span>
+
+#include <vulkan/vulkan.h>
+
+class Device;
+class Buffer;
+class UniformRingBufferBuilder;
+
+struct UniformSliceT
+{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+/**
+ * @brief Persistently mapped uniform buffer split in one region per frame in flight
+ *
+ * Slices are bump-allocated in the region of the current frame and bound with dynamic offsets.
+ * A region is reset by beginFrame() once the GPU is done with the frame that last used it.
+ * Slices are filled with write() and flushed together by flush() before the frame is submitted.
+ */
+class UniformRingBuffer
+{
+    friend UniformRingBufferBuilder;
+
+  private:
+    std::weak_ptr<Device> m_device;
+
+    std::unique_ptr<Buffer> m_buffer;
+
+    VkDeviceSize m_alignment;
+    VkDeviceSize m_frameSize;
+    uint32_t m_frameCount;
+
+    uint32_t m_frameIndex = 0;
+    VkDeviceSize m_head = 0;
+
+    UniformRingBuffer() = default;
+
+  public:
+    ~UniformRingBuffer();
+
+    UniformRingBuffer(const UniformRingBuffer &) = delete;
+    UniformRingBuffer &operator=(const UniformRingBuffer &) = delete;
+    UniformRingBuffer(UniformRingBuffer &&) = delete;
+    UniformRingBuffer &operator=(UniformRingBuffer &&) = delete;
+
+    void beginFrame(uint32_t frameIndex);
+
+    [[nodiscard]] std::optional<UniformSliceT> allocate(VkDeviceSize size);
+    void write(const UniformSliceT &slice, std::span<const std::byte> data);
+    void flush();
+
+  public:
+    [[nodiscard]] VkBuffer getBufferHandle() const;
+
+    [[nodiscard]] inline uint32_t getFrameIndex() const
+    {
+        return m_frameIndex;
+    }
+    [[nodiscard]] inline uint32_t getFrameCount() const
+    {
+        return m_frameCount;
+    }
+};
+
+class UniformRingBufferBuilder
+{
+  private:
+    std::unique_ptr<UniformRingBuffer> m_product;
+
+    std::weak_ptr<Device> m_device;
+
+    VkDeviceSize m_frameSize = 4 * 1024 * 1024;
+    uint32_t m_frameCount = 2;
+
+    void restart()
+    {
+        m_product = std::unique_ptr<UniformRingBuffer>(new UniformRingBuffer);
+    }
+
+  public:
+    UniformRingBufferBuilder()
+    {
+        restart();
+    }
+
+    void setDevice(std::weak_ptr<Device> device)
+    {
+        m_device = device;
+        m_product->m_device = device;
+    }
+    void setFrameSize(VkDeviceSize a)
+    {
+        m_frameSize = a;
+    }
+    void setFrameCount(uint32_t a)
+    {
+        m_frameCount = a;
+    }
+
+    std::unique_ptr<UniformRingBuffer> build();
+};
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "buffer.hpp"
+#include "device.hpp"
+#include "image.hpp"
+
+#include "upload_context.hpp"
+
+UploadContext::~UploadContext()
+{
+    if (!m_device.lock())
+        return;
+
+    submit();
+    wait();
+
+    auto deviceHandle = m_device.lock()->getHandle();
+
+    m_stagingBuffers.clear();
+    vkDestroyFence(deviceHandle, m_fence, nullptr);
+    vkDestroyCommandPool(deviceHandle, m_commandPool, nullptr);
+}
+
+void UploadContext::beginRecording()
+{
+    if (m_bRecording)
+        return;
+
+    // the command buffer and the staging memory are still in use by the previous batch
+    wait();
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkResult res = vkBeginCommandBuffer(m_commandBuffer, &beginInfo);
+    if (res != VK_SUCCESS)
+        std::cerr << "Failed to begin upload command buffer : " << res << std::endl;
+
+    m_bRecording = true;
+}
+
+bool UploadContext::allocateStaging(VkDeviceSize size, VkBuffer &buffer, VkDeviceSize &offset, void *&data)
+{
+    // flush the batch when it grows over budget so staging memory does not grow without bound
+    if (m_stagingUsed > 0 && m_stagingUsed + size > m_stagingBudget)
+    {
+        submit();
+        wait();
+        beginRecording();
+    }
+
+    // 16 bytes covers the texel size and the 4 bytes alignment required by buffer to image copies
+    m_stagingHead = (m_stagingHead + 15) & ~VkDeviceSize(15);
+    while (m_stagingIndex < m_stagingBuffers.size() &&
+           m_stagingHead + size > m_stagingBuffers[m_stagingIndex]->getSize())
+    {
+        ++m_stagingIndex;
+        m_stagingHead = 0;
+    }
+
+    if (m_stagingIndex == m_stagingBuffers.size())
+    {
+        BufferBuilder bb;
+        BufferDirector bd;
+        bd.createStagingBufferBuilder(bb);
+        bb.setDevice(m_device);
+        bb.setSize(std::max(m_stagingBufferSize, size));
+        std::unique_ptr<Buffer> stagingBuffer = bb.build();
+        if (!stagingBuffer)
+            return false;
+        m_stagingBuffers.emplace_back(std::move(stagingBuffer));
+        m_stagingHead = 0;
+    }
+
+    Buffer &stagingBuffer = *m_stagingBuffers[m_stagingIndex];
+    buffer = stagingBuffer.getHandle();
+    offset = m_stagingHead;
+    data = static_cast<char *>(stagingBuffer.getMappedData()) + m_stagingHead;
+
+    m_stagingHead += size;
+    m_stagingUsed += size;
+    return true;
+}
+
+void UploadContext::resetStaging()
+{
+    m_stagingIndex = 0;
+    m_stagingHead = 0;
+    m_stagingUsed = 0;
+}
+
+void UploadContext::uploadBuffer(Buffer &dst, const void *srcData, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+    beginRecording();
+
+    VkBuffer stagingBuffer;
+    VkDeviceSize stagingOffset;
+    void *stagingData;
+    if (!allocateStaging(size, stagingBuffer, stagingOffset, stagingData))
+        return;
+
+    memcpy(stagingData, srcData, size);
+    dst.recordTransferBufferToBuffer(m_commandBuffer, stagingBuffer, stagingOffset, size, dstOffset);
+
+    if (!m_bUseTransferQueue)
+        return;
+
+    TransferHandoff *handoff = m_device.lock()->getTransferHandoff();
+    m_bufferOwnershipBarriers.emplace_back(VkBufferMemoryBarrier{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = TransferHandoff::consumerAccessMask,
+        .srcQueueFamilyIndex = handoff->getTransferFamilyIndex(),
+        .dstQueueFamilyIndex = handoff->getGraphicsFamilyIndex(),
+        .buffer = dst.getHandle(),
+        .offset = dstOffset,
+        .size = size,
+    });
+}
+
+void UploadContext::uploadImage(Image &dst, const void *srcData, VkDeviceSize size)
+{
+    beginRecording();
+
+    VkBuffer stagingBuffer;
+    VkDeviceSize stagingOffset;
+    void *stagingData;
+    if (!allocateStaging(size, stagingBuffer, stagingOffset, stagingData))
+        return;
+
+    memcpy(stagingData, srcData, size);
+
+    ImageLayoutTransitionBuilder iltb;
+    ImageLayoutTransitionDirector iltd;
+
+    iltd.createBuilder<VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL>(iltb);
+    iltb.setImage(dst);
+    dst.recordTransitionImageLayout(m_commandBuffer, *iltb.build());
+
+    dst.recordCopyBufferToImage(m_commandBuffer, stagingBuffer, stagingOffset);
+
+    iltd.createBuilder<VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL>(iltb);
+    iltb.setImage(dst);
+    if (!m_bUseTransferQueue)
+    {
+        dst.recordTransitionImageLayout(m_commandBuffer, *iltb.build());
+        return;
+    }
+
+    // the transition to the sampled layout happens with the queue family ownership transfer
+    TransferHandoff *handoff = m_device.lock()->getTransferHandoff();
+    iltb.setSrcQueueFamilyIndex(handoff->getTransferFamilyIndex());
+    iltb.setDstQueueFamilyIndex(handoff->getGraphicsFamilyIndex());
+    m_imageOwnershipBarriers.emplace_back(iltb.build()->barrier);
+}
+
+void UploadContext::submit()
+{
+    if (!m_bRecording)
+        return;
+
+    auto devicePtr = m_device.lock();
+    m_bRecording = false;
+
+    if (m_bUseTransferQueue)
+    {
+        // the frames acquire the resources, only the ones using them wait for the copies
+        bool bSubmitted = devicePtr->getTransferHandoff()->submit(m_commandBuffer, m_fence, m_bufferOwnershipBarriers,
+                                                                  m_imageOwnershipBarriers);
+        m_bufferOwnershipBarriers.clear();
+        m_imageOwnershipBarriers.clear();
+        if (!bSubmitted)
+        {
+            resetStaging();
+            return;
+        }
+
+        // the staging memory is in use until the fence is waited on
+        m_bPending = true;
+        return;
+    }
+
+    // make the buffer copies visible to every later use of the uploaded data
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT |
+                         VK_ACCESS_SHADER_READ_BIT,
+    };
+    vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+
+    vkEndCommandBuffer(m_commandBuffer);
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &m_commandBuffer,
+    };
+    VkResult res = vkQueueSubmit(devicePtr->getGraphicsQueue(), 1, &submitInfo, m_fence);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to submit upload command buffer : " << res << std::endl;
+        resetStaging();
+        return;
+    }
+
+    m_bPending = true;
+}
+
+bool UploadContext::poll()
+{
+    if (!m_bPending)
+        return true;
+
+    auto deviceHandle = m_device.lock()->getHandle();
+    if (vkGetFenceStatus(deviceHandle, m_fence) != VK_SUCCESS)
+        return false;
+
+    vkResetFences(deviceHandle, 1, &m_fence);
+    resetStaging();
+    m_bPending = false;
+    return true;
+}
+
+void UploadContext::wait()
+{
+    if (!m_bPending)
+        return;
+
+    vkWaitForFences(m_device.lock()->getHandle(), 1, &m_fence, VK_TRUE, UINT64_MAX);
+    poll();
+}
+
+std::unique_ptr<UploadContext> UploadContextBuilder::build()
+{
+    assert(m_device.lock());
+
+    auto devicePtr = m_device.lock();
+    auto deviceHandle = devicePtr->getHandle();
+
+    m_product->m_stagingBufferSize = m_stagingBufferSize;
+    m_product->m_stagingBudget = m_stagingBudget;
+    m_product->m_bUseTransferQueue = m_bUseTransferQueue && devicePtr->getTransferHandoff() != nullptr;
+
+    uint32_t uploadFamilyIndex = m_product->m_bUseTransferQueue ? devicePtr->getTransferFamilyIndex().value()
+                                                                : devicePtr->getGraphicsFamilyIndex().value();
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = uploadFamilyIndex,
+    };
+    VkResult res = vkCreateCommandPool(deviceHandle, &commandPoolCreateInfo, nullptr, &m_product->m_commandPool);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create upload command pool : " << res << std::endl;
+        return nullptr;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = m_product->m_commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    res = vkAllocateCommandBuffers(deviceHandle, &allocInfo, &m_product->m_commandBuffer);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to allocate upload command buffer : " << res << std::endl;
+        return nullptr;
+    }
+
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+    };
+    res = vkCreateFence(deviceHandle, &fenceCreateInfo, nullptr, &m_product->m_fence);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create upload fence : " << res << std::endl;
+        return nullptr;
+    }
+
+    auto result = std::move(m_product);
+    restart();
+    return result;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+class Device;
+class Buffer;
+class Image;
+class UploadContextBuilder;
+
+/**
+ * @brief Batches staging copies and layout transitions into a single submission
+ *
+ * Data is written in a pool of persistently mapped staging buffers and every copy and barrier
+ * is recorded in one command buffer. submit() sends the batch with a fence the caller can poll or
+ * wait on. Staging memory is recycled once the batch is complete.
+ *
+ * When the device has a transfer only queue family, copies run on the transfer queue so they do not
+ * stall rendering. Ownership of the uploaded resources is then released to the graphics queue and the
+ * next frame acquires them (see TransferHandoff), the fence only tells that the copies are complete.
+ */
+class UploadContext
+{
+    friend UploadContextBuilder;
+
+  private:
+    std::weak_ptr<Device> m_device;
+
+    VkCommandPool m_commandPool;
+    VkCommandBuffer m_commandBuffer;
+    VkFence m_fence;
+
+    // transfer queue path, the ownership of the uploaded resources is handed to the graphics queue
+    bool m_bUseTransferQueue = false;
+    std::vector<VkBufferMemoryBarrier> m_bufferOwnershipBarriers;
+    std::vector<VkImageMemoryBarrier> m_imageOwnershipBarriers;
+
+    bool m_bRecording = false;
+    bool m_bPending = false;
+
+    // staging arena
+    std::vector<std::unique_ptr<Buffer>> m_stagingBuffers;
+    size_t m_stagingIndex = 0;
+    VkDeviceSize m_stagingHead = 0;
+    VkDeviceSize m_stagingBufferSize;
+    VkDeviceSize m_stagingBudget;
+    VkDeviceSize m_stagingUsed = 0;
+
+    UploadContext() = default;
+
+    void beginRecording();
+
+    [[nodiscard]] bool allocateStaging(VkDeviceSize size, VkBuffer &buffer, VkDeviceSize &offset, void *&data);
+    void resetStaging();
+
+  public:
+    ~UploadContext();
+
+    UploadContext(const UploadContext &) = delete;
+    UploadContext &operator=(const UploadContext &) = delete;
+    UploadContext(UploadContext &&) = delete;
+    UploadContext &operator=(UploadContext &&) = delete;
+
+    /**
+     * @brief Stage data and record a copy into a device local buffer
+     *
+     */
+    void uploadBuffer(Buffer &dst, const void *srcData, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+    /**
+     * @brief Stage texels and record the transitions and the copy that leave the image ready for sampling
+     *
+     */
+    void uploadImage(Image &dst, const void *srcData, VkDeviceSize size);
+
+    /**
+     * @brief Submit every recorded command (does nothing if nothing was recorded)
+     *
+     */
+    void submit();
+    /**
+     * @brief Check if the last submission is complete, staging memory is recycled if so
+     *
+     * @return true if there is no pending submission
+     */
+    bool poll();
+    void wait();
+
+  public:
+    [[nodiscard]] inline bool isRecording() const
+    {
+        return m_bRecording;
+    }
+    [[nodiscard]] inline bool usesTransferQueue() const
+    {
+        return m_bUseTransferQueue;
+    }
+};
+
+class UploadContextBuilder
+{
+  private:
+    std::unique_ptr<UploadContext> m_product;
+
+    std::weak_ptr<Device> m_device;
+
+    VkDeviceSize m_stagingBufferSize = 16 * 1024 * 1024;
+    VkDeviceSize m_stagingBudget = 256 * 1024 * 1024;
+    bool m_bUseTransferQueue = true;
+
+    void restart()
+    {
+        m_product = std::unique_ptr<UploadContext>(new UploadContext);
+    }
+
+  public:
+    UploadContextBuilder()
+    {
+        restart();
+    }
+
+    void setDevice(std::weak_ptr<Device> device)
+    {
+        m_device = device;
+        m_product->m_device = device;
+    }
+    void setStagingBufferSize(VkDeviceSize a)
+    {
+        m_stagingBufferSize = a;
+    }
+    /**
+     * @brief Amount of staging memory a batch may use before it is flushed automatically
+     *
+     */
+    void setStagingBudget(VkDeviceSize a)
+    {
+        m_stagingBudget = a;
+    }
+    /**
+     * @brief Use the transfer only queue family when available (falls back to the graphics queue)
+     *
+     */
+    void setUseTransferQueue(bool bUse)
+    {
+        m_bUseTransferQueue = bUse;
+    }
+
+    std::unique_ptr<UploadContext> build();
+};
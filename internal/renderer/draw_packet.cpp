@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <array>
+
+#include "draw_packet.hpp"
+
+// pass | pipeline | material | mesh | depth
+constexpr uint32_t pass_bit_count = 4;
+constexpr uint32_t pipeline_bit_count = 16;
+constexpr uint32_t material_bit_count = 16;
+constexpr uint32_t mesh_bit_count = 16;
+constexpr uint32_t depth_bit_count = 12;
+static_assert(pass_bit_count + pipeline_bit_count + material_bit_count + mesh_bit_count + depth_bit_count == 64);
+
+// spreads handles and pointers, which mostly differ by their middle bits, over the kept bits
+uint64_t hash_bits(uint64_t value, uint32_t bitCount)
+{
+    return (value * 0x9E3779B97F4A7C15ULL) >> (64 - bitCount);
+}
+
+uint64_t make_draw_state_key(const DrawPacketT &packet)
+{
+    uint64_t key = std::min<uint64_t>(packet.pass, (1 << pass_bit_count) - 1);
+    key = (key << pipeline_bit_count) | hash_bits(reinterpret_cast<uint64_t>(packet.pipeline), pipeline_bit_count);
+    key = (key << material_bit_count) | hash_bits(packet.materialId, material_bit_count);
+    key = (key << mesh_bit_count) | hash_bits(reinterpret_cast<uint64_t>(packet.vertexBuffer), mesh_bit_count);
+    return key << depth_bit_count;
+}
+
+uint64_t make_draw_sort_key(uint64_t stateKey, float depth)
+{
+    uint64_t quantizedDepth = static_cast<uint64_t>(std::clamp(depth, 0.f, 1.f) * ((1 << depth_bit_count) - 1));
+    return stateKey | quantizedDepth;
+}
+
+bool can_share_draw_state(const DrawPacketT &a, const DrawPacketT &b)
+{
+    // the key hashes may collide, the fields are compared
+    return a.pass == b.pass && a.pipeline == b.pipeline && a.materialSet == b.materialSet &&
+           a.vertexBuffer == b.vertexBuffer && a.indexBuffer == b.indexBuffer &&
+           (a.dynamicState == b.dynamicState || *a.dynamicState == *b.dynamicState);
+}
+
+bool can_instance_draws(const DrawPacketT &a, const DrawPacketT &b)
+{
+    return can_share_draw_state(a, b) && a.indexCount == b.indexCount && a.firstIndex == b.firstIndex &&
+           a.vertexOffset == b.vertexOffset;
+}
+
+void radix_sort_draws(std::vector<DrawSortEntryT> &entries, std::vector<DrawSortEntryT> &scratch)
+{
+    if (entries.size() < 2)
+        return;
+
+    scratch.resize(entries.size());
+
+    // digits of a byte, the bytes shared by every key are skipped
+    uint64_t differingBits = 0;
+    for (const DrawSortEntryT &entry : entries)
+        differingBits |= entry.sortKey ^ entries.front().sortKey;
+
+    for (uint32_t shift = 0; shift < 64; shift += 8)
+    {
+        if (((differingBits >> shift) & 0xFF) == 0)
+            continue;
+
+        std::array<size_t, 256> offsets = {};
+        for (const DrawSortEntryT &entry : entries)
+            ++offsets[(entry.sortKey >> shift) & 0xFF];
+
+        size_t offset = 0;
+        for (size_t &count : offsets)
+        {
+            size_t digitCount = count;
+            count = offset;
+            offset += digitCount;
+        }
+
+        for (const DrawSortEntryT &entry : entries)
+            scratch[offsets[(entry.sortKey >> shift) & 0xFF]++] = entry;
+        entries.swap(scratch);
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "graphics/dynamic_state.hpp"
+
+#include "engine/instance_data.hpp"
+
+class Pipeline;
+
+/**
+ * @brief Everything a draw records, gathered from its render state when the state changes
+ *
+ * Packets are plain data so that recording walks a flat array instead of the render states. The
+ * pointers are owned by the render states, which outlive the recording of the frame.
+ */
+struct DrawPacketT
+{
+    // false if the state has nothing to draw, the other fields are then left unset
+    bool bDrawable;
+
+    // sort key without the depth, see make_draw_state_key
+    uint64_t stateKey;
+
+    // passes are drawn in increasing order, there is a single opaque pass for now
+    uint8_t pass;
+
+    const Pipeline *pipeline;
+    const DynamicStateT *dynamicState;
+    // VK_NULL_HANDLE for bindless pipelines
+    VkDescriptorSet materialSet;
+    // bindless slot or material set, telling materials apart in the sort key
+    uint64_t materialId;
+
+    // mesh range
+    VkBuffer vertexBuffer;
+    VkBuffer indexBuffer;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+
+    // instance data
+    InstanceData instance;
+};
+
+// position of a packet in the sorted order
+struct DrawSortEntryT
+{
+    uint64_t sortKey;
+    uint32_t packetIndex;
+};
+
+// consecutive sorted draws recorded as a single instanced draw
+struct DrawBatchT
+{
+    // packet of the first instance, its state is shared by the whole batch
+    uint32_t packetIndex;
+    // range of the instance buffer, in the sorted order of the draws
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+// consecutive batches sharing their bound state, recorded with a single indirect draw
+struct DrawBucketT
+{
+    // range of the batches, and of the indirect commands in the same order
+    uint32_t firstBatch;
+    uint32_t batchCount;
+};
+
+/**
+ * @brief Part of the sort key ordering the draws by pass, pipeline, material then mesh
+ *
+ * The pipeline, material and mesh fields hold hashes, draws sharing them are grouped together so that
+ * their binds are skipped (see CommandRecorder), a collision only costs a bind.
+ */
+[[nodiscard]] uint64_t make_draw_state_key(const DrawPacketT &packet);
+/**
+ * @brief Key ordering the draws of the same state front to back
+ *
+ * @param depth distance to the camera normalized to [0, 1]
+ */
+[[nodiscard]] uint64_t make_draw_sort_key(uint64_t stateKey, float depth);
+
+/**
+ * @brief Sort the entries by key with a least significant digit radix sort, keeping the order of equal keys
+ *
+ * @param scratch buffer of the passes, reused between the calls
+ */
+void radix_sort_draws(std::vector<DrawSortEntryT> &entries, std::vector<DrawSortEntryT> &scratch);
+
+/**
+ * @brief Whether two draws bind the same pipeline, descriptor sets, buffers and dynamic state
+ *
+ */
+[[nodiscard]] bool can_share_draw_state(const DrawPacketT &a, const DrawPacketT &b);
+/**
+ * @brief Whether two draws only differ by their instance data and can be merged in an instanced draw
+ *
+ */
+[[nodiscard]] bool can_instance_draws(const DrawPacketT &a, const DrawPacketT &b);
@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#include "graphics/buffer.hpp"
+#include "graphics/device.hpp"
+#include "graphics/uniform_ring_buffer.hpp"
+
+#include "engine/instance_data.hpp"
+
+#include "frame_context.hpp"
+
+// replace a buffer of the frame too small for the given size, grown geometrically so that a growing scene
+// reallocates a few times only
+template <typename T>
+T *reserve_frame_buffer(std::weak_ptr<Device> device, std::unique_ptr<Buffer> &buffer, uint32_t count,
+                        void (BufferDirector::*createBuilder)(BufferBuilder &))
+{
+    size_t capacity = buffer ? buffer->getSize() / sizeof(T) : 0;
+    if (count <= capacity)
+        return static_cast<T *>(buffer->getMappedData());
+
+    BufferBuilder bb;
+    BufferDirector bd;
+    (bd.*createBuilder)(bb);
+    bb.setDevice(device);
+    bb.setSize(std::max<size_t>({count, capacity * 2, 1024}) * sizeof(T));
+    buffer = bb.build();
+    if (!buffer)
+        return nullptr;
+
+    return static_cast<T *>(buffer->getMappedData());
+}
+
+FrameContext::~FrameContext()
+{
+    auto devicePtr = m_device.lock();
+    if (!devicePtr)
+        return;
+
+    auto deviceHandle = devicePtr->getHandle();
+
+    vkDestroyFence(deviceHandle, m_inFlightFence, nullptr);
+    vkDestroySemaphore(deviceHandle, m_acquireSemaphore, nullptr);
+    // the command buffers are freed with their pool
+    for (VkCommandPool commandPool : m_secondaryCommandPools)
+        vkDestroyCommandPool(deviceHandle, commandPool, nullptr);
+    vkDestroyCommandPool(deviceHandle, m_commandPool, nullptr);
+}
+
+uint64_t FrameContext::begin(UniformRingBuffer &uniformRing)
+{
+    auto devicePtr = m_device.lock();
+    auto deviceHandle = devicePtr->getHandle();
+
+    // the fence is reset when submitting, a frame that is not submitted does not block the next one
+    vkWaitForFences(deviceHandle, 1, &m_inFlightFence, VK_TRUE, UINT64_MAX);
+
+    devicePtr->getDeletionQueue()->collect(m_frameSerial);
+    devicePtr->getDescriptorAllocator()->beginFrame(m_frameIndex);
+    uniformRing.beginFrame(m_frameIndex);
+
+    VkResult res = vkResetCommandPool(deviceHandle, m_commandPool, 0);
+    if (res != VK_SUCCESS)
+        std::cerr << "Failed to reset frame command pool : " << res << std::endl;
+    for (VkCommandPool commandPool : m_secondaryCommandPools)
+    {
+        res = vkResetCommandPool(deviceHandle, commandPool, 0);
+        if (res != VK_SUCCESS)
+            std::cerr << "Failed to reset frame command pool : " << res << std::endl;
+    }
+
+    return m_frameSerial;
+}
+
+bool FrameContext::submit(VkQueue queue, VkSemaphore renderSemaphore)
+{
+    auto devicePtr = m_device.lock();
+
+    // the swapchain image is waited on first, the binary semaphore value is ignored
+    std::vector<VkSemaphore> waitSemaphores = {m_acquireSemaphore};
+    std::vector<uint64_t> waitValues = {0};
+    std::vector<VkPipelineStageFlags> waitStages = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    waitSemaphores.insert(waitSemaphores.end(), m_timelineWaitSemaphores.begin(), m_timelineWaitSemaphores.end());
+    waitValues.insert(waitValues.end(), m_timelineWaitValues.begin(), m_timelineWaitValues.end());
+    waitStages.insert(waitStages.end(), m_timelineWaitStages.begin(), m_timelineWaitStages.end());
+    m_timelineWaitSemaphores.clear();
+    m_timelineWaitValues.clear();
+    m_timelineWaitStages.clear();
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size()),
+        .pWaitSemaphoreValues = waitValues.data(),
+    };
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = waitSemaphores.size() > 1 ? &timelineInfo : nullptr,
+        .waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
+        .pWaitSemaphores = waitSemaphores.data(),
+        .pWaitDstStageMask = waitStages.data(),
+        .commandBufferCount = 1,
+        .pCommandBuffers = &m_commandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &renderSemaphore,
+    };
+
+    vkResetFences(devicePtr->getHandle(), 1, &m_inFlightFence);
+    VkResult res = vkQueueSubmit(queue, 1, &submitInfo, m_inFlightFence);
+
+    // objects released while recording this frame are destroyed once its fence is waited on
+    m_frameSerial = devicePtr->getDeletionQueue()->endFrame();
+
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to submit draw command buffer : " << res << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void FrameContext::waitTimeline(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stageMask)
+{
+    m_timelineWaitSemaphores.emplace_back(semaphore);
+    m_timelineWaitValues.emplace_back(value);
+    m_timelineWaitStages.emplace_back(stageMask);
+}
+
+InstanceData *FrameContext::reserveInstances(uint32_t count)
+{
+    // a new buffer holds none of the instances
+    if (!m_instanceBuffer || count > m_instanceBuffer->getSize() / sizeof(InstanceData))
+        m_instanceSources.clear();
+    m_instanceSources.resize(count, UINT32_MAX);
+
+    InstanceData *instances = reserve_frame_buffer<InstanceData>(m_device, m_instanceBuffer, count,
+                                                         &BufferDirector::createInstanceBufferBuilder);
+    if (!instances)
+        std::cerr << "Failed to allocate an instance buffer of " << count << " instance(s)" << std::endl;
+    return instances;
+}
+
+void FrameContext::beginInstanceWrites(uint64_t packetVersion)
+{
+    if (m_instanceVersion == packetVersion)
+        return;
+
+    std::fill(m_instanceSources.begin(), m_instanceSources.end(), UINT32_MAX);
+    m_instanceVersion = packetVersion;
+}
+
+VkDrawIndexedIndirectCommand *FrameContext::reserveIndirectCommands(uint32_t count)
+{
+    VkDrawIndexedIndirectCommand *commands = reserve_frame_buffer<VkDrawIndexedIndirectCommand>(
+        m_device, m_indirectBuffer, count, &BufferDirector::createIndirectBufferBuilder);
+    if (!commands)
+        std::cerr << "Failed to allocate an indirect buffer of " << count << " command(s)" << std::endl;
+    return commands;
+}
+
+VkBuffer FrameContext::getInstanceBuffer() const
+{
+    return m_instanceBuffer ? m_instanceBuffer->getHandle() : VK_NULL_HANDLE;
+}
+
+VkBuffer FrameContext::getIndirectBuffer() const
+{
+    return m_indirectBuffer ? m_indirectBuffer->getHandle() : VK_NULL_HANDLE;
+}
+
+std::unique_ptr<FrameContext> FrameContextBuilder::build()
+{
+    assert(m_device.lock());
+
+    auto devicePtr = m_device.lock();
+    auto deviceHandle = devicePtr->getHandle();
+
+    // the buffer is never reset on its own, the whole pool is reset when the frame starts again
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = devicePtr->getGraphicsFamilyIndex().value(),
+    };
+    VkResult res = vkCreateCommandPool(deviceHandle, &commandPoolCreateInfo, nullptr, &m_product->m_commandPool);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create frame command pool : " << res << std::endl;
+        return nullptr;
+    }
+
+    VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = m_product->m_commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1U,
+    };
+    res = vkAllocateCommandBuffers(deviceHandle, &commandBufferAllocInfo, &m_product->m_commandBuffer);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to allocate command buffers : " << res << std::endl;
+        return nullptr;
+    }
+
+    for (uint32_t i = 0; i < m_secondaryCommandBufferCount; ++i)
+    {
+        VkCommandPool &commandPool = m_product->m_secondaryCommandPools.emplace_back(VK_NULL_HANDLE);
+        res = vkCreateCommandPool(deviceHandle, &commandPoolCreateInfo, nullptr, &commandPool);
+        if (res != VK_SUCCESS)
+        {
+            std::cerr << "Failed to create frame command pool : " << res << std::endl;
+            return nullptr;
+        }
+
+        VkCommandBufferAllocateInfo secondaryAllocInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = commandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1U,
+        };
+        VkCommandBuffer &commandBuffer = m_product->m_secondaryCommandBuffers.emplace_back(VK_NULL_HANDLE);
+        res = vkAllocateCommandBuffers(deviceHandle, &secondaryAllocInfo, &commandBuffer);
+        if (res != VK_SUCCESS)
+        {
+            std::cerr << "Failed to allocate command buffers : " << res << std::endl;
+            return nullptr;
+        }
+    }
+
+    // synchronization
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    };
+    res = vkCreateSemaphore(deviceHandle, &semaphoreCreateInfo, nullptr, &m_product->m_acquireSemaphore);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create semaphore : " << res << std::endl;
+        return nullptr;
+    }
+
+    // the first wait returns immediately
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+    };
+    res = vkCreateFence(deviceHandle, &fenceCreateInfo, nullptr, &m_product->m_inFlightFence);
+    if (res != VK_SUCCESS)
+    {
+        std::cerr << "Failed to create fence : " << res << std::endl;
+        return nullptr;
+    }
+
+    auto result = std::move(m_product);
+    return result;
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+class Device;
+class Buffer;
+class InstanceData;
+class UniformRingBuffer;
+class FrameContextBuilder;
+
+/**
+ * @brief Resources of a frame in flight, reused once the GPU is done with the frame that last used them
+ *
+ * The frame index selects the region of every per frame resource : the uniform ring region, the
+ * descriptor allocator frame chain and this context's command pool. Deletions are tagged with the serial
+ * of the frame that released them (see DeletionQueue). The number of frames in flight is independent of
+ * the number of swapchain images.
+ */
+class FrameContext
+{
+    friend FrameContextBuilder;
+
+  private:
+    std::weak_ptr<Device> m_device;
+
+    uint32_t m_frameIndex = 0;
+
+    // reset in bulk when the frame starts again, its command buffer is recorded once per submission
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+
+    // one pool per recording thread, command pools must not be used by several threads at once
+    std::vector<VkCommandPool> m_secondaryCommandPools;
+    std::vector<VkCommandBuffer> m_secondaryCommandBuffers;
+
+    // per instance data and indirect commands of the frame's draws, grown when a frame draws more
+    std::unique_ptr<Buffer> m_instanceBuffer;
+    std::unique_ptr<Buffer> m_indirectBuffer;
+
+    // draw packet each instance of the buffer was written from and the version of the packets then, an
+    // instance written from the same packet of the same version is not written again
+    std::vector<uint32_t> m_instanceSources;
+    uint64_t m_instanceVersion = 0;
+
+    VkSemaphore m_acquireSemaphore = VK_NULL_HANDLE;
+    VkFence m_inFlightFence = VK_NULL_HANDLE;
+
+    // timeline semaphores the next submission waits on besides the image acquisition (see TransferHandoff)
+    std::vector<VkSemaphore> m_timelineWaitSemaphores;
+    std::vector<uint64_t> m_timelineWaitValues;
+    std::vector<VkPipelineStageFlags> m_timelineWaitStages;
+
+    // deletion queue serial of the last submission of this frame
+    uint64_t m_frameSerial = 0;
+
+    FrameContext() = default;
+
+  public:
+    ~FrameContext();
+
+    FrameContext(const FrameContext &) = delete;
+    FrameContext &operator=(const FrameContext &) = delete;
+    FrameContext(FrameContext &&) = delete;
+    FrameContext &operator=(FrameContext &&) = delete;
+
+    /**
+     * @brief Wait for the last submission of this frame then release its per frame resources
+     *
+     * The deletions up to its serial are run, its uniform region and descriptor sets are reset and its
+     * command pools are reset.
+     * @return the serial of the retired frame, every older frame is retired too
+     */
+    uint64_t begin(UniformRingBuffer &uniformRing);
+
+    /**
+     * @brief Submit the recorded command buffer and close the frame in the deletion queue
+     *
+     * @param renderSemaphore signaled once the commands are executed
+     */
+    bool submit(VkQueue queue, VkSemaphore renderSemaphore);
+
+    /**
+     * @brief Make the next submission wait for a timeline semaphore value at the given stages only
+     *
+     */
+    void waitTimeline(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stageMask);
+
+    /**
+     * @brief Map room for the instances of the frame, at the start of the instance buffer
+     *
+     * A buffer too small is replaced, the GPU is done with it as the frame has begun.
+     * @return nullptr if the buffer could not be allocated
+     */
+    [[nodiscard]] InstanceData *reserveInstances(uint32_t count);
+    /**
+     * @brief Map room for the indirect draw commands of the frame, at the start of the indirect buffer
+     *
+     * @return nullptr if the buffer could not be allocated
+     */
+    [[nodiscard]] VkDrawIndexedIndirectCommand *reserveIndirectCommands(uint32_t count);
+
+    /**
+     * @brief Start writing the instances of draw packets of the given version
+     *
+     * Every instance is written again if the packets have changed since the buffer was last written.
+     */
+    void beginInstanceWrites(uint64_t packetVersion);
+    /**
+     * @brief Whether an instance must be written, it is then recorded as written from the given packet
+     *
+     */
+    [[nodiscard]] inline bool updateInstanceSource(uint32_t instanceIndex, uint32_t packetIndex)
+    {
+        if (m_instanceSources[instanceIndex] == packetIndex)
+            return false;
+        m_instanceSources[instanceIndex] = packetIndex;
+        return true;
+    }
+
+  public:
+    [[nodiscard]] inline uint32_t getFrameIndex() const
+    {
+        return m_frameIndex;
+    }
+    [[nodiscard]] inline VkCommandBuffer getCommandBuffer() const
+    {
+        return m_commandBuffer;
+    }
+    /**
+     * @brief Secondary command buffer of a recording thread
+     *
+     */
+    [[nodiscard]] inline VkCommandBuffer getSecondaryCommandBuffer(uint32_t threadIndex) const
+    {
+        return m_secondaryCommandBuffers[threadIndex];
+    }
+    /**
+     * @brief Instance buffer of the frame, valid until the next reserveInstances
+     *
+     */
+    [[nodiscard]] VkBuffer getInstanceBuffer() const;
+    /**
+     * @brief Indirect buffer of the frame, valid until the next reserveIndirectCommands
+     *
+     */
+    [[nodiscard]] VkBuffer getIndirectBuffer() const;
+    [[nodiscard]] inline VkSemaphore getAcquireSemaphore() const
+    {
+        return m_acquireSemaphore;
+    }
+};
+
+class FrameContextBuilder
+{
+  private:
+    std::unique_ptr<FrameContext> m_product;
+
+    std::weak_ptr<Device> m_device;
+
+    uint32_t m_secondaryCommandBufferCount = 0;
+
+    void restart()
+    {
+        m_product = std::unique_ptr<FrameContext>(new FrameContext);
+    }
+
+  public:
+    FrameContextBuilder()
+    {
+        restart();
+    }
+
+    void setDevice(std::weak_ptr<Device> device)
+    {
+        m_device = device;
+        m_product->m_device = device;
+    }
+    void setFrameIndex(uint32_t index)
+    {
+        m_product->m_frameIndex = index;
+    }
+    /**
+     * @brief Number of threads recording the frame in secondary command buffers
+     *
+     */
+    void setSecondaryCommandBufferCount(uint32_t count)
+    {
+        m_secondaryCommandBufferCount = count;
+    }
+
+    std::unique_ptr<FrameContext> build();
+};
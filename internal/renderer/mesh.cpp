@@ -7,6 +7,7 @@
 
 #include "graphics/buffer.hpp"
 #include "graphics/device.hpp"
+#include "graphics/upload_context.hpp"
 
 #include "mesh.hpp"
 
@@ -16,7 +17,7 @@ Mesh::~Mesh()
     m_vertexBuffer.reset();
 }
 
-void MeshBuilder::createVertexBuffer()
+void MeshBuilder::createVertexBuffer(UploadContext &uploadContext)
 {
     assert(!m_product->m_vertices.empty());
 
@@ -26,26 +27,17 @@ void MeshBuilder::createVertexBuffer()
 
     BufferBuilder bb;
     BufferDirector bd;
-    bd.createStagingBufferBuilder(bb);
-    bb.setDevice(m_product->m_device);
-    bb.setSize(vertexBufferSize);
-    std::unique_ptr<Buffer> stagingBuffer = bb.build();
-
-    stagingBuffer->copyDataToMemory(m_product->m_vertices.data());
-
-    bb.restart();
     bd.createVertexBufferBuilder(bb);
     bb.setDevice(m_product->m_device);
     bb.setSize(vertexBufferSize);
     m_product->m_vertexBuffer = bb.build();
 
-    // transfer from staging buffer to vertex buffer
+    // transfer from staging memory to vertex buffer
 
-    m_product->m_vertexBuffer->transferBufferToBuffer(stagingBuffer->getHandle());
-    stagingBuffer.reset();
+    uploadContext.uploadBuffer(*m_product->m_vertexBuffer, m_product->m_vertices.data(), vertexBufferSize);
 }
 
-void MeshBuilder::createIndexBuffer()
+void MeshBuilder::createIndexBuffer(UploadContext &uploadContext)
 {
     assert(!m_product->m_indices.empty());
 
@@ -55,22 +47,12 @@ void MeshBuilder::createIndexBuffer()
 
     BufferBuilder bb;
     BufferDirector bd;
-    bd.createStagingBufferBuilder(bb);
-    bb.setDevice(m_product->m_device);
-    bb.setSize(indexBufferSize);
-
-    std::unique_ptr<Buffer> stagingBuffer = bb.build();
-
-    stagingBuffer->copyDataToMemory(m_product->m_indices.data());
-
-    bb.restart();
     bd.createIndexBufferBuilder(bb);
     bb.setDevice(m_product->m_device);
     bb.setSize(indexBufferSize);
     m_product->m_indexBuffer = bb.build();
 
-    m_product->m_indexBuffer->transferBufferToBuffer(stagingBuffer->getHandle());
-    stagingBuffer.reset();
+    uploadContext.uploadBuffer(*m_product->m_indexBuffer, m_product->m_indices.data(), indexBufferSize);
 }
 
 void MeshBuilder::setVerticesFromAiScene(const aiScene *pScene)
@@ -117,8 +99,21 @@ std::unique_ptr<Mesh> MeshBuilder::build()
         setIndicesFromAiScene(pScene);
     }
 
-    createVertexBuffer();
-    createIndexBuffer();
+    if (m_uploadContext)
+    {
+        createVertexBuffer(*m_uploadContext);
+        createIndexBuffer(*m_uploadContext);
+    }
+    else
+    {
+        UploadContextBuilder ucb;
+        ucb.setDevice(m_device);
+        std::unique_ptr<UploadContext> uploadContext = ucb.build();
+        createVertexBuffer(*uploadContext);
+        createIndexBuffer(*uploadContext);
+        uploadContext->submit();
+        uploadContext->wait();
+    }
 
     auto result = std::move(m_product);
     restart();
@@ -10,6 +10,7 @@
 class Device;
 class Buffer;
 class Texture;
+class UploadContext;
 class aiScene;
 class MeshBuilder;
 
@@ -79,13 +80,15 @@ class MeshBuilder
 
     unsigned int m_importerFlags;
 
+    UploadContext *m_uploadContext = nullptr;
+
     void restart()
     {
         m_product = std::unique_ptr<Mesh>(new Mesh);
     }
 
-    void createVertexBuffer();
-    void createIndexBuffer();
+    void createVertexBuffer(UploadContext &uploadContext);
+    void createIndexBuffer(UploadContext &uploadContext);
 
     void setVerticesFromAiScene(const aiScene *pScene);
     void setIndicesFromAiScene(const aiScene *pScene);
@@ -120,6 +123,15 @@ class MeshBuilder
     {
         m_importerFlags = flags;
     }
+    /**
+     * @brief Record the uploads in a shared context instead of submitting them right away
+     *
+     * The buffers can only be used once the context has been submitted and completed.
+     */
+    void setUploadContext(UploadContext *uploadContext)
+    {
+        m_uploadContext = uploadContext;
+    }
 
     std::unique_ptr<Mesh> build();
 };
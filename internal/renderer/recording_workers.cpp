@@ -0,0 +1,66 @@
+#include "recording_workers.hpp"
+
+RecordingWorkers::RecordingWorkers(uint32_t threadCount)
+{
+    for (uint32_t i = 0; i < threadCount; ++i)
+        m_workers.emplace_back(&RecordingWorkers::work, this);
+}
+
+RecordingWorkers::~RecordingWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopping = true;
+    }
+    m_taskCondition.notify_all();
+
+    for (std::thread &worker : m_workers)
+        worker.join();
+}
+
+void RecordingWorkers::runTasks(std::unique_lock<std::mutex> &lock)
+{
+    while (m_nextTask < m_taskCount)
+    {
+        uint32_t index = m_nextTask++;
+
+        // record outside of the lock
+        lock.unlock();
+        m_task(index);
+        lock.lock();
+
+        if (--m_pendingTaskCount == 0)
+            m_doneCondition.notify_all();
+    }
+}
+
+void RecordingWorkers::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_taskCondition.wait(lock, [this]() { return m_bStopping || m_nextTask < m_taskCount; });
+        if (m_bStopping)
+            return;
+
+        runTasks(lock);
+    }
+}
+
+void RecordingWorkers::run(uint32_t taskCount, const std::function<void(uint32_t)> &task)
+{
+    if (taskCount == 0)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // every task of the previous run is over, no thread references its task anymore
+    m_task = task;
+    m_taskCount = taskCount;
+    m_nextTask = 0;
+    m_pendingTaskCount = taskCount;
+    m_taskCondition.notify_all();
+
+    runTasks(lock);
+    m_doneCondition.wait(lock, [this]() { return m_pendingTaskCount == 0; });
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Threads kept alive between the frames to record command buffers in parallel
+ *
+ * A run hands out the indices of its tasks to the workers and to the calling thread, then waits for
+ * every task to be over. Tasks of a run must not depend on each other.
+ */
+class RecordingWorkers
+{
+  private:
+    std::vector<std::thread> m_workers;
+
+    // run in progress, each index below the task count is given to a single thread
+    std::function<void(uint32_t)> m_task;
+    uint32_t m_taskCount = 0;
+    uint32_t m_nextTask = 0;
+    uint32_t m_pendingTaskCount = 0;
+    bool m_bStopping = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_taskCondition;
+    std::condition_variable m_doneCondition;
+
+    void work();
+    // run the tasks left, the lock is held on return
+    void runTasks(std::unique_lock<std::mutex> &lock);
+
+  public:
+    /**
+     * @param threadCount number of threads besides the thread calling run
+     */
+    RecordingWorkers(uint32_t threadCount);
+    ~RecordingWorkers();
+
+    RecordingWorkers(const RecordingWorkers &) = delete;
+    RecordingWorkers &operator=(const RecordingWorkers &) = delete;
+    RecordingWorkers(RecordingWorkers &&) = delete;
+    RecordingWorkers &operator=(RecordingWorkers &&) = delete;
+
+    /**
+     * @brief Call the task once per index in [0, taskCount) and wait for every call to return
+     *
+     */
+    void run(uint32_t taskCount, const std::function<void(uint32_t)> &task);
+};
@@ -1,12 +1,13 @@
+#include <chrono>
 #include <glm/glm.hpp>
 #include <iostream>
 
-#include "engine/camera.hpp"
 #include "engine/uniform.hpp"
 #include "graphics/buffer.hpp"
 #include "graphics/device.hpp"
 #include "graphics/pipeline.hpp"
 #include "graphics/render_pass.hpp"
+#include "draw_packet.hpp"
 #include "mesh.hpp"
 #include "texture.hpp"
 
@@ -14,148 +15,136 @@
 
 RenderStateABC::~RenderStateABC()
 {
-    if (!m_device.lock())
-        return;
-
-    vkDestroyDescriptorPool(m_device.lock()->getHandle(), m_descriptorPool, nullptr);
-
     m_pipeline.reset();
 }
 
-void RenderStateABC::updateUniformBuffers(uint32_t imageIndex, const Camera &camera)
+void RenderStateABC::updatePipeline()
 {
-    MVP ubo = {
-        .model = glm::identity<glm::mat4>(),
-        .view = camera.getViewMatrix(),
-        .proj = camera.getProjectionMatrix(),
-    };
-    memcpy(m_uniformBuffersMapped[imageIndex], &ubo, sizeof(ubo));
-}
+    if (!m_pendingPipeline.valid() ||
+        m_pendingPipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
 
-void RenderStateABC::recordBackBufferDescriptorSetsCommands(VkCommandBuffer &commandBuffer, uint32_t imageIndex)
-{
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline->getPipelineLayout(), 0, 1,
-                            &m_descriptorSets[imageIndex], 0, nullptr);
+    std::shared_ptr<Pipeline> pipeline = m_pendingPipeline.get();
+    m_pendingPipeline = {};
+    if (!pipeline)
+    {
+        std::cerr << "Failed to compile pipeline in the background, keeping the fallback pipeline" << std::endl;
+        return;
+    }
+
+    // a pipeline of the same material set layout keeps using the material set
+    bool bSameSetLayout = m_pipeline && m_pipeline->isBindless() == pipeline->isBindless() &&
+                          m_pipeline->getDescriptorSetLayout(materialSetIndex) ==
+                              pipeline->getDescriptorSetLayout(materialSetIndex);
+    m_pipeline = pipeline;
+    if (bSameSetLayout)
+        return;
+
+    if (!updateDescriptorSet())
+        std::cerr << "Failed to recreate the descriptor set of the compiled pipeline" << std::endl;
 }
 
-void MeshRenderStateBuilder::setPipeline(std::shared_ptr<Pipeline> pipeline)
+void RenderStateABC::prepareRecording()
 {
-    m_product->m_pipeline = pipeline;
+    updatePipeline();
+
+    // the texture has been moved by the defragmenter, frames in flight keep using the old set
+    auto texPtr = m_texture.lock();
+    if (texPtr && texPtr->updateImageView(m_textureGeneration))
+    {
+        if (!updateDescriptorSet())
+            std::cerr << "Failed to recreate the descriptor set of the moved texture" << std::endl;
+    }
 }
-void MeshRenderStateBuilder::addPoolSize(VkDescriptorType poolSizeType)
+
+bool RenderStateABC::fillDrawPacket(DrawPacketT &packet) const
 {
-    m_poolSizes.push_back(VkDescriptorPoolSize{
-        .type = poolSizeType,
-        .descriptorCount = m_frameInFlightCount,
-    });
+    packet.pass = 0;
+    packet.pipeline = m_pipeline.get();
+    packet.dynamicState = &m_dynamicState;
+
+    // the frame set and the bindless table are bound by the renderer
+    // bindless textures are read per instance, the draws of any texture share a material
+    packet.materialSet = m_descriptorSet;
+    packet.materialId = reinterpret_cast<uint64_t>(m_descriptorSet);
+
+    // the slot is not read by the untextured variants
+    packet.instance = {
+        .model = m_modelMatrix,
+        .textureSlot = 0,
+    };
+    auto texPtr = m_texture.lock();
+    if (texPtr && texPtr->getBindlessSlot() != BindlessTable::invalidSlot)
+        packet.instance.textureSlot = texPtr->getBindlessSlot();
+    return true;
 }
 
-std::unique_ptr<RenderStateABC> MeshRenderStateBuilder::build()
+bool RenderStateABC::updateDescriptorSet()
 {
-    assert(m_device.lock());
-
-    auto deviceHandle = m_device.lock()->getHandle();
+    auto texPtr = m_texture.lock();
+    if (texPtr)
+        m_textureGeneration = texPtr->getImageGeneration();
 
-    // descriptor pool
-    VkDescriptorPoolCreateInfo createInfo = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .maxSets = m_frameInFlightCount,
-        .poolSizeCount = static_cast<uint32_t>(m_poolSizes.size()),
-        .pPoolSizes = m_poolSizes.data(),
-    };
-    VkResult res = vkCreateDescriptorPool(deviceHandle, &createInfo, nullptr, &m_product->m_descriptorPool);
-    if (res != VK_SUCCESS)
+    if (m_pipeline->isBindless())
     {
-        std::cerr << "Failed to create descriptor pool : " << res << std::endl;
-        return nullptr;
+        m_descriptorSet = VK_NULL_HANDLE;
+        return true;
     }
 
-    // descriptor set
-    std::vector<VkDescriptorSetLayout> setLayouts(m_frameInFlightCount,
-                                                  m_product->m_pipeline->getDescriptorSetLayout());
-    VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .descriptorPool = m_product->m_descriptorPool,
-        .descriptorSetCount = m_frameInFlightCount,
-        .pSetLayouts = setLayouts.data(),
+    VkDescriptorImageInfo imageInfo = {
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
     };
-    m_product->m_descriptorSets.resize(m_frameInFlightCount);
-    res = vkAllocateDescriptorSets(deviceHandle, &descriptorSetAllocInfo, m_product->m_descriptorSets.data());
-    if (res != VK_SUCCESS)
+    if (texPtr)
     {
-        std::cerr << "Failed to allocate descriptor sets : " << res << std::endl;
-        return nullptr;
+        imageInfo.sampler = texPtr->getSampler();
+        imageInfo.imageView = texPtr->getImageView();
     }
+    UniformDescriptorBuilder udb;
+    udb.addSetWrites(VkWriteDescriptorSet{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &imageInfo,
+    });
 
-    // uniform buffers
+    std::vector<VkWriteDescriptorSet> writes = udb.build()->getSetWrites();
+    m_descriptorSet = m_device.lock()->getDescriptorAllocator()->getImmutableSet(
+        m_pipeline->getDescriptorSetLayout(materialSetIndex), writes);
 
-    m_product->m_uniformBuffers.resize(m_frameInFlightCount);
-    m_product->m_uniformBuffersMapped.resize(m_frameInFlightCount);
-    for (int i = 0; i < m_product->m_uniformBuffers.size(); ++i)
-    {
-        BufferBuilder bb;
-        BufferDirector bd;
-        bd.createUniformBufferBuilder(bb);
-        bb.setSize(sizeof(RenderStateABC::MVP));
-        bb.setDevice(m_device);
-        m_product->m_uniformBuffers[i] = bb.build();
-
-        vkMapMemory(deviceHandle, m_product->m_uniformBuffers[i]->getMemory(), 0, sizeof(RenderStateABC::MVP), 0,
-                    &m_product->m_uniformBuffersMapped[i]);
-    }
+    return m_descriptorSet != VK_NULL_HANDLE;
+}
 
-    for (int i = 0; i < m_product->m_descriptorSets.size(); ++i)
-    {
-        VkDescriptorBufferInfo bufferInfo = {
-            .buffer = m_product->m_uniformBuffers[i]->getHandle(),
-            .offset = 0,
-            .range = sizeof(RenderStateABC::MVP),
-        };
-        UniformDescriptorBuilder udb;
-        udb.addSetWrites(VkWriteDescriptorSet{
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = m_product->m_descriptorSets[i],
-            .dstBinding = 0,
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .pBufferInfo = &bufferInfo,
-        });
-
-        VkDescriptorImageInfo imageInfo = {
-            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        };
-        if (m_texture.lock())
-        {
-            auto texPtr = m_texture.lock();
-            imageInfo.sampler = texPtr->getSampler();
-            imageInfo.imageView = texPtr->getImageView();
-        }
-        udb.addSetWrites(VkWriteDescriptorSet{
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = m_product->m_descriptorSets[i],
-            .dstBinding = 1,
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .pImageInfo = &imageInfo,
-        });
-
-        std::vector<VkWriteDescriptorSet> writes = udb.build()->getSetWrites();
-        vkUpdateDescriptorSets(deviceHandle, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
-    }
+void MeshRenderStateBuilder::setPipeline(std::shared_ptr<Pipeline> pipeline)
+{
+    m_product->m_pipeline = pipeline;
+}
+
+std::unique_ptr<RenderStateABC> MeshRenderStateBuilder::build()
+{
+    assert(m_device.lock());
+    // a fallback pipeline is drawn with while the pending one compiles
+    assert(m_product->m_pipeline);
+
+    m_product->updatePipeline();
+    if (!m_product->updateDescriptorSet())
+        return nullptr;
 
     auto result = std::move(m_product);
     return result;
 }
 
-void MeshRenderState::recordBackBufferDrawObjectCommands(VkCommandBuffer &commandBuffer)
+bool MeshRenderState::fillDrawPacket(DrawPacketT &packet) const
 {
     auto meshPtr = m_mesh.lock();
-
-    VkBuffer vbos[] = {meshPtr->getVertexBufferHandle()};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vbos, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, meshPtr->getIndexBufferHandle(), 0, VK_INDEX_TYPE_UINT16);
-    vkCmdDrawIndexed(commandBuffer, meshPtr->getIndexCount(), 1, 0, 0, 0);
+    if (!meshPtr || !RenderStateABC::fillDrawPacket(packet))
+        return false;
+
+    packet.vertexBuffer = meshPtr->getVertexBufferHandle();
+    packet.indexBuffer = meshPtr->getIndexBufferHandle();
+    packet.indexCount = meshPtr->getIndexCount();
+    packet.firstIndex = 0;
+    packet.vertexOffset = 0;
+    return true;
 }
@@ -1,77 +1,106 @@
 #pragma once
 
+#include <future>
 #include <memory>
 #include <vector>
 
+#include <glm/glm.hpp>
+
 #include <vulkan/vulkan.h>
 
+#include "engine/instance_data.hpp"
+
+#include "graphics/dynamic_state.hpp"
+
 class Pipeline;
 class Device;
+struct DrawPacketT;
 class Buffer;
-class Camera;
 class Mesh;
+class Texture;
 class MeshRenderStateBuilder;
 
-class UniformBlock
-{
-  class MVP
-  {
-    public:
-      glm::mat4 model;
-      glm::mat4 view;
-      glm::mat4 proj;
-  };
-
-  // TODO : move uniform block in RenderPhase class (or in pipeline ?)
-
-  struct LightT
-  {
-      glm::vec3 color;
-      float intensity;
-  };
-
-  struct DirectionalLight : public LightT
-  {
-      glm::vec3 direction;
-  };
-
-  struct PointLightT : public LightT
-  {
-      glm::vec3 position;
-      glm::vec3 attenuation;
-  };
-
-  VkDescriptorPool m_descriptorPool;
-  std::vector<VkDescriptorSet> m_descriptorSets;
-  std::vector<std::unique_ptr<Buffer>> m_uniformBuffers;
-  std::vector<void *> m_uniformBuffersMapped;
-};
-
 class RenderStateABC
 {
-  protected:
+  public:
+    // descriptor sets by update frequency, the per draw data is read from the instance buffer (see InstanceData)
+    static constexpr uint32_t frameSetIndex = 0;
+    static constexpr uint32_t materialSetIndex = 1;
+
+    // frame set, written and bound once per frame by the renderer
+    struct CameraT
+    {
+        glm::mat4 view;
+        glm::mat4 proj;
+    };
 
+  protected:
     std::weak_ptr<Device> m_device;
 
     std::shared_ptr<Pipeline> m_pipeline;
+    // specialized pipeline compiling in the background, m_pipeline is the fallback until it is ready
+    std::shared_future<std::shared_ptr<Pipeline>> m_pendingPipeline;
+    // set per draw if the pipeline has dynamic state
+    DynamicStateT m_dynamicState;
+
+    // material set, borrowed from the device's descriptor allocator and shared with the states of the same
+    // texture (VK_NULL_HANDLE for bindless pipelines)
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+
+    // material set content
+    std::weak_ptr<Texture> m_texture;
+    uint64_t m_textureGeneration = 0;
 
-    std::unique_ptr<UniformBlock> m_uniformBlock;
+    glm::mat4 m_modelMatrix = glm::mat4(1.f);
 
     RenderStateABC() = default;
 
+    /**
+     * @brief Get the material set of the current pipeline layout and resources
+     *
+     * Bindless pipelines have no material set, the texture is read from its slot.
+     * The previous set is left to the frames in flight, the allocator keeps it until its resources are
+     * destroyed.
+     */
+    [[nodiscard]] bool updateDescriptorSet();
+
   public:
     virtual ~RenderStateABC();
 
-    virtual void updateUniformBuffers(uint32_t imageIndex, const Camera &camera);
-
-    virtual void recordBackBufferDescriptorSetsCommands(VkCommandBuffer &commandBuffer, uint32_t imageIndex);
-    virtual void recordBackBufferDrawObjectCommands(VkCommandBuffer &commandBuffer) = 0;
+    /**
+     * @brief Swap in the pending pipeline if its compilation is over
+     *
+     * Called before recording the state so that a frame is drawn with a single pipeline.
+     */
+    void updatePipeline();
+    /**
+     * @brief Update the pipeline and the material set before the draw packet of the state is rebuilt
+     *
+     * Render states share textures and descriptor sets, they are prepared on a single thread.
+     */
+    void prepareRecording();
+
+    /**
+     * @brief Write the pipeline, the material and the instance data of the draw
+     *
+     * Called when the state changes only, the renderer keeps the packet between the frames.
+     * @return false if there is nothing to draw
+     */
+    virtual bool fillDrawPacket(DrawPacketT &packet) const;
 
   public:
+    [[nodiscard]] bool hasPendingPipeline() const
+    {
+        return m_pendingPipeline.valid();
+    }
     [[nodiscard]] std::shared_ptr<Pipeline> getPipeline() const
     {
         return m_pipeline;
     }
+    [[nodiscard]] const DynamicStateT &getDynamicState() const
+    {
+        return m_dynamicState;
+    }
 };
 
 class RenderStateBuilderI
@@ -81,9 +110,10 @@ class RenderStateBuilderI
 
     virtual void setDevice(std::weak_ptr<Device> device) = 0;
     virtual void setPipeline(std::shared_ptr<Pipeline> pipeline) = 0;
-    virtual void addPoolSize(VkDescriptorType poolSizeType) = 0;
-    virtual void setFrameInFlightCount(uint32_t a) = 0;
+    virtual void setPendingPipeline(std::shared_future<std::shared_ptr<Pipeline>> pipeline) = 0;
+    virtual void setDynamicState(const DynamicStateT &state) = 0;
     virtual void setTexture(std::weak_ptr<Texture> texture) = 0;
+    virtual void setModelMatrix(const glm::mat4 &model) = 0;
 
     virtual std::unique_ptr<RenderStateABC> build() = 0;
 };
@@ -96,7 +126,7 @@ class MeshRenderState : public RenderStateABC
     std::weak_ptr<Mesh> m_mesh;
 
   public:
-    void recordBackBufferDrawObjectCommands(VkCommandBuffer &commandBuffer) override;
+    bool fillDrawPacket(DrawPacketT &packet) const override;
 };
 
 class MeshRenderStateBuilder : public RenderStateBuilderI
@@ -106,11 +136,6 @@ class MeshRenderStateBuilder : public RenderStateBuilderI
 
     std::weak_ptr<Device> m_device;
 
-    std::vector<VkDescriptorPoolSize> m_poolSizes;
-    uint32_t m_frameInFlightCount;
-
-    std::weak_ptr<Texture> m_texture;
-
   public:
     MeshRenderStateBuilder()
     {
@@ -128,14 +153,29 @@ class MeshRenderStateBuilder : public RenderStateBuilderI
         m_product->m_device = device;
     }
     void setPipeline(std::shared_ptr<Pipeline> pipeline) override;
-    void addPoolSize(VkDescriptorType poolSizeType) override;
-    void setFrameInFlightCount(uint32_t a) override
+    /**
+     * @brief Pipeline to draw with once compiled, the pipeline set by setPipeline is the fallback until then
+     *
+     */
+    void setPendingPipeline(std::shared_future<std::shared_ptr<Pipeline>> pipeline) override
+    {
+        m_product->m_pendingPipeline = pipeline;
+    }
+    /**
+     * @brief Cull mode, depth test, topology... of the draws (see PipelineBuilder::getDynamicState)
+     *
+     */
+    void setDynamicState(const DynamicStateT &state) override
     {
-        m_frameInFlightCount = a;
+        m_product->m_dynamicState = state;
     }
     void setTexture(std::weak_ptr<Texture> texture) override
     {
-        m_texture = texture;
+        m_product->m_texture = texture;
+    }
+    void setModelMatrix(const glm::mat4 &model) override
+    {
+        m_product->m_modelMatrix = model;
     }
 
     void setMesh(std::shared_ptr<Mesh> mesh)
@@ -1,15 +1,24 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <optional>
+#include <span>
 
 #include "graphics/buffer.hpp"
 #include "graphics/device.hpp"
 #include "graphics/pipeline.hpp"
 #include "graphics/swapchain.hpp"
 
+#include "draw_packet.hpp"
+#include "frame_context.hpp"
 #include "mesh.hpp"
+#include "recording_workers.hpp"
 #include "texture.hpp"
 
 #include "engine/camera.hpp"
+#include "engine/instance_data.hpp"
 #include "engine/uniform.hpp"
 
 #include "render_state.hpp"
@@ -23,34 +32,94 @@ Renderer::~Renderer()
 
     auto deviceHandle = m_device.lock()->getHandle();
 
+    // background compilations reference the render pass
+    m_device.lock()->getPipelineCompiler()->waitIdle();
     vkDeviceWaitIdle(deviceHandle);
 
-    for (int i = 0; i < m_bufferingType; ++i)
-    {
-        vkDestroyFence(deviceHandle, m_backBuffers[i].inFlightFence, nullptr);
-        vkDestroySemaphore(deviceHandle, m_backBuffers[i].renderSemaphore, nullptr);
-        vkDestroySemaphore(deviceHandle, m_backBuffers[i].acquireSemaphore, nullptr);
-    }
+    m_frames.clear();
+    for (VkSemaphore renderSemaphore : m_renderSemaphores)
+        vkDestroySemaphore(deviceHandle, renderSemaphore, nullptr);
 
+    m_uniformRing.reset();
+    m_recordingWorkers.reset();
+    m_commandRecorders.clear();
     m_renderPass.reset();
+
+    // the device is idle, nothing needs to wait for a frame to retire
+    m_device.lock()->getDeletionQueue()->flush();
 }
 
 void Renderer::registerRenderState(std::shared_ptr<RenderStateABC> renderState)
 {
     m_renderStates.emplace_back(renderState);
+    m_bDrawPacketsDirty = true;
+}
+
+void Renderer::warmupPipelines(uint32_t threadCount)
+{
+    auto devicePtr = m_device.lock();
+
+    std::vector<std::string> descriptions = devicePtr->getPipelineManifest()->getDescriptions();
+    if (descriptions.empty())
+        return;
+
+    threadCount = std::clamp(threadCount, 1U, static_cast<uint32_t>(descriptions.size()));
+
+    // vkCreateGraphicsPipelines is thread safe, the workers only share the registry and the pipeline cache
+    std::vector<std::shared_ptr<Pipeline>> pipelines(descriptions.size());
+    std::vector<std::chrono::nanoseconds> durations(descriptions.size());
+    std::atomic<size_t> nextIndex = 0;
+    auto compile = [&]() {
+        for (size_t i = nextIndex++; i < descriptions.size(); i = nextIndex++)
+        {
+            PipelineBuilder pb;
+            if (!pb.setDescription(descriptions[i]))
+                continue;
+            pb.setDevice(m_device);
+            pb.setRenderPass(m_renderPass.get());
+            pb.setExtent(m_swapchain->getExtent());
+
+            auto start = std::chrono::steady_clock::now();
+            pipelines[i] = pb.build();
+            durations[i] = std::chrono::steady_clock::now() - start;
+        }
+    };
+
+    auto warmupStart = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < threadCount; ++i)
+        workers.emplace_back(compile);
+    compile();
+    for (std::thread &worker : workers)
+        worker.join();
+    auto wallDuration = std::chrono::steady_clock::now() - warmupStart;
+
+    std::chrono::nanoseconds serialDuration(0);
+    for (size_t i = 0; i < pipelines.size(); ++i)
+    {
+        if (!pipelines[i])
+            continue;
+        serialDuration += durations[i];
+        m_warmPipelines.emplace_back(pipelines[i]);
+    }
+
+    std::cout << "Pipeline warmup : " << m_warmPipelines.size() << "/" << descriptions.size()
+              << " pipeline(s) compiled on " << threadCount << " thread(s) in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(wallDuration).count() << " ms ("
+              << std::chrono::duration_cast<std::chrono::milliseconds>(serialDuration).count()
+              << " ms summed over the pipelines)" << std::endl;
 }
 
 uint32_t Renderer::acquireBackBuffer()
 {
-    auto deviceHandle = m_device.lock()->getHandle();
+    FrameContext &frame = *m_frames[m_frameIndex];
 
-    vkWaitForFences(deviceHandle, 1, &m_backBuffers[m_backBufferIndex].inFlightFence, VK_TRUE, UINT64_MAX);
-    vkResetFences(deviceHandle, 1, &m_backBuffers[m_backBufferIndex].inFlightFence);
+    // the last submission of this frame is retired, so is every frame before it
+    m_completedFrameSerial = frame.begin(*m_uniformRing);
 
     uint32_t imageIndex;
-    VkResult res =
-        vkAcquireNextImageKHR(deviceHandle, m_swapchain->getHandle(), UINT64_MAX,
-                              m_backBuffers[m_backBufferIndex].acquireSemaphore, VK_NULL_HANDLE, &imageIndex);
+    VkResult res = vkAcquireNextImageKHR(m_device.lock()->getHandle(), m_swapchain->getHandle(), UINT64_MAX,
+                                         frame.getAcquireSemaphore(), VK_NULL_HANDLE, &imageIndex);
     if (res != VK_SUCCESS)
     {
         std::cerr << "Failed to acquire next image : " << res << std::endl;
@@ -60,24 +129,237 @@ uint32_t Renderer::acquireBackBuffer()
     return imageIndex;
 }
 
-void Renderer::recordRenderers(uint32_t imageIndex, const Camera &camera)
+void Renderer::rebuildDrawPacket(uint32_t stateIndex)
+{
+    RenderStateABC &renderState = *m_renderStates[stateIndex];
+    renderState.prepareRecording();
+
+    DrawPacketT &packet = m_drawPackets[stateIndex];
+    InstanceData previousInstance = packet.instance;
+    packet.bDrawable = renderState.fillDrawPacket(packet);
+    if (!packet.bDrawable)
+        return;
+
+    packet.stateKey = make_draw_state_key(packet);
+    if (packet.instance.model != previousInstance.model || packet.instance.textureSlot != previousInstance.textureSlot)
+        ++m_drawPacketVersion;
+}
+
+void Renderer::gatherDrawPackets(const Camera &camera)
+{
+    m_drawOrder.clear();
+    m_drawBatches.clear();
+    m_drawBuckets.clear();
+
+    // the render states are only visited when they change
+    if (m_bDrawPacketsDirty)
+    {
+        // the new packets have no previous instance to compare with
+        if (m_drawPackets.size() != m_renderStates.size())
+            ++m_drawPacketVersion;
+        m_drawPackets.resize(m_renderStates.size());
+        m_pendingPipelineStates.clear();
+        for (uint32_t i = 0; i < m_renderStates.size(); ++i)
+        {
+            rebuildDrawPacket(i);
+            if (m_renderStates[i]->hasPendingPipeline())
+                m_pendingPipelineStates.emplace_back(i);
+        }
+        m_bDrawPacketsDirty = false;
+    }
+    else
+    {
+        std::erase_if(m_pendingPipelineStates, [this](uint32_t stateIndex) {
+            rebuildDrawPacket(stateIndex);
+            return !m_renderStates[stateIndex]->hasPendingPipeline();
+        });
+    }
+
+    glm::mat4 view = camera.getViewMatrix();
+    for (uint32_t i = 0; i < m_drawPackets.size(); ++i)
+    {
+        const DrawPacketT &packet = m_drawPackets[i];
+        if (!packet.bDrawable)
+            continue;
+
+        // draws sharing their pipeline, material and mesh are sorted front to back by their origin
+        glm::vec3 viewPosition = glm::vec3(view * packet.instance.model[3]);
+        m_drawOrder.emplace_back(DrawSortEntryT{
+            .sortKey = make_draw_sort_key(packet.stateKey, glm::length(viewPosition) / camera.getFar()),
+            .packetIndex = i,
+        });
+    }
+
+    radix_sort_draws(m_drawOrder, m_drawOrderScratch);
+
+    if (m_drawOrder.empty())
+        return;
+
+    FrameContext &frame = *m_frames[m_frameIndex];
+    InstanceData *instances = frame.reserveInstances(static_cast<uint32_t>(m_drawOrder.size()));
+    if (!instances)
+    {
+        std::cerr << "Failed to write the instances, nothing is drawn this frame" << std::endl;
+        return;
+    }
+    frame.beginInstanceWrites(m_drawPacketVersion);
+
+    // the draws sharing their state are next to each other once sorted, they become the instances of a batch
+    // and the batches of a bucket
+    for (uint32_t i = 0; i < m_drawOrder.size(); ++i)
+    {
+        const DrawPacketT &packet = m_drawPackets[m_drawOrder[i].packetIndex];
+        // the frame's buffer still holds the instance if the sorted order has not moved it
+        if (frame.updateInstanceSource(i, m_drawOrder[i].packetIndex))
+            instances[i] = packet.instance;
+
+        if (m_bMergingDraws && !m_drawBatches.empty() &&
+            can_instance_draws(m_drawPackets[m_drawBatches.back().packetIndex], packet))
+        {
+            ++m_drawBatches.back().instanceCount;
+            continue;
+        }
+        m_drawBatches.emplace_back(DrawBatchT{
+            .packetIndex = m_drawOrder[i].packetIndex,
+            .firstInstance = i,
+            .instanceCount = 1,
+        });
+
+        if (m_bMergingDraws && !m_drawBuckets.empty() &&
+            can_share_draw_state(m_drawPackets[m_drawBatches[m_drawBuckets.back().firstBatch].packetIndex], packet))
+        {
+            ++m_drawBuckets.back().batchCount;
+            continue;
+        }
+        m_drawBuckets.emplace_back(DrawBucketT{
+            .firstBatch = static_cast<uint32_t>(m_drawBatches.size() - 1),
+            .batchCount = 1,
+        });
+    }
+
+    if (!m_bIndirectDrawing)
+        return;
+
+    VkDrawIndexedIndirectCommand *commands = frame.reserveIndirectCommands(static_cast<uint32_t>(m_drawBatches.size()));
+    if (!commands)
+    {
+        std::cerr << "Failed to write the indirect commands, nothing is drawn this frame" << std::endl;
+        m_drawBatches.clear();
+        m_drawBuckets.clear();
+        return;
+    }
+
+    for (size_t i = 0; i < m_drawBatches.size(); ++i)
+    {
+        const DrawBatchT &batch = m_drawBatches[i];
+        const DrawPacketT &packet = m_drawPackets[batch.packetIndex];
+        commands[i] = VkDrawIndexedIndirectCommand{
+            .indexCount = packet.indexCount,
+            .instanceCount = batch.instanceCount,
+            .firstIndex = packet.firstIndex,
+            .vertexOffset = packet.vertexOffset,
+            .firstInstance = batch.firstInstance,
+        };
+    }
+}
+
+void Renderer::recordDraws(CommandRecorder &recorder, VkCommandBuffer commandBuffer, size_t first, size_t last,
+                           uint32_t cameraOffset)
+{
+    // nothing is known of the state of a new command buffer
+    recorder.begin(commandBuffer);
+    if (first == last)
+        return;
+
+    // the frame set and the bindless table stay bound across the pipelines of the same layout
+    BindlessTable *bindlessTable = m_device.lock()->getBindlessTable();
+    VkDescriptorSet bindlessSet = bindlessTable ? bindlessTable->getSet() : VK_NULL_HANDLE;
+
+    // the instances of every batch are in the same buffer
+    const FrameContext &frame = *m_frames[m_frameIndex];
+    recorder.bindVertexBuffer(InstanceData::binding, frame.getInstanceBuffer(), 0);
+
+    for (size_t i = first; i < last; ++i)
+    {
+        // the batches of a bucket share the state of its first one
+        const DrawBucketT &bucket = m_drawBuckets[i];
+        const DrawPacketT &packet = m_drawPackets[m_drawBatches[bucket.firstBatch].packetIndex];
+        const Pipeline &pipeline = *packet.pipeline;
+        VkPipelineLayout pipelineLayout = pipeline.getPipelineLayout();
+
+        recorder.bindPipeline(pipeline);
+        recorder.bindDescriptorSet(pipelineLayout, RenderStateABC::frameSetIndex, m_frameDescriptorSet,
+                                   std::span(&cameraOffset, 1));
+        if (pipeline.isBindless())
+            recorder.bindDescriptorSet(pipelineLayout, BindlessTable::setIndex, bindlessSet);
+        else if (packet.materialSet != VK_NULL_HANDLE)
+            recorder.bindDescriptorSet(pipelineLayout, RenderStateABC::materialSetIndex, packet.materialSet);
+
+        if (pipeline.hasDynamicState())
+            recorder.setDynamicState(*packet.dynamicState);
+
+        recorder.bindVertexBuffer(0, packet.vertexBuffer, 0);
+        recorder.bindIndexBuffer(packet.indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+        if (m_bIndirectDrawing)
+        {
+            recorder.drawIndexedIndirect(frame.getIndirectBuffer(),
+                                         bucket.firstBatch * sizeof(VkDrawIndexedIndirectCommand), bucket.batchCount);
+            continue;
+        }
+
+        for (uint32_t j = bucket.firstBatch; j < bucket.firstBatch + bucket.batchCount; ++j)
+        {
+            const DrawBatchT &batch = m_drawBatches[j];
+            const DrawPacketT &batchPacket = m_drawPackets[batch.packetIndex];
+            recorder.drawIndexed(batchPacket.indexCount, batch.instanceCount, batchPacket.firstIndex,
+                                 batchPacket.vertexOffset, batch.firstInstance);
+        }
+    }
+}
+
+bool Renderer::beginFrameCommands(VkDeviceSize defragmentationBudget, bool bAcquireUploads)
 {
-    VkCommandBuffer &commandBuffer = m_backBuffers[m_backBufferIndex].commandBuffer;
+    FrameContext &frame = *m_frames[m_frameIndex];
+    auto devicePtr = m_device.lock();
 
-    vkResetCommandBuffer(commandBuffer, 0);
+    // the command pools of the frame have been reset by FrameContext::begin
+    VkCommandBuffer commandBuffer = frame.getCommandBuffer();
 
     VkCommandBufferBeginInfo commandBufferBeginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = 0,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
         .pInheritanceInfo = nullptr,
     };
     VkResult res = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
     if (res != VK_SUCCESS)
     {
         std::cerr << "Failed to begin recording command buffer : " << res << std::endl;
-        return;
+        return false;
+    }
+
+    // resources uploaded on the transfer queue are acquired before their first use, the frame only waits for
+    // their copies at the stages reading them
+    TransferHandoff *handoff = devicePtr->getTransferHandoff();
+    if (bAcquireUploads && handoff)
+    {
+        uint64_t uploadValue = handoff->recordAcquire(commandBuffer);
+        if (uploadValue > 0)
+            frame.waitTimeline(handoff->getTimelineSemaphore(), uploadValue, TransferHandoff::consumerStageMask);
     }
 
+    // move a few allocations out of sparse memory blocks, the copies are ordered before this frame's draws
+    // the packets holding the handles of the moved resources are rebuilt
+    if (devicePtr->getDefragmenter()->recordPass(commandBuffer, defragmentationBudget, m_completedFrameSerial) > 0)
+        m_bDrawPacketsDirty = true;
+    return true;
+}
+
+void Renderer::recordFrame(uint32_t imageIndex, const Camera &camera, uint32_t threadCount)
+{
+    FrameContext &frame = *m_frames[m_frameIndex];
+    VkCommandBuffer commandBuffer = frame.getCommandBuffer();
+
     VkClearValue clearColor = {
         .color = {0.2f, 0.2f, 0.2f, 1.f},
     };
@@ -85,63 +367,134 @@ void Renderer::recordRenderers(uint32_t imageIndex, const Camera &camera)
         .depthStencil = {1.f, 0},
     };
     std::array<VkClearValue, 2> clearValues = {clearColor, clearDepth};
-    VkRenderPassBeginInfo renderPassBeginInfo = {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .renderPass = m_renderPass->getHandle(),
-        .framebuffer = m_renderPass->getFramebuffer(imageIndex),
-        .renderArea =
-            {
-                .offset = {0, 0},
-                .extent = m_swapchain->getExtent(),
-            },
-        .clearValueCount = static_cast<uint32_t>(clearValues.size()),
-        .pClearValues = clearValues.data(),
+    // a render pass recorded in secondary command buffers only executes them
+    bool bParallel = threadCount > 1;
+    m_renderPass->recordBegin(commandBuffer, imageIndex, clearValues,
+                              bParallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+    // the camera matrices are computed once per frame
+    RenderStateABC::CameraT cameraData = {
+        .view = camera.getViewMatrix(),
+        .proj = camera.getProjectionMatrix(),
     };
-    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    for (int i = 0; i < m_renderStates.size(); ++i)
+    std::optional<UniformSliceT> cameraSlice = m_uniformRing->allocate(sizeof(RenderStateABC::CameraT));
+    if (cameraSlice.has_value())
     {
-        m_renderStates[i]->updateUniformBuffers(imageIndex, camera);
-
-        m_renderStates[i]->getPipeline()->recordBind(commandBuffer, imageIndex);
+        m_uniformRing->write(*cameraSlice, std::as_bytes(std::span(&cameraData, 1)));
+        m_uniformRing->flush();
+    }
+    else
+        std::cerr << "Failed to allocate the camera uniforms, nothing is drawn this frame" << std::endl;
+    uint32_t cameraOffset = cameraSlice.has_value() ? static_cast<uint32_t>(cameraSlice->offset) : 0;
 
-        m_renderStates[i]->recordBackBufferDescriptorSetsCommands(commandBuffer, imageIndex);
-        m_renderStates[i]->recordBackBufferDrawObjectCommands(commandBuffer);
+    if (cameraSlice.has_value() && !bParallel)
+    {
+        recordDraws(*m_commandRecorders[0], commandBuffer, 0, m_drawBuckets.size(), cameraOffset);
+    }
+    else if (cameraSlice.has_value())
+    {
+        // each thread records a contiguous range of the sorted buckets, the ranges are executed in order
+        std::vector<VkCommandBuffer> secondaryCommandBuffers(threadCount, VK_NULL_HANDLE);
+        m_recordingWorkers->run(threadCount, [&](uint32_t threadIndex) {
+            VkCommandBuffer secondaryCommandBuffer = frame.getSecondaryCommandBuffer(threadIndex);
+            if (!m_renderPass->beginSecondaryCommandBuffer(secondaryCommandBuffer, imageIndex))
+                return;
+
+            size_t first = m_drawBuckets.size() * threadIndex / threadCount;
+            size_t last = m_drawBuckets.size() * (threadIndex + 1) / threadCount;
+            recordDraws(*m_commandRecorders[threadIndex], secondaryCommandBuffer, first, last, cameraOffset);
+
+            VkResult secondaryRes = vkEndCommandBuffer(secondaryCommandBuffer);
+            if (secondaryRes != VK_SUCCESS)
+            {
+                std::cerr << "Failed to record secondary command buffer : " << secondaryRes << std::endl;
+                return;
+            }
+            secondaryCommandBuffers[threadIndex] = secondaryCommandBuffer;
+        });
+
+        std::erase(secondaryCommandBuffers, VK_NULL_HANDLE);
+        if (!secondaryCommandBuffers.empty())
+        {
+            vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaryCommandBuffers.size()),
+                                 secondaryCommandBuffers.data());
+        }
     }
 
-    vkCmdEndRenderPass(commandBuffer);
+    m_renderPass->recordEnd(commandBuffer, imageIndex);
 
-    res = vkEndCommandBuffer(commandBuffer);
+    VkResult res = vkEndCommandBuffer(commandBuffer);
     if (res != VK_SUCCESS)
         std::cerr << "Failed to record command buffer : " << res << std::endl;
 }
 
-void Renderer::submitBackBuffer()
+void Renderer::recordRenderers(uint32_t imageIndex, const Camera &camera)
 {
-    VkSemaphore waitSemaphores[] = {m_backBuffers[m_backBufferIndex].acquireSemaphore};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    VkSemaphore signalSemaphores[] = {m_backBuffers[m_backBufferIndex].renderSemaphore};
-    VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = waitSemaphores,
-        .pWaitDstStageMask = waitStages,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &m_backBuffers[m_backBufferIndex].commandBuffer,
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = signalSemaphores,
-    };
+    // the moved resources are recreated before their handles are gathered in the draw packets
+    if (!beginFrameCommands(m_defragmentationBudget, true))
+        return;
+    gatherDrawPackets(camera);
 
-    VkResult res = vkQueueSubmit(m_device.lock()->getGraphicsQueue(), 1, &submitInfo,
-                                 m_backBuffers[m_backBufferIndex].inFlightFence);
-    if (res != VK_SUCCESS)
-        std::cerr << "Failed to submit draw command buffer : " << res << std::endl;
+    // below a few buckets per thread, the secondary command buffers cost more than they save
+    uint32_t threadCount = static_cast<uint32_t>(
+        std::clamp<size_t>(m_drawBuckets.size() / minDrawBucketsPerThread, 1, m_recordingThreadCount));
+    recordFrame(imageIndex, camera, threadCount);
+}
+
+void Renderer::benchmarkRecording(const Camera &camera, uint32_t drawCount, uint32_t frameCount)
+{
+    if (m_renderStates.empty() || frameCount == 0)
+        return;
+
+    // the registered states are drawn repeatedly up to the draw count
+    std::vector<std::shared_ptr<RenderStateABC>> renderStates = m_renderStates;
+    m_renderStates.clear();
+    for (uint32_t i = 0; i < drawCount; ++i)
+        m_renderStates.emplace_back(renderStates[i % renderStates.size()]);
+    // the copies of a state would be merged in a single draw
+    m_bMergingDraws = false;
+    m_bDrawPacketsDirty = true;
+
+    std::chrono::nanoseconds baseDuration(0);
+    for (uint32_t threadCount = 1; threadCount <= m_recordingThreadCount; threadCount *= 2)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < frameCount; ++i)
+        {
+            // nothing is submitted, the fences stay signaled and the frames are only recycled
+            m_completedFrameSerial = m_frames[m_frameIndex]->begin(*m_uniformRing);
+            // the defragmenter copies and the upload acquisitions must be executed, they are left out
+            if (!beginFrameCommands(0, false))
+                break;
+            gatherDrawPackets(camera);
+            recordFrame(0, camera, threadCount);
+            swapBuffers();
+        }
+        auto duration = (std::chrono::steady_clock::now() - start) / frameCount;
+        if (threadCount == 1)
+            baseDuration = duration;
+
+        std::cout << "Recording benchmark : " << m_renderStates.size() << " draw(s) in " << m_drawBatches.size()
+                  << " instanced draw(s) and " << m_drawBuckets.size() << " bucket(s) on " << threadCount
+                  << " thread(s) in " << std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
+                  << " us per frame (x" << static_cast<float>(baseDuration.count()) / duration.count() << ")"
+                  << std::endl;
+    }
+
+    m_renderStates = std::move(renderStates);
+    m_bMergingDraws = true;
+    m_bDrawPacketsDirty = true;
+}
+
+void Renderer::submitBackBuffer(uint32_t imageIndex)
+{
+    m_frames[m_frameIndex]->submit(m_device.lock()->getGraphicsQueue(), m_renderSemaphores[imageIndex]);
 }
 
 void Renderer::presentBackBuffer(uint32_t imageIndex)
 {
     VkSwapchainKHR swapchains[] = {m_swapchain->getHandle()};
-    VkSemaphore waitSemaphores[] = {m_backBuffers[m_backBufferIndex].renderSemaphore};
+    VkSemaphore waitSemaphores[] = {m_renderSemaphores[imageIndex]};
     VkPresentInfoKHR presentInfo = {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = 1,
@@ -159,13 +512,15 @@ void Renderer::presentBackBuffer(uint32_t imageIndex)
 
 void Renderer::swapBuffers()
 {
-    m_backBufferIndex = (m_backBufferIndex + 1) % m_bufferingType;
+    m_frameIndex = (m_frameIndex + 1) % m_frameInFlightCount;
 }
 
 std::unique_ptr<Renderer> RendererBuilder::build()
 {
     assert(m_device.lock());
     assert(m_swapchain);
+    assert(m_product->m_frameInFlightCount > 0);
+    assert(m_product->m_recordingThreadCount > 0);
 
     auto devicePtr = m_device.lock();
     auto deviceHandle = devicePtr->getHandle();
@@ -177,60 +532,79 @@ std::unique_ptr<Renderer> RendererBuilder::build()
     rpb.addDepthAttachment(m_swapchain->getDepthImageFormat());
     m_product->m_renderPass = rpb.build();
 
-    // back buffers
+    // the indirect commands of the batches start at their first instance
+    m_product->m_bIndirectDrawing =
+        m_product->m_bIndirectDrawing && devicePtr->getPhysicalDeviceFeatures().drawIndirectFirstInstance;
+
+    // recording threads, the calling thread included
+    m_product->m_recordingWorkers = std::make_unique<RecordingWorkers>(m_product->m_recordingThreadCount - 1);
+    for (uint32_t i = 0; i < m_product->m_recordingThreadCount; ++i)
+        m_product->m_commandRecorders.emplace_back(std::make_unique<CommandRecorder>(m_device));
+
+    // uniforms
+
+    UniformRingBufferBuilder urbb;
+    urbb.setDevice(m_device);
+    urbb.setFrameCount(m_product->m_frameInFlightCount);
+    m_product->m_uniformRing = urbb.build();
+
+    // the uniform buffer is a dynamic one, a single frame set serves every frame in flight
+    UniformDescriptorBuilder udb;
+    udb.addSetLayoutBinding(VkDescriptorSetLayoutBinding{
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    });
+    m_product->m_frameDescriptorPack = udb.build();
+
+    VkDescriptorBufferInfo cameraBufferInfo = {
+        .buffer = m_product->m_uniformRing->getBufferHandle(),
+        .offset = 0,
+        .range = sizeof(RenderStateABC::CameraT),
+    };
+    VkWriteDescriptorSet cameraWrite = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .pBufferInfo = &cameraBufferInfo,
+    };
+    VkDescriptorSetLayout frameSetLayout = devicePtr->getPipelineRegistry()->getDescriptorSetLayout(
+        m_product->m_frameDescriptorPack->getSetLayoutBindings());
+    m_product->m_frameDescriptorSet =
+        devicePtr->getDescriptorAllocator()->getImmutableSet(frameSetLayout, std::span(&cameraWrite, 1));
+    if (m_product->m_frameDescriptorSet == VK_NULL_HANDLE)
+        return nullptr;
 
-    m_product->m_backBuffers.resize(m_product->m_bufferingType);
+    // frames in flight
 
-    VkCommandBufferAllocateInfo commandBufferAllocInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = devicePtr->getCommandPool(),
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1U,
-    };
-    for (int i = 0; i < m_product->m_bufferingType; ++i)
+    for (uint32_t i = 0; i < m_product->m_frameInFlightCount; ++i)
     {
-        VkResult res =
-            vkAllocateCommandBuffers(deviceHandle, &commandBufferAllocInfo, &m_product->m_backBuffers[i].commandBuffer);
-        if (res != VK_SUCCESS)
-        {
-            std::cerr << "Failed to allocate command buffers : " << res << std::endl;
+        FrameContextBuilder fcb;
+        fcb.setDevice(m_device);
+        fcb.setFrameIndex(i);
+        if (m_product->m_recordingThreadCount > 1)
+            fcb.setSecondaryCommandBufferCount(m_product->m_recordingThreadCount);
+        std::unique_ptr<FrameContext> frame = fcb.build();
+        if (!frame)
             return nullptr;
-        }
+        m_product->m_frames.emplace_back(std::move(frame));
     }
 
-    // synchronization
-
     VkSemaphoreCreateInfo semaphoreCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
     };
-    VkFenceCreateInfo fenceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-    };
-    for (int i = 0; i < m_product->m_bufferingType; ++i)
+    m_product->m_renderSemaphores.resize(m_swapchain->getImages().size(), VK_NULL_HANDLE);
+    for (VkSemaphore &renderSemaphore : m_product->m_renderSemaphores)
     {
-        VkResult res = vkCreateSemaphore(deviceHandle, &semaphoreCreateInfo, nullptr,
-                                         &m_product->m_backBuffers[i].acquireSemaphore);
-        if (res != VK_SUCCESS)
-        {
-            std::cerr << "Failed to create semaphore : " << res << std::endl;
-            return nullptr;
-        }
-
-        res = vkCreateSemaphore(deviceHandle, &semaphoreCreateInfo, nullptr,
-                                &m_product->m_backBuffers[i].renderSemaphore);
+        VkResult res = vkCreateSemaphore(deviceHandle, &semaphoreCreateInfo, nullptr, &renderSemaphore);
         if (res != VK_SUCCESS)
         {
             std::cerr << "Failed to create semaphore : " << res << std::endl;
             return nullptr;
         }
-
-        res = vkCreateFence(deviceHandle, &fenceCreateInfo, nullptr, &m_product->m_backBuffers[i].inFlightFence);
-        if (res != VK_SUCCESS)
-        {
-            std::cerr << "Failed to create fence : " << res << std::endl;
-            return nullptr;
-        }
     }
 
     auto result = std::move(m_product);
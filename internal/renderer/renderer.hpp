@@ -1,8 +1,14 @@
 #pragma once
 
 #include <memory>
+#include <thread>
+#include <vector>
 
+#include "graphics/command_recorder.hpp"
 #include "graphics/render_pass.hpp"
+#include "graphics/uniform_ring_buffer.hpp"
+
+#include "draw_packet.hpp"
 
 class Device;
 class SwapChain;
@@ -12,15 +18,9 @@ class Texture;
 class Buffer;
 class Camera;
 class RenderStateABC;
-
-struct BackBufferT
-{
-    VkCommandBuffer commandBuffer;
-
-    VkSemaphore acquireSemaphore;
-    VkSemaphore renderSemaphore;
-    VkFence inFlightFence;
-};
+class UniformDescriptor;
+class FrameContext;
+class RecordingWorkers;
 
 class RendererBuilder;
 
@@ -32,18 +32,99 @@ class Renderer
     std::weak_ptr<Device> m_device;
     const SwapChain *m_swapchain;
 
-    int m_bufferingType = 2;
+    uint32_t m_frameInFlightCount = 2;
 
     std::unique_ptr<RenderPass> m_renderPass;
 
+    // threads recording the render states in secondary command buffers, the calling thread included
+    uint32_t m_recordingThreadCount = 1;
+    std::unique_ptr<RecordingWorkers> m_recordingWorkers;
+    // one per recording thread, skips the binds repeated between the render states
+    std::vector<std::unique_ptr<CommandRecorder>> m_commandRecorders;
+
+    std::unique_ptr<UniformRingBuffer> m_uniformRing;
+
+    // frame set (RenderStateABC::frameSetIndex), holds the camera written once per frame
+    std::shared_ptr<UniformDescriptor> m_frameDescriptorPack;
+    VkDescriptorSet m_frameDescriptorSet = VK_NULL_HANDLE;
+
     std::vector<std::shared_ptr<RenderStateABC>> m_renderStates;
 
-    int m_backBufferIndex = 0;
-    std::vector<BackBufferT> m_backBuffers;
+    // draw of each render state, in the same order, rebuilt when the state changes only
+    std::vector<DrawPacketT> m_drawPackets;
+    // every packet is rebuilt by the next gather (states registered, resources moved by the defragmenter)
+    bool m_bDrawPacketsDirty = true;
+    // states whose packet is rebuilt every frame until their specialized pipeline is swapped in
+    std::vector<uint32_t> m_pendingPipelineStates;
+    // incremented when the instance data of a packet changes, the frames skip the instances they already hold
+    uint64_t m_drawPacketVersion = 1;
+
+    // sorted order of the draws, their instanced batches and the buckets of batches sharing their state, kept
+    // between the frames to reuse their storage
+    std::vector<DrawSortEntryT> m_drawOrder;
+    std::vector<DrawSortEntryT> m_drawOrderScratch;
+    std::vector<DrawBatchT> m_drawBatches;
+    std::vector<DrawBucketT> m_drawBuckets;
+
+    // draw the buckets from the indirect buffer of the frame instead of a draw per batch
+    bool m_bIndirectDrawing = true;
+    // merge the draws sharing their state in batches and buckets, off while benchmarking the recording
+    bool m_bMergingDraws = true;
+
+    // pipelines compiled ahead of their first use, kept alive so that the registry can share them
+    std::vector<std::shared_ptr<Pipeline>> m_warmPipelines;
+
+    uint32_t m_frameIndex = 0;
+    std::vector<std::unique_ptr<FrameContext>> m_frames;
+
+    // signaled by the submission presenting the image, one per swapchain image as presentation does not
+    // tell when it is done waiting
+    std::vector<VkSemaphore> m_renderSemaphores;
+
+    // last frame known to be retired by the GPU
+    uint64_t m_completedFrameSerial = 0;
+
+    // bytes the memory defragmenter may copy per frame (0 disables it)
+    VkDeviceSize m_defragmentationBudget = 4 * 1024 * 1024;
 
     Renderer() = default;
 
+    /**
+     * @brief Prepare a render state and rebuild its draw packet
+     *
+     */
+    void rebuildDrawPacket(uint32_t stateIndex);
+    /**
+     * @brief Sort the draw packets and merge them in instanced batches and buckets
+     *
+     * The packets of the changed render states are rebuilt first, the others only get their depth updated.
+     * The instances, and the indirect commands of the batches when drawing indirectly, are written to the
+     * buffers of the current frame in the sorted order.
+     */
+    void gatherDrawPackets(const Camera &camera);
+    /**
+     * @brief Record a range of the buckets
+     *
+     */
+    void recordDraws(CommandRecorder &recorder, VkCommandBuffer commandBuffer, size_t first, size_t last,
+                     uint32_t cameraOffset);
+    /**
+     * @brief Begin the command buffer of the frame with the upload acquisitions and the defragmenter pass
+     *
+     * Called before the draw packets are gathered so that they capture the handles of the moved resources.
+     * @param bAcquireUploads false if the frame is not submitted, the uploads are then acquired by the next one
+     */
+    [[nodiscard]] bool beginFrameCommands(VkDeviceSize defragmentationBudget, bool bAcquireUploads);
+    /**
+     * @brief Record the gathered buckets of the frame and end its command buffer
+     *
+     */
+    void recordFrame(uint32_t imageIndex, const Camera &camera, uint32_t threadCount);
+
   public:
+    // buckets recorded by a thread at least, fewer buckets are recorded inline
+    static constexpr size_t minDrawBucketsPerThread = 128;
+
     ~Renderer();
 
     Renderer(const Renderer &) = delete;
@@ -52,12 +133,38 @@ class Renderer
     Renderer &operator=(Renderer &&) = delete;
 
     void registerRenderState(std::shared_ptr<RenderStateABC> renderState);
+    /**
+     * @brief Rebuild the draw packets of every render state on the next frame
+     *
+     * The packets keep the handles of the meshes and textures, this must be called when one of the resources
+     * of a registered state is destroyed or replaced.
+     */
+    void invalidateDrawPackets()
+    {
+        m_bDrawPacketsDirty = true;
+    }
+
+    /**
+     * @brief Compile the pipelines recorded in the device's pipeline manifest on worker threads
+     *
+     * @param threadCount number of threads compiling, the calling thread included
+     */
+    void warmupPipelines(uint32_t threadCount = std::thread::hardware_concurrency());
 
     uint32_t acquireBackBuffer();
 
     void recordRenderers(uint32_t imageIndex, const Camera &camera);
 
-    void submitBackBuffer();
+    /**
+     * @brief Time the recording of the render states on 1, 2, 4... threads up to the recording thread count
+     *
+     * The registered states are recorded repeatedly up to the draw count. The copies are not merged so that
+     * every draw is recorded in its own bucket and the work shared between the threads grows with the draw
+     * count. Nothing is submitted and the defragmenter is left out, it is called between two frames.
+     */
+    void benchmarkRecording(const Camera &camera, uint32_t drawCount, uint32_t frameCount = 100);
+
+    void submitBackBuffer(uint32_t imageIndex);
     void presentBackBuffer(uint32_t imageIndex);
 
     void swapBuffers();
@@ -67,6 +174,18 @@ class Renderer
     {
         return m_renderPass.get();
     }
+    [[nodiscard]] const UniformRingBuffer *getUniformRingBuffer() const
+    {
+        return m_uniformRing.get();
+    }
+    /**
+     * @brief Layout of the frame set, the first uniform descriptor pack of every pipeline drawn by the renderer
+     *
+     */
+    [[nodiscard]] std::shared_ptr<UniformDescriptor> getFrameDescriptorPack() const
+    {
+        return m_frameDescriptorPack;
+    }
 };
 
 class RendererBuilder
@@ -80,7 +199,7 @@ class RendererBuilder
     void restart()
     {
         m_product = std::unique_ptr<Renderer>(new Renderer);
-        m_product->m_bufferingType = 2U;
+        m_product->m_frameInFlightCount = 2U;
     }
 
   public:
@@ -99,9 +218,33 @@ class RendererBuilder
         m_swapchain = swapchain;
         m_product->m_swapchain = swapchain;
     }
-    void setBufferingType(uint32_t type)
+    /**
+     * @brief Number of frames recorded while the GPU executes the previous ones, whatever the swapchain image count
+     *
+     */
+    void setFrameInFlightCount(uint32_t count)
+    {
+        m_product->m_frameInFlightCount = count;
+    }
+    /**
+     * @brief Threads recording the render states in parallel, the calling thread included
+     *
+     */
+    void setRecordingThreadCount(uint32_t count)
+    {
+        m_product->m_recordingThreadCount = count;
+    }
+    /**
+     * @brief Draw the batches sharing their state with an indirect draw (needs drawIndirectFirstInstance)
+     *
+     */
+    void setIndirectDrawing(bool bIndirect)
+    {
+        m_product->m_bIndirectDrawing = bIndirect;
+    }
+    void setDefragmentationBudget(VkDeviceSize a)
     {
-        m_product->m_bufferingType = type;
+        m_product->m_defragmentationBudget = a;
     }
 
     std::unique_ptr<Renderer> build();
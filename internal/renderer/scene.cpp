@@ -1,3 +1,5 @@
+#include "graphics/upload_context.hpp"
+
 #include "mesh.hpp"
 #include "texture.hpp"
 
@@ -5,10 +7,16 @@
 
 Scene::Scene(const std::weak_ptr<Device> device)
 {
+    // every asset upload of the scene goes in the same batch
+    UploadContextBuilder ucb;
+    ucb.setDevice(device);
+    std::unique_ptr<UploadContext> uploadContext = ucb.build();
+
     MeshBuilder mb;
     MeshDirector md;
     md.createAssimpMeshBuilder(mb);
     mb.setDevice(device);
+    mb.setUploadContext(uploadContext.get());
     mb.setModelFilename("assets/viking_room.obj");
     std::shared_ptr<Mesh> mesh = mb.build();
 
@@ -16,6 +24,7 @@ Scene::Scene(const std::weak_ptr<Device> device)
     TextureDirector td;
     td.createSRGBTextureBuilder(tb);
     tb.setDevice(device);
+    tb.setUploadContext(uploadContext.get());
     tb.setTextureFilename("assets/viking_room.png");
     mesh->setTexture(tb.build());
 
@@ -46,4 +55,7 @@ Scene::Scene(const std::weak_ptr<Device> device)
     mesh2->setTexture(tb.build());
 
     m_objects.push_back(mesh2);
+
+    uploadContext->submit();
+    uploadContext->wait();
 }
\ No newline at end of file
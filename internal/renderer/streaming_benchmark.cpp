@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <iostream>
+
+#include "graphics/buffer.hpp"
+#include "graphics/upload_context.hpp"
+
+#include "streaming_benchmark.hpp"
+
+StreamingBenchmark::StreamingBenchmark(std::weak_ptr<Device> device, VkDeviceSize totalSize, VkDeviceSize batchSize,
+                                       uint32_t baselineFrameCount)
+    : m_device(device), m_totalSize(totalSize), m_batchSize(batchSize), m_baselineFrameCount(baselineFrameCount)
+{
+    UploadContextBuilder ucb;
+    ucb.setDevice(device);
+    m_uploadContext = ucb.build();
+    if (!m_uploadContext)
+    {
+        std::cerr << "Failed to create streaming benchmark upload context" << std::endl;
+        m_bDone = true;
+        return;
+    }
+
+    m_batchData.resize(m_batchSize);
+    for (size_t i = 0; i < m_batchData.size(); ++i)
+        m_batchData[i] = static_cast<unsigned char>(i);
+}
+
+StreamingBenchmark::~StreamingBenchmark()
+{
+    // the destination buffers are released after the upload context has waited for the last batch
+    m_uploadContext.reset();
+    m_batchBuffers.clear();
+}
+
+void StreamingBenchmark::update(double frameDuration)
+{
+    if (m_bDone)
+        return;
+
+    // the first frame duration covers the loading of the scene
+    if (m_frameCount++ == 0)
+        return;
+
+    if (m_frameCount <= m_baselineFrameCount)
+    {
+        m_baselineDuration += frameDuration;
+        return;
+    }
+
+    m_streamingDuration += frameDuration;
+    m_maxStreamingFrameDuration = std::max(m_maxStreamingFrameDuration, frameDuration);
+    ++m_streamingFrameCount;
+
+    // the batch in flight is not complete, rendering goes on without waiting for it
+    if (!m_uploadContext->poll())
+        return;
+
+    // buffers of the previous batch are destroyed once the frames acquiring them are complete
+    m_batchBuffers.clear();
+
+    if (m_streamedSize >= m_totalSize)
+    {
+        report();
+        m_bDone = true;
+        return;
+    }
+
+    VkDeviceSize size = std::min(m_batchSize, m_totalSize - m_streamedSize);
+
+    BufferBuilder bb;
+    BufferDirector bd;
+    bd.createVertexBufferBuilder(bb);
+    bb.setDevice(m_device);
+    bb.setSize(size);
+    bb.setDefragmentable(false);
+    std::unique_ptr<Buffer> buffer = bb.build();
+    if (!buffer)
+    {
+        std::cerr << "Failed to create streaming benchmark buffer" << std::endl;
+        m_bDone = true;
+        return;
+    }
+
+    m_uploadContext->uploadBuffer(*buffer, m_batchData.data(), size);
+    m_uploadContext->submit();
+
+    m_batchBuffers.emplace_back(std::move(buffer));
+    m_streamedSize += size;
+}
+
+void StreamingBenchmark::report() const
+{
+    double baselineFrameDuration = m_baselineDuration / std::max(m_baselineFrameCount - 1, 1U);
+    double streamingFrameDuration = m_streamingDuration / std::max(m_streamingFrameCount, 1U);
+
+    std::cout << "Streaming benchmark : " << m_streamedSize / (1024 * 1024) << " MB streamed on the "
+              << (m_uploadContext->usesTransferQueue() ? "transfer" : "graphics") << " queue in "
+              << m_streamingFrameCount << " frame(s) (" << m_streamingDuration * 1000.0 << " ms), "
+              << streamingFrameDuration * 1000.0 << " ms per frame on average (max "
+              << m_maxStreamingFrameDuration * 1000.0 << " ms) against " << baselineFrameDuration * 1000.0
+              << " ms without streaming" << std::endl;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+class Device;
+class Buffer;
+class UploadContext;
+
+/**
+ * @brief Streams device local buffers while the frames are rendered and reports the frame times
+ *
+ * The frame times of a few frames without uploads are taken as the baseline, then a batch of data is
+ * uploaded each time the previous one is complete until the total size is reached. Comparing both tells
+ * how much the uploads slow down rendering.
+ */
+class StreamingBenchmark
+{
+  private:
+    std::weak_ptr<Device> m_device;
+
+    std::unique_ptr<UploadContext> m_uploadContext;
+
+    VkDeviceSize m_totalSize;
+    VkDeviceSize m_batchSize;
+    VkDeviceSize m_streamedSize = 0;
+    // source data of every batch
+    std::vector<unsigned char> m_batchData;
+    // destination of the batch in flight, released once the next one is submitted
+    std::vector<std::unique_ptr<Buffer>> m_batchBuffers;
+
+    uint32_t m_baselineFrameCount;
+    uint32_t m_frameCount = 0;
+    double m_baselineDuration = 0.0;
+    double m_streamingDuration = 0.0;
+    double m_maxStreamingFrameDuration = 0.0;
+    uint32_t m_streamingFrameCount = 0;
+
+    bool m_bDone = false;
+
+    void report() const;
+
+  public:
+    StreamingBenchmark(std::weak_ptr<Device> device, VkDeviceSize totalSize, VkDeviceSize batchSize = 16 * 1024 * 1024,
+                       uint32_t baselineFrameCount = 120);
+    ~StreamingBenchmark();
+
+    StreamingBenchmark(const StreamingBenchmark &) = delete;
+    StreamingBenchmark &operator=(const StreamingBenchmark &) = delete;
+    StreamingBenchmark(StreamingBenchmark &&) = delete;
+    StreamingBenchmark &operator=(StreamingBenchmark &&) = delete;
+
+    /**
+     * @brief Account for the last frame and submit the next batch if the previous one is complete
+     *
+     * Called once per frame after its submission.
+     * @param frameDuration duration of the last frame in seconds
+     */
+    void update(double frameDuration);
+
+  public:
+    [[nodiscard]] inline bool isDone() const
+    {
+        return m_bDone;
+    }
+};
@@ -3,6 +3,7 @@
 #include "graphics/buffer.hpp"
 #include "graphics/device.hpp"
 #include "graphics/image.hpp"
+#include "graphics/upload_context.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -15,9 +16,41 @@ Texture::~Texture()
     if (!m_device.lock())
         return;
 
-    auto deviceHandle = m_device.lock()->getHandle();
-    vkDestroySampler(deviceHandle, m_sampler, nullptr);
-    vkDestroyImageView(deviceHandle, m_imageView, nullptr);
+    auto devicePtr = m_device.lock();
+    devicePtr->getDeletionQueue()->push([deviceHandle = devicePtr->getHandle(),
+                                         descriptorAllocator = devicePtr->getDescriptorAllocator(),
+                                         bindlessTable = devicePtr->getBindlessTable(), sampler = m_sampler,
+                                         imageView = m_imageView, bindlessSlot = m_bindlessSlot]() {
+        descriptorAllocator->evictSets(imageView);
+        if (bindlessTable)
+            bindlessTable->releaseTexture(bindlessSlot);
+        vkDestroySampler(deviceHandle, sampler, nullptr);
+        vkDestroyImageView(deviceHandle, imageView, nullptr);
+    });
+}
+
+bool Texture::updateImageView(uint64_t generation)
+{
+    if (m_imageGeneration != m_image->getGeneration())
+    {
+        // frames in flight still use the old view
+        auto devicePtr = m_device.lock();
+        devicePtr->getDeletionQueue()->push([deviceHandle = devicePtr->getHandle(),
+                                             descriptorAllocator = devicePtr->getDescriptorAllocator(),
+                                             bindlessTable = devicePtr->getBindlessTable(), imageView = m_imageView,
+                                             bindlessSlot = m_bindlessSlot]() {
+            descriptorAllocator->evictSets(imageView);
+            if (bindlessTable)
+                bindlessTable->releaseTexture(bindlessSlot);
+            vkDestroyImageView(deviceHandle, imageView, nullptr);
+        });
+
+        m_imageView = m_image->createImageView();
+        m_imageGeneration = m_image->getGeneration();
+        if (BindlessTable *bindlessTable = devicePtr->getBindlessTable())
+            m_bindlessSlot = bindlessTable->registerTexture(m_imageView, m_sampler);
+    }
+    return m_imageGeneration != generation;
 }
 
 std::unique_ptr<Texture> TextureBuilder::build()
@@ -46,15 +79,6 @@ std::unique_ptr<Texture> TextureBuilder::build()
         stbi_image_free(textureData);
     }
 
-    BufferBuilder bb;
-    BufferDirector bd;
-    bd.createStagingBufferBuilder(bb);
-    bb.setDevice(m_device);
-    bb.setSize(imageSize);
-    std::unique_ptr<Buffer> stagingBuffer = bb.build();
-
-    stagingBuffer->copyDataToMemory(m_product->m_imageData.data());
-
     ImageBuilder ib;
     ImageDirector id;
     id.createSampledImage2DBuilder(ib);
@@ -65,22 +89,26 @@ std::unique_ptr<Texture> TextureBuilder::build()
     ib.setTiling(m_tiling);
     m_product->m_image = ib.build();
 
-    ImageLayoutTransitionBuilder iltb;
-    ImageLayoutTransitionDirector iltd;
+    // staging copy and layout transitions are recorded in a single batch
 
-    iltd.createBuilder<VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL>(iltb);
-    iltb.setImage(*m_product->m_image);
-    m_product->m_image->transitionImageLayout(*iltb.build());
-
-    m_product->m_image->copyBufferToImage(stagingBuffer->getHandle());
-
-    iltd.createBuilder<VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL>(iltb);
-    iltb.setImage(*m_product->m_image);
-    m_product->m_image->transitionImageLayout(*iltb.build());
+    if (m_uploadContext)
+    {
+        m_uploadContext->uploadImage(*m_product->m_image, m_product->m_imageData.data(), imageSize);
+    }
+    else
+    {
+        UploadContextBuilder ucb;
+        ucb.setDevice(m_device);
+        std::unique_ptr<UploadContext> uploadContext = ucb.build();
+        uploadContext->uploadImage(*m_product->m_image, m_product->m_imageData.data(), imageSize);
+        uploadContext->submit();
+        uploadContext->wait();
+    }
 
     // image view
 
     m_product->m_imageView = m_product->m_image->createImageView();
+    m_product->m_imageGeneration = m_product->m_image->getGeneration();
 
     // sampler
 
@@ -113,6 +141,10 @@ std::unique_ptr<Texture> TextureBuilder::build()
         return nullptr;
     }
 
+    // bindless slot, the texture is still usable through descriptor sets if the table is full
+    if (BindlessTable *bindlessTable = devicePtr->getBindlessTable())
+        m_product->m_bindlessSlot = bindlessTable->registerTexture(m_product->m_imageView, m_product->m_sampler);
+
     auto result = std::move(m_product);
     restart();
     return result;
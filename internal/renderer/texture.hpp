@@ -2,9 +2,11 @@
 
 #include <vulkan/vulkan.h>
 
+#include "graphics/bindless_table.hpp"
 #include "graphics/image.hpp"
 
 class Device;
+class UploadContext;
 class TextureBuilder;
 
 class Texture
@@ -21,6 +23,12 @@ class Texture
     VkImageView m_imageView;
     VkSampler m_sampler;
 
+    // generation of the image the view was created for
+    uint64_t m_imageGeneration = 0;
+
+    // slot of the view in the device's bindless table, if it has one
+    uint32_t m_bindlessSlot = BindlessTable::invalidSlot;
+
     std::vector<unsigned char> m_imageData;
 
     Texture() = default;
@@ -33,6 +41,14 @@ class Texture
     Texture(Texture &&) = delete;
     Texture &operator=(Texture &&) = delete;
 
+    /**
+     * @brief Recreate the image view if the image has been moved by the defragmenter
+     *
+     * The new view gets a new bindless slot, frames in flight keep reading the old one.
+     * @return true if the view has changed since the given generation
+     */
+    bool updateImageView(uint64_t generation);
+
   public:
     [[nodiscard]] inline const VkSampler &getSampler() const
     {
@@ -42,6 +58,14 @@ class Texture
     {
         return m_imageView;
     }
+    [[nodiscard]] inline uint64_t getImageGeneration() const
+    {
+        return m_imageGeneration;
+    }
+    [[nodiscard]] inline uint32_t getBindlessSlot() const
+    {
+        return m_bindlessSlot;
+    }
 };
 
 class TextureBuilder
@@ -58,6 +82,8 @@ class TextureBuilder
     std::string m_textureFilename;
     bool m_bLoadFromFile = false;
 
+    UploadContext *m_uploadContext = nullptr;
+
     void restart()
     {
         m_product = std::unique_ptr<Texture>(new Texture);
@@ -108,6 +134,15 @@ class TextureBuilder
     {
         m_samplerFilter = a;
     }
+    /**
+     * @brief Record the upload in a shared context instead of submitting it right away
+     *
+     * The texture can only be sampled once the context has been submitted and completed.
+     */
+    void setUploadContext(UploadContext *uploadContext)
+    {
+        m_uploadContext = uploadContext;
+    }
 
     std::unique_ptr<Texture> build();
 };
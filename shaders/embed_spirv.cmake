@@ -0,0 +1,31 @@
+# Writes the words of a SPIR-V file as a constexpr array in a C++ header
+#
+# -DSPIRV_FILE=<compiled shader> -DHEADER_FILE=<generated header> -DIDENTIFIER=<array name>
+
+file(READ "${SPIRV_FILE}" SPIRV_HEX HEX)
+
+# glslc writes little-endian words, starting with the magic number 0x07230203
+string(SUBSTRING "${SPIRV_HEX}" 0 8 SPIRV_MAGIC)
+if(NOT SPIRV_MAGIC STREQUAL "03022307")
+	message(FATAL_ERROR "${SPIRV_FILE} is not a little-endian SPIR-V module")
+endif()
+
+string(REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])"
+	"0x\\4\\3\\2\\1, " SPIRV_WORDS "${SPIRV_HEX}")
+# eight words per line (CMake regexes have no repetition count)
+set(SPIRV_WORD "0x[0-9a-f]+, ")
+string(REGEX REPLACE "(${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD})"
+	"\\1\n    " SPIRV_WORDS "${SPIRV_WORDS}")
+string(REPLACE ", \n" ",\n" SPIRV_WORDS "${SPIRV_WORDS}")
+string(STRIP "${SPIRV_WORDS}" SPIRV_WORDS)
+
+file(WRITE "${HEADER_FILE}"
+	"#pragma once\n"
+	"\n"
+	"#include <cstdint>\n"
+	"\n"
+	"// generated from ${SPIRV_FILE}\n"
+	"inline constexpr uint32_t ${IDENTIFIER}[] = {\n"
+	"    ${SPIRV_WORDS}\n"
+	"};\n"
+)
@@ -1,5 +1,9 @@
 #version 450
 
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
 layout(location = 0) in vec3 fragNormal;
 layout(location = 1) in vec3 fragColor;
 layout(location = 2) in vec2 fragUV;
@@ -7,7 +11,25 @@ layout(location = 3) in vec3 fragPos;
 
 layout(location = 0) out vec4 oColor;
 
-layout(binding = 1) uniform sampler2D texSampler;
+#ifdef BINDLESS
+// device wide table (see internal/graphics/bindless_table.hpp) in place of the material set, the instances
+// of a draw may read different slots
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(location = 4) flat in uint fragTextureSlot;
+
+#define texSampler textures[nonuniformEXT(fragTextureSlot)]
+#else
+// material set
+layout(set = 1, binding = 0) uniform sampler2D texSampler;
+#endif
+
+// variants (see internal/engine/shader_constants.hpp)
+layout(constant_id = 0) const int LIGHT_COUNT = 1;
+layout(constant_id = 1) const bool USE_TEXTURE = true;
+layout(constant_id = 2) const bool ALPHA_TEST = false;
+
+const int MAX_LIGHT_COUNT = 4;
 
 struct PointLight
 {
@@ -25,7 +47,11 @@ struct Lighting
     vec3 specular;
 };
 
-PointLight light0 = PointLight(vec3(-1.0, 0.0, 0.0), vec3(0.4, 1.0, 0.2), 1.0, vec3(1.0), 1.0);
+PointLight lights[MAX_LIGHT_COUNT] = PointLight[](
+	PointLight(vec3(-1.0, 0.0, 0.0), vec3(0.4, 1.0, 0.2), 1.0, vec3(1.0), 1.0),
+	PointLight(vec3(1.0, 1.0, 0.0), vec3(1.0, 0.4, 0.2), 1.0, vec3(1.0), 1.0),
+	PointLight(vec3(0.0, 1.0, 1.0), vec3(0.2, 0.4, 1.0), 1.0, vec3(1.0), 1.0),
+	PointLight(vec3(0.0, -1.0, -1.0), vec3(1.0), 0.5, vec3(1.0), 1.0));
 
 void main()
 {
@@ -35,12 +61,19 @@ void main()
 
 	fragLighting.ambient = vec3(0.1);
 
-	vec3 lightDir = normalize(light0.position - fragPos);
-	float diff = max(dot(normal, lightDir), 0.0);
-	fragLighting.diffuse = diff * light0.diffuseColor * light0.diffusePower;
+	// the loop bound is a constant of the variant, the compiler unrolls it
+	fragLighting.diffuse = vec3(0.0);
+	for (int i = 0; i < min(LIGHT_COUNT, MAX_LIGHT_COUNT); ++i)
+	{
+		vec3 lightDir = normalize(lights[i].position - fragPos);
+		float diff = max(dot(normal, lightDir), 0.0);
+		fragLighting.diffuse += diff * lights[i].diffuseColor * lights[i].diffusePower;
+	}
 
 	fragLighting.specular = vec3(0.0);
 
-	oColor = texture(texSampler, fragUV);
+	oColor = USE_TEXTURE ? texture(texSampler, fragUV) : vec4(fragColor, 1.0);
+	if (ALPHA_TEST && oColor.a < 0.5)
+		discard;
 	oColor *= vec4(fragLighting.ambient + fragLighting.diffuse + fragLighting.specular, 1.0);
 }
\ No newline at end of file
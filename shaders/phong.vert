@@ -4,25 +4,30 @@ layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec3 aColor;
 layout(location = 3) in vec2 aUV;
+// per instance (see internal/engine/instance_data.hpp)
+layout(location = 4) in mat4 aModel;
+layout(location = 8) in uint aTextureSlot;
 
 layout(location = 0) out vec3 fragNormal;
 layout(location = 1) out vec3 fragColor;
 layout(location = 2) out vec2 fragUV;
 layout(location = 3) out vec3 fragPos;
+layout(location = 4) flat out uint fragTextureSlot;
 
-layout(binding = 0) uniform MVPUniformBufferObject
+// per frame (see RenderStateABC::CameraT)
+layout(set = 0, binding = 0) uniform CameraUniformBufferObject
 {
-	mat4 model;
 	mat4 view;
 	mat4 proj;
-} mvp;
+} camera;
 
 void main()
 {
-	gl_Position = mvp.proj * mvp.view * mvp.model * vec4(aPos, 1.0);
+	gl_Position = camera.proj * camera.view * aModel * vec4(aPos, 1.0);
 
-	fragPos = vec3(mvp.model * vec4(aPos, 1.0));
+	fragPos = vec3(aModel * vec4(aPos, 1.0));
 	fragNormal = normalize(aNormal);
 	fragColor = aColor;
 	fragUV = aUV;
+	fragTextureSlot = aTextureSlot;
 }
\ No newline at end of file
@@ -1,11 +1,26 @@
 #version 450
 
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragUV;
 
 layout(location = 0) out vec4 oColor;
 
-layout(binding = 1) uniform sampler2D texSampler;
+#ifdef BINDLESS
+// device wide table (see internal/graphics/bindless_table.hpp) in place of the material set, the instances
+// of a draw may read different slots
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(location = 2) flat in uint fragTextureSlot;
+
+#define texSampler textures[nonuniformEXT(fragTextureSlot)]
+#else
+// material set
+layout(set = 1, binding = 0) uniform sampler2D texSampler;
+#endif
 
 void main()
 {
@@ -1,5 +1,9 @@
+#include <algorithm>
 #include <assimp/Importer.hpp>
+#include <cstdlib>
+#include <thread>
 
+#include "graphics/allocation_stress.hpp"
 #include "graphics/context.hpp"
 #include "graphics/device.hpp"
 #include "graphics/pipeline.hpp"
@@ -10,9 +14,11 @@
 #include "renderer/render_state.hpp"
 #include "renderer/renderer.hpp"
 #include "renderer/scene.hpp"
+#include "renderer/streaming_benchmark.hpp"
 #include "renderer/texture.hpp"
 
 #include "engine/camera.hpp"
+#include "engine/shader_constants.hpp"
 #include "engine/uniform.hpp"
 #include "engine/vertex.hpp"
 
@@ -54,14 +60,25 @@ Application::Application()
 
     m_window->setSwapChain(std::move(std::make_unique<SwapChain>(mainDevice)));
 
+    if (const char *benchmarkDrawCount = std::getenv("VKPG_RECORDING_BENCHMARK"))
+        m_recordingBenchmarkDrawCount = static_cast<uint32_t>(std::strtoul(benchmarkDrawCount, nullptr, 10));
+    if (const char *stressBufferCount = std::getenv("VKPG_ALLOCATION_STRESS"))
+        m_allocationStressBufferCount = static_cast<uint32_t>(std::strtoul(stressBufferCount, nullptr, 10));
+    if (const char *benchmarkSize = std::getenv("VKPG_STREAMING_BENCHMARK"))
+        m_streamingBenchmarkSize = static_cast<uint32_t>(std::strtoul(benchmarkSize, nullptr, 10));
+
     RendererBuilder rb;
     rb.setDevice(mainDevice);
     rb.setSwapChain(m_window->getSwapChain());
+    // the benchmark compares 1, 2, 4 and 8 threads whatever the number of cores
+    uint32_t threadCount = std::clamp(std::thread::hardware_concurrency(), 1U, 8U);
+    rb.setRecordingThreadCount(m_recordingBenchmarkDrawCount > 0 ? 8U : threadCount);
     m_renderer = rb.build();
 }
 
 Application::~Application()
 {
+    m_streamingBenchmark.reset();
     m_renderer.reset();
     m_scene.reset();
 
@@ -79,49 +96,84 @@ void Application::runLoop()
 
     m_window->makeContextCurrent();
 
+    if (m_allocationStressBufferCount > 0)
+        run_allocation_stress(mainDevice, m_allocationStressBufferCount);
+
+    // compile the pipelines of the previous runs before the scene needs them
+    m_renderer->warmupPipelines();
+
+    // textures are read from the device's bindless table where descriptor indexing is supported
+    bool bBindless = mainDevice->getBindlessTable() != nullptr;
+
+    // every material is drawn with the same descriptor set layouts
+    auto createMaterialBuilder = [&](PipelineBuilder &pb, const char *shaderName) {
+        PipelineDirector pd;
+        pd.createColorDepthRasterizerBuilder(pb);
+        pb.setDevice(mainDevice);
+        pb.addVertexShaderStage(shaderName);
+        pb.setRenderPass(m_renderer->getRenderPass());
+        pb.setExtent(m_window->getSwapChain()->getExtent());
+        pb.addUniformDescriptorPack(m_renderer->getFrameDescriptorPack());
+        // the model matrix and the texture slot are read per instance (see InstanceData)
+        if (bBindless)
+        {
+            pb.addFragmentShaderStage((std::string(shaderName) + "_bindless").c_str());
+            pb.setBindless(true);
+        }
+        else
+        {
+            pb.addFragmentShaderStage(shaderName);
+            UniformDescriptorBuilder udb;
+            udb.addSetLayoutBinding(VkDescriptorSetLayoutBinding{
+                .binding = 0,
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            });
+            pb.addUniformDescriptorPack(udb.build());
+        }
+    };
+
+    // generic pipeline drawn with while the materials compile in the background
+    PipelineBuilder fallbackBuilder;
+    createMaterialBuilder(fallbackBuilder, "unlit");
+    std::shared_ptr<Pipeline> fallbackPipeline = fallbackBuilder.build();
+
     m_scene = std::make_unique<Scene>(mainDevice);
     auto objects = m_scene->getObjects();
     for (int i = 0; i < objects.size(); ++i)
     {
         MeshRenderStateBuilder mrsb;
-        mrsb.setFrameInFlightCount(m_window->getSwapChain()->getFrameInFlightCount());
-        mrsb.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        mrsb.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
         mrsb.setDevice(mainDevice);
         mrsb.setTexture(objects[i]->getTexture());
         mrsb.setMesh(objects[i]);
 
-        // material
+        // material (objects of the same material share their pipeline through the device's registry)
         PipelineBuilder pb;
-        PipelineDirector pd;
-        pd.createColorDepthRasterizerBuilder(pb);
-        pb.setDevice(mainDevice);
-        pb.addVertexShaderStage("phong");
-        pb.addFragmentShaderStage("phong");
-        pb.setRenderPass(m_renderer->getRenderPass());
-        pb.setExtent(m_window->getSwapChain()->getExtent());
-        UniformDescriptorBuilder udb;
-        udb.addSetLayoutBinding(VkDescriptorSetLayoutBinding{
-            .binding = 0,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-        });
-        udb.addSetLayoutBinding(VkDescriptorSetLayoutBinding{
-            .binding = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-        });
-        pb.setUniformDescriptorPack(udb.build());
-
-        mrsb.setPipeline(pb.build());
+        createMaterialBuilder(pb, "phong");
+        pb.setSpecializationConstant<Phong::LightCount>(VK_SHADER_STAGE_FRAGMENT_BIT, 1);
+        pb.setSpecializationConstant<Phong::UseTexture>(VK_SHADER_STAGE_FRAGMENT_BIT,
+                                                        !objects[i]->getTexture().expired());
+        pb.setSpecializationConstant<Phong::AlphaTest>(VK_SHADER_STAGE_FRAGMENT_BIT, VK_FALSE);
+        mrsb.setPipeline(fallbackPipeline);
+        mrsb.setPendingPipeline(pb.buildAsync());
+        // cull mode, depth test... are recorded per draw on devices with extended dynamic state
+        mrsb.setDynamicState(pb.getDynamicState());
 
         m_renderer->registerRenderState(mrsb.build());
     }
 
     Camera camera;
 
+    if (m_recordingBenchmarkDrawCount > 0)
+        m_renderer->benchmarkRecording(camera, m_recordingBenchmarkDrawCount);
+
+    if (m_streamingBenchmarkSize > 0)
+    {
+        m_streamingBenchmark = std::make_unique<StreamingBenchmark>(
+            mainDevice, static_cast<VkDeviceSize>(m_streamingBenchmarkSize) * 1024 * 1024);
+    }
+
     std::pair<double, double> mousePos;
     glfwGetCursorPos(m_window->getHandle(), &mousePos.first, &mousePos.second);
     glfwSetInputMode(m_window->getHandle(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -161,15 +213,25 @@ void Application::runLoop()
 
         camera.setTransform(cameraTransform);
 
+        // a frame whose image could not be acquired is skipped, its fence is left signaled
         uint32_t imageIndex = m_renderer->acquireBackBuffer();
+        if (imageIndex != static_cast<uint32_t>(-1))
+        {
+            m_renderer->recordRenderers(imageIndex, camera);
 
-        m_renderer->recordRenderers(imageIndex, camera);
-
-        m_renderer->submitBackBuffer();
-        m_renderer->presentBackBuffer(imageIndex);
+            m_renderer->submitBackBuffer(imageIndex);
+            m_renderer->presentBackBuffer(imageIndex);
+        }
 
         m_renderer->swapBuffers();
 
+        // the batches are submitted after the frame, the next one acquires them
+        if (m_streamingBenchmark)
+            m_streamingBenchmark->update(deltaTime);
+
         m_window->swapBuffers();
+
+        // keep the pipeline cache on disk even if the application does not exit cleanly
+        mainDevice->getPipelineCache()->saveIfNeeded(std::chrono::seconds(60));
     }
 }
\ No newline at end of file
@@ -10,6 +10,7 @@ class Context;
 class Device;
 class Renderer;
 class Scene;
+class StreamingBenchmark;
 
 class Application
 {
@@ -25,6 +26,14 @@ class Application
 
     Time::TimeManager m_timeManager;
 
+    // draws of the recording benchmark run before the loop (VKPG_RECORDING_BENCHMARK), 0 if disabled
+    uint32_t m_recordingBenchmarkDrawCount = 0;
+    // buffers created by the allocation stress test before the loop (VKPG_ALLOCATION_STRESS), 0 if disabled
+    uint32_t m_allocationStressBufferCount = 0;
+    // megabytes streamed during the loop by the streaming benchmark (VKPG_STREAMING_BENCHMARK), 0 if disabled
+    uint32_t m_streamingBenchmarkSize = 0;
+    std::unique_ptr<StreamingBenchmark> m_streamingBenchmark;
+
   public:
     Application();
     ~Application();